@@ -0,0 +1,274 @@
+#include "Bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace route {
+
+static constexpr size_t kWords = 65536 / 64;
+
+void Bitmap::Container::toBits()
+{
+    bits.assign(kWords, 0);
+    for (uint16_t v : array) {
+        bits[v >> 6] |= 1ULL << (v & 63);
+    }
+    std::vector<uint16_t>().swap(array);
+}
+
+void Bitmap::Container::toArray()
+{
+    array.clear();
+    array.reserve(card);
+    for (size_t i = 0; i < kWords; ++i) {
+        uint64_t w = bits[i];
+        while (w) {
+            array.push_back(static_cast<uint16_t>(i * 64 + __builtin_ctzll(w)));
+            w &= w - 1;
+        }
+    }
+    std::vector<uint64_t>().swap(bits);
+}
+
+void Bitmap::Container::add(uint16_t low)
+{
+    if (isBits()) {
+        uint64_t& w = bits[low >> 6];
+        uint64_t mask = 1ULL << (low & 63);
+        card += (w & mask) == 0;
+        w |= mask;
+        return;
+    }
+    if (array.empty() || array.back() < low) {
+        array.push_back(low);
+    } else {
+        auto it = std::lower_bound(array.begin(), array.end(), low);
+        if (*it == low) {
+            return;
+        }
+        array.insert(it, low);
+    }
+    if (++card > kArrayMax) {
+        toBits();
+    }
+}
+
+bool Bitmap::Container::contains(uint16_t low) const
+{
+    if (isBits()) {
+        return (bits[low >> 6] >> (low & 63)) & 1;
+    }
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+Bitmap::Container Bitmap::And(const Container& a, const Container& b)
+{
+    Container c;
+    c.key = a.key;
+    c.card = 0;
+    if (a.isBits() && b.isBits()) {
+        c.bits.resize(kWords);
+        for (size_t i = 0; i < kWords; ++i) {
+            c.bits[i] = a.bits[i] & b.bits[i];
+            c.card += __builtin_popcountll(c.bits[i]);
+        }
+        if (c.card <= kArrayMax) {
+            c.toArray();
+        }
+    } else if (a.isBits() || b.isBits()) {
+        const Container& arr = a.isBits() ? b : a;
+        const Container& bm = a.isBits() ? a : b;
+        for (uint16_t v : arr.array) {
+            if (bm.contains(v)) {
+                c.array.push_back(v);
+            }
+        }
+        c.card = c.array.size();
+    } else {
+        std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                              std::back_inserter(c.array));
+        c.card = c.array.size();
+    }
+    return c;
+}
+
+Bitmap::Container Bitmap::Or(const Container& a, const Container& b)
+{
+    Container c;
+    c.key = a.key;
+    c.card = 0;
+    if (a.isBits() && b.isBits()) {
+        c.bits.resize(kWords);
+        for (size_t i = 0; i < kWords; ++i) {
+            c.bits[i] = a.bits[i] | b.bits[i];
+            c.card += __builtin_popcountll(c.bits[i]);
+        }
+    } else if (a.isBits() || b.isBits()) {
+        const Container& arr = a.isBits() ? b : a;
+        c = a.isBits() ? a : b;
+        c.key = a.key;
+        for (uint16_t v : arr.array) {
+            c.add(v);
+        }
+    } else {
+        c.array.reserve(a.array.size() + b.array.size());
+        std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                       std::back_inserter(c.array));
+        c.card = c.array.size();
+        if (c.card > kArrayMax) {
+            c.toBits();
+        }
+    }
+    return c;
+}
+
+Bitmap Bitmap::Range(uint32_t n)
+{
+    Bitmap b;
+    for (uint64_t start = 0; start < n; start += 65536) {
+        Container c;
+        c.key = static_cast<uint16_t>(start >> 16);
+        c.card = static_cast<uint32_t>(std::min<uint64_t>(65536, n - start));
+        if (c.card <= kArrayMax) {
+            for (uint32_t i = 0; i < c.card; ++i) {
+                c.array.push_back(static_cast<uint16_t>(i));
+            }
+        } else {
+            c.bits.assign(kWords, 0);
+            size_t full = c.card / 64;
+            std::fill(c.bits.begin(), c.bits.begin() + full, ~0ULL);
+            if (c.card % 64) {
+                c.bits[full] = (1ULL << (c.card % 64)) - 1;
+            }
+        }
+        b._containers.push_back(std::move(c));
+    }
+    return b;
+}
+
+Bitmap::Container* Bitmap::find(uint16_t key)
+{
+    auto it = std::lower_bound(_containers.begin(), _containers.end(), key,
+                               [](const Container& c, uint16_t k) { return c.key < k; });
+    return it != _containers.end() && it->key == key ? &*it : nullptr;
+}
+
+const Bitmap::Container* Bitmap::find(uint16_t key) const
+{
+    return const_cast<Bitmap*>(this)->find(key);
+}
+
+void Bitmap::add(uint32_t x)
+{
+    uint16_t key = static_cast<uint16_t>(x >> 16);
+    Container* c = nullptr;
+    if (!_containers.empty() && _containers.back().key == key) {
+        c = &_containers.back();
+    } else if (_containers.empty() || _containers.back().key < key) {
+        _containers.emplace_back();
+        c = &_containers.back();
+        c->key = key;
+        c->card = 0;
+    } else {
+        c = find(key);
+        if (!c) {
+            auto it = std::lower_bound(_containers.begin(), _containers.end(), key,
+                                       [](const Container& c, uint16_t k) { return c.key < k; });
+            it = _containers.insert(it, Container());
+            it->key = key;
+            it->card = 0;
+            c = &*it;
+        }
+    }
+    c->add(static_cast<uint16_t>(x));
+}
+
+bool Bitmap::contains(uint32_t x) const
+{
+    const Container* c = find(static_cast<uint16_t>(x >> 16));
+    return c && c->contains(static_cast<uint16_t>(x));
+}
+
+uint64_t Bitmap::cardinality() const
+{
+    uint64_t n = 0;
+    for (const auto& c : _containers) {
+        n += c.card;
+    }
+    return n;
+}
+
+Bitmap& Bitmap::operator&=(const Bitmap& other)
+{
+    std::vector<Container> out;
+    size_t i = 0, j = 0;
+    while (i < _containers.size() && j < other._containers.size()) {
+        const Container& a = _containers[i];
+        const Container& b = other._containers[j];
+        if (a.key < b.key) {
+            ++i;
+        } else if (b.key < a.key) {
+            ++j;
+        } else {
+            Container c = And(a, b);
+            if (c.card) {
+                out.push_back(std::move(c));
+            }
+            ++i;
+            ++j;
+        }
+    }
+    _containers.swap(out);
+    return *this;
+}
+
+Bitmap& Bitmap::operator|=(const Bitmap& other)
+{
+    std::vector<Container> out;
+    out.reserve(_containers.size() + other._containers.size());
+    size_t i = 0, j = 0;
+    while (i < _containers.size() || j < other._containers.size()) {
+        if (j == other._containers.size() ||
+            (i < _containers.size() && _containers[i].key < other._containers[j].key)) {
+            out.push_back(std::move(_containers[i++]));
+        } else if (i == _containers.size() || other._containers[j].key < _containers[i].key) {
+            out.push_back(other._containers[j++]);
+        } else {
+            out.push_back(Or(_containers[i++], other._containers[j++]));
+        }
+    }
+    _containers.swap(out);
+    return *this;
+}
+
+void Bitmap::toVector(std::vector<uint32_t>& out) const
+{
+    out.reserve(out.size() + cardinality());
+    for (const auto& c : _containers) {
+        uint32_t high = static_cast<uint32_t>(c.key) << 16;
+        if (c.isBits()) {
+            for (size_t i = 0; i < kWords; ++i) {
+                uint64_t w = c.bits[i];
+                while (w) {
+                    out.push_back(high | static_cast<uint32_t>(i * 64 + __builtin_ctzll(w)));
+                    w &= w - 1;
+                }
+            }
+        } else {
+            for (uint16_t v : c.array) {
+                out.push_back(high | v);
+            }
+        }
+    }
+}
+
+size_t Bitmap::bytes() const
+{
+    size_t n = sizeof(Bitmap) + _containers.capacity() * sizeof(Container);
+    for (const auto& c : _containers) {
+        n += c.array.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+    }
+    return n;
+}
+
+} //end namespace route
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace route {
+
+/**
+ * @brief roaring 风格的压缩位图
+ *
+ * 32 位整数按高 16 位分桶, 每个桶一个容器: 元素不超过 kArrayMax 时为有序 uint16 数组,
+ * 否则为 65536 位的位图. 容器按高 16 位有序存放.
+ */
+class Bitmap {
+public:
+    static constexpr uint32_t kArrayMax = 4096;
+
+    Bitmap() = default;
+
+    // [0, n) 全部置位
+    static Bitmap Range(uint32_t n);
+
+    // 按升序追加最快, 乱序也可以
+    void add(uint32_t x);
+    bool contains(uint32_t x) const;
+    bool empty() const { return _containers.empty(); }
+    uint64_t cardinality() const;
+
+    Bitmap& operator&=(const Bitmap& other);
+    Bitmap& operator|=(const Bitmap& other);
+
+    // 升序输出所有元素
+    void toVector(std::vector<uint32_t>& out) const;
+
+    // 容器占用的字节数
+    size_t bytes() const;
+
+private:
+    struct Container {
+        uint16_t key;
+        uint32_t card;
+        // 二者只有一个非空
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bits;
+
+        bool isBits() const { return !bits.empty(); }
+        void toBits();
+        void toArray();
+        void add(uint16_t low);
+        bool contains(uint16_t low) const;
+    };
+
+    static Container And(const Container& a, const Container& b);
+    static Container Or(const Container& a, const Container& b);
+
+    Container* find(uint16_t key);
+    const Container* find(uint16_t key) const;
+
+private:
+    std::vector<Container> _containers;
+}; // Bitmap
+
+} // end namespace route
@@ -10,7 +10,13 @@
 #ifndef _CHECKCASTNOTHROW_H_
 #define _CHECKCASTNOTHROW_H_
 
+#include <errno.h>
+#include <stdlib.h>
+#include <limits>
 #include <string>
+#include <string_view>
+#include <charconv>
+#include <type_traits>
 
 namespace gsl
 {
@@ -98,6 +104,14 @@ template <> inline int check_cast <short, long>(long value, short &dest)
 
 template <> inline int check_cast <int, long>(long value, int &dest)
 {
+    if (value < static_cast<long>(std::numeric_limits<int>::min()))
+    {
+        return -1;
+    }
+    if (value > static_cast<long>(std::numeric_limits<int>::max()))
+    {
+        return -1;
+    }
     dest = static_cast <int>(value);
     return 0;
 }
@@ -118,10 +132,32 @@ template <>
 inline int check_cast <unsigned int, unsigned long>(unsigned long value,
                                                     unsigned int &dest)
 {
+    if (value > static_cast<unsigned long>(std::numeric_limits<unsigned int>::max()))
+    {
+        return -1;
+    }
     dest = static_cast <unsigned int>(value);
     return 0;
 }
 
+/**
+ * @brief strto* 系列的返回值转换
+ *
+ * @return 0-完整转换, 1-结尾有无效字符, -1-没有可转换的数字或溢出
+ */
+inline int strto_result(const char *s, const char *end)
+{
+    if (end == s)
+    {
+        return -1;
+    }
+    if (errno == ERANGE)
+    {
+        return -1;
+    }
+    return *end == '\0' ? 0 : 1;
+}
+
 //from c-style string
 template <> inline int check_cast <char, const char *>(const char *s, char &dest)
 {
@@ -135,9 +171,14 @@ template <> inline int check_cast <char, const char *>(const char *s, char &dest
 
 template <> inline int check_cast <long, const char *>(const char *s, long &dest)
 {
+    if (!s)
+    {
+        return -1;
+    }
     char* end = NULL;
+    errno = 0;
     dest = strtol(s, &end, 10);
-    return 0;
+    return strto_result(s, end);
 }
 
 //signed char is used as int8
@@ -195,16 +236,26 @@ template <> inline int check_cast <int, const char *>(const char *s, int &dest)
 
 template <> inline int check_cast <long long, const char *>(const char *s, long long &dest)
 {
+    if (!s)
+    {
+        return -1;
+    }
     char* end = NULL;
+    errno = 0;
     dest = strtoll(s, &end, 10);
-    return 0;
+    return strto_result(s, end);
 }
 
 template <> inline int check_cast <unsigned long, const char *>(const char *s, unsigned long &dest)
 {
+    if (!s)
+    {
+        return -1;
+    }
     char* end = NULL;
+    errno = 0;
     dest = strtoul(s, &end, 10);
-    return 0;
+    return strto_result(s, end);
 }
 
 template <>
@@ -237,23 +288,38 @@ inline int check_cast <unsigned int, const char *>(const char *s, unsigned int &
 template <>
 inline int check_cast <unsigned long long, const char *>(const char *s, unsigned long long &dest)
 {
+    if (!s)
+    {
+        return -1;
+    }
     char* end = NULL;
+    errno = 0;
     dest = strtoull(s, &end, 10);
-    return 0;
+    return strto_result(s, end);
 }
 
 template <> inline int check_cast <float, const char *>(const char *s, float &dest)
 {
+    if (!s)
+    {
+        return -1;
+    }
     char* end = NULL;
+    errno = 0;
     dest = strtof(s, &end);
-    return 0;
+    return strto_result(s, end);
 }
 
 template <> inline int check_cast <double, const char *>(const char *s, double &dest)
 {
+    if (!s)
+    {
+        return -1;
+    }
     char* end = NULL;
+    errno = 0;
     dest = strtod(s, &end);
-    return 0;
+    return strto_result(s, end);
 }
 
 template <> int check_cast <long double, const char *>(const char *s, long double &dest);
@@ -392,6 +458,54 @@ inline int check_cast <std::string, const char *>(const char *value, std::string
     dest = value;
     return 0;
 }
+
+/**
+ * @brief 从 std::string_view 转换, 基于 std::from_chars, 不分配内存也不要求 '\0' 结尾
+ *
+ * 与 strto* 一致, 跳过前导空白和数值前的 '+'.
+ *
+ * @return 0-转换成功
+ *         1-结尾有无效字符, dest 为有效前缀的值
+ *         -1-没有可转换的数字或溢出, dest 不变
+ */
+template <typename DestType> inline int check_cast(std::string_view value, DestType & dest)
+{
+    if constexpr (std::is_same<DestType, std::string>::value)
+    {
+        dest.assign(value.data(), value.size());
+        return 0;
+    }
+    else if constexpr (std::is_same<DestType, char>::value)
+    {
+        if (value.empty())
+        {
+            return -1;
+        }
+        dest = value[0];
+        return 0;
+    }
+    else
+    {
+        const char *p = value.data();
+        const char *end = p + value.size();
+        while (p < end && (*p == ' ' || *p == '\t'))
+        {
+            ++p;
+        }
+        if (p < end && *p == '+')
+        {
+            ++p;
+        }
+        DestType v;
+        std::from_chars_result res = std::from_chars(p, end, v);
+        if (res.ec != std::errc())
+        {
+            return -1;
+        }
+        dest = v;
+        return res.ptr == end ? 0 : 1;
+    }
+}
 }
 
 #endif /* _CHECKCASTNOTHROW_H_ */
@@ -0,0 +1,39 @@
+#include "CoarseClock.h"
+
+#include <time.h>
+#include <chrono>
+#include <thread>
+
+namespace route {
+
+void CoarseClock::tick()
+{
+    time_t t = time(NULL);
+    struct tm tm;
+    localtime_r(&t, &tm);
+    _hour.store(tm.tm_hour, std::memory_order_relaxed);
+    _wday.store(tm.tm_wday, std::memory_order_relaxed);
+    _now.store(static_cast<int64_t>(t), std::memory_order_relaxed);
+}
+
+void CoarseClock::start(int interval_ms)
+{
+    // 只由启动线程的调用者刷新, 其余调用者等第一次刷新完成, 不与后台线程同时写
+    bool expected = false;
+    if (!_started.compare_exchange_strong(expected, true)) {
+        while (!_ready.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        return;
+    }
+    tick();
+    _ready.store(true, std::memory_order_release);
+    std::thread([interval_ms]() {
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+            tick();
+        }
+    }).detach();
+}
+
+} //end namespace route
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+namespace route {
+
+/**
+ * @brief 进程级的粗粒度时钟
+ *
+ * 后台线程每隔 interval_ms 刷新一次当前时间及本地时区的小时/星期,
+ * 求值时只读原子变量, 不做系统调用. 精度为刷新间隔.
+ */
+class CoarseClock {
+public:
+    // 启动后台刷新线程, 重复调用无副作用; 返回前已完成第一次刷新
+    static void start(int interval_ms = 100);
+
+    // 立即刷新一次
+    static void tick();
+
+    // epoch 秒
+    static inline int64_t now()
+    {
+        return _now.load(std::memory_order_relaxed);
+    }
+
+    // 本地时间的小时, 0-23
+    static inline int32_t hour()
+    {
+        return _hour.load(std::memory_order_relaxed);
+    }
+
+    // 本地时间的星期, 0-6, 0 为星期日
+    static inline int32_t wday()
+    {
+        return _wday.load(std::memory_order_relaxed);
+    }
+
+private:
+    static inline std::atomic<int64_t> _now{0};
+    static inline std::atomic<int32_t> _hour{0};
+    static inline std::atomic<int32_t> _wday{0};
+    static inline std::atomic<bool> _started{false};
+    // 第一次刷新已完成
+    static inline std::atomic<bool> _ready{false};
+}; // CoarseClock
+
+} // end namespace route
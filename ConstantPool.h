@@ -0,0 +1,271 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+namespace route {
+
+/**
+ * @brief 常量池的内存统计
+ *
+ * referenced 为各叶子各自保存常量时需要的字节数, stored 为池中实际保存的字节数.
+ * free_bytes 为引用归零后等待复用的空间.
+ * node_bytes 为表达式树本身 (节点, checker, 未入池的常量) 的字节数, 由规则集统计时填写.
+ */
+struct PoolStats {
+    size_t lists;
+    size_t references;
+    size_t stored_bytes;
+    size_t referenced_bytes;
+    size_t free_lists;
+    size_t free_bytes;
+    size_t nodes;
+    size_t node_bytes;
+
+    PoolStats(): lists(0), references(0), stored_bytes(0), referenced_bytes(0), free_lists(0), free_bytes(0),
+    nodes(0), node_bytes(0) {}
+
+    size_t saved() const
+    {
+        return referenced_bytes > stored_bytes ? referenced_bytes - stored_bytes : 0;
+    }
+
+    PoolStats& operator+=(const PoolStats& o)
+    {
+        lists += o.lists;
+        references += o.references;
+        stored_bytes += o.stored_bytes;
+        referenced_bytes += o.referenced_bytes;
+        free_lists += o.free_lists;
+        free_bytes += o.free_bytes;
+        nodes += o.nodes;
+        node_bytes += o.node_bytes;
+        return *this;
+    }
+};
+
+template<typename T>
+inline size_t ValueBytes(const T& v)
+{
+    return sizeof(T);
+}
+
+template<>
+inline size_t ValueBytes<std::string>(const std::string& v)
+{
+    // 超出 SSO 的部分在堆上
+    return sizeof(std::string) + (v.size() > 15 ? v.capacity() + 1 : 0);
+}
+
+class PoolBase {
+public:
+    virtual ~PoolBase() = default;
+    virtual PoolStats stats() const = 0;
+};
+
+/**
+ * @brief 同一类型常量列表的池
+ *
+ * 内容相同的列表只保存一份, 以 32 位句柄 (从 1 开始) 引用并计数.
+ * 列表按块连续存放, 块不会移动, 因此 get 返回的指针在列表被引用期间有效.
+ * 引用计数归零的列表连同句柄进入空闲表, 之后长度不超过其容量的新列表优先复用 (取容量最小的一个),
+ * 规则反复增删时池的大小不会一直增长.
+ */
+template<typename T>
+class TypedPool : public PoolBase {
+public:
+    static constexpr size_t kChunkSize = 4096;
+
+    uint32_t intern(const T* values, size_t n)
+    {
+        uint64_t h = hash(values, n);
+        auto range = _index.equal_range(h);
+        for (auto it = range.first; it != range.second; ++it) {
+            Entry& e = _entries[it->second - 1];
+            if (e.count == n && std::equal(values, values + n, e.data)) {
+                ++e.refs;
+                return it->second;
+            }
+        }
+        uint32_t handle;
+        auto reuse = _free.lower_bound(static_cast<uint32_t>(n));
+        if (reuse != _free.end()) {
+            handle = reuse->second;
+            _free.erase(reuse);
+        } else {
+            Entry e;
+            e.data = allocate(n);
+            e.capacity = static_cast<uint32_t>(n);
+            _entries.push_back(e);
+            handle = static_cast<uint32_t>(_entries.size());
+        }
+        Entry& e = _entries[handle - 1];
+        e.hash = h;
+        e.count = static_cast<uint32_t>(n);
+        e.refs = 1;
+        std::copy(values, values + n, e.data);
+        _index.emplace(h, handle);
+        return handle;
+    }
+
+    void release(uint32_t handle)
+    {
+        if (!handle || handle > _entries.size() || !_entries[handle - 1].refs) {
+            return;
+        }
+        Entry& e = _entries[handle - 1];
+        if (--e.refs) {
+            return;
+        }
+        auto range = _index.equal_range(e.hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == handle) {
+                _index.erase(it);
+                break;
+            }
+        }
+        // 释放 std::string 等值在堆上的内容
+        std::fill(e.data, e.data + e.count, T());
+        e.count = 0;
+        _free.emplace(e.capacity, handle);
+    }
+
+    const T* get(uint32_t handle, uint32_t& count) const
+    {
+        const Entry& e = _entries[handle - 1];
+        count = e.count;
+        return e.data;
+    }
+
+    PoolStats stats() const override
+    {
+        PoolStats s;
+        for (const auto& e : _entries) {
+            if (!e.refs) {
+                ++s.free_lists;
+                s.free_bytes += e.capacity * sizeof(T);
+                continue;
+            }
+            size_t bytes = 0;
+            for (uint32_t i = 0; i < e.count; ++i) {
+                bytes += ValueBytes(e.data[i]);
+            }
+            ++s.lists;
+            s.references += e.refs;
+            s.stored_bytes += bytes;
+            s.referenced_bytes += bytes * e.refs;
+        }
+        return s;
+    }
+
+private:
+    struct Entry {
+        T* data;
+        uint64_t hash;
+        uint32_t capacity;
+        uint32_t count;
+        uint32_t refs;
+    };
+
+    static uint64_t hash(const T* values, size_t n)
+    {
+        uint64_t h = 0xcbf29ce484222325ULL ^ n;
+        std::hash<T> hasher;
+        for (size_t i = 0; i < n; ++i) {
+            h = (h ^ hasher(values[i])) * 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    // 块大小从 64 个值开始倍增到 kChunkSize, 小规则集不会预留过多内存
+    T* allocate(size_t n)
+    {
+        if (n > kChunkSize) {
+            _chunks.emplace_back(new T[n]);
+            return _chunks.back().get();
+        }
+        if (!_current || _used + n > _chunk_size) {
+            _chunk_size = std::min(kChunkSize, std::max<size_t>(_chunk_size * 2, std::max<size_t>(n, 64)));
+            _chunks.emplace_back(new T[_chunk_size]);
+            _current = _chunks.back().get();
+            _used = 0;
+        }
+        T* p = _current + _used;
+        _used += n;
+        return p;
+    }
+
+private:
+    std::vector<Entry> _entries;
+    std::unordered_multimap<uint64_t, uint32_t> _index;
+    // 容量 -> 引用归零的句柄
+    std::multimap<uint32_t, uint32_t> _free;
+    std::vector<std::unique_ptr<T[]>> _chunks;
+    T* _current = nullptr;
+    size_t _used = 0;
+    size_t _chunk_size = 32;
+};
+
+/**
+ * @brief 规则集范围的常量池, 每种值类型一个 TypedPool
+ *
+ * intern/release 加锁, 只在编译和更新规则时调用; 求值时直接读取叶子缓存的指针.
+ */
+class ConstantPools {
+public:
+    template<typename T>
+    uint32_t intern(const T* values, size_t n)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return pool<T>().intern(values, n);
+    }
+
+    template<typename T>
+    void release(uint32_t handle)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        pool<T>().release(handle);
+    }
+
+    template<typename T>
+    const T* get(uint32_t handle, uint32_t& count)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return pool<T>().get(handle, count);
+    }
+
+    PoolStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        PoolStats s;
+        for (const auto& kv : _pools) {
+            s += kv.second->stats();
+        }
+        return s;
+    }
+
+private:
+    template<typename T>
+    TypedPool<T>& pool()
+    {
+        std::unique_ptr<PoolBase>& p = _pools[std::type_index(typeid(T))];
+        if (!p) {
+            p.reset(new TypedPool<T>());
+        }
+        return static_cast<TypedPool<T>&>(*p);
+    }
+
+private:
+    mutable std::mutex _mutex;
+    std::map<std::type_index, std::unique_ptr<PoolBase>> _pools;
+}; // ConstantPools
+
+} // end namespace route
@@ -0,0 +1,267 @@
+#include "CounterStore.h"
+#include "CoarseClock.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+namespace route {
+
+static size_t g_default_capacity = 1 << 18;
+static uint32_t g_default_bucket_seconds = 60;
+static std::atomic<bool> g_instantiated(false);
+
+// 竞争失败时重试的次数
+static const int kClaimRetries = 4;
+
+static inline uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hashBytes(uint64_t h, const char* data, size_t len)
+{
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof(w));
+        h = mix(h ^ w);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, len - i);
+    return mix(h ^ tail ^ len);
+}
+
+static inline uint32_t bucketStamp(uint64_t v)
+{
+    return static_cast<uint32_t>(v >> 32);
+}
+
+CounterStore::CounterStore(size_t capacity, uint32_t bucket_seconds):
+_bucket_seconds(std::max<uint32_t>(1, bucket_seconds)),
+_keys(0),
+_evicted(0),
+_replaced(0),
+_dropped(0),
+_stop(false)
+{
+    size_t groups = 1;
+    while (groups * kWays < capacity) {
+        groups <<= 1;
+    }
+    _group_mask = groups - 1;
+    _groups.reset(new Group[groups]);
+    _slots.reset(new Slot[groups * kWays]);
+    for (size_t i = 0; i < groups; ++i) {
+        for (int w = 0; w < kWays; ++w) {
+            _groups[i].keys[w].store(0, std::memory_order_relaxed);
+        }
+    }
+    for (size_t i = 0; i < groups * kWays; ++i) {
+        _slots[i].touched.store(0, std::memory_order_relaxed);
+        for (int b = 0; b < kBuckets; ++b) {
+            _slots[i].buckets[b].store(0, std::memory_order_relaxed);
+        }
+    }
+    CoarseClock::start();
+    _evictor = std::thread(&CounterStore::evictLoop, this);
+}
+
+CounterStore::~CounterStore()
+{
+    _stop.store(true);
+    _evictor.join();
+}
+
+CounterStore& CounterStore::instance()
+{
+    static CounterStore store(g_default_capacity, g_default_bucket_seconds);
+    g_instantiated.store(true);
+    return store;
+}
+
+bool CounterStore::setDefaults(size_t capacity, uint32_t bucket_seconds)
+{
+    if (g_instantiated.load() || capacity == 0 || bucket_seconds == 0) {
+        return false;
+    }
+    g_default_capacity = capacity;
+    g_default_bucket_seconds = bucket_seconds;
+    return true;
+}
+
+uint64_t CounterStore::hashKey(std::string_view event, std::string_view key)
+{
+    uint64_t h = hashBytes(0x9e3779b97f4a7c15ULL, event.data(), event.size());
+    h = hashBytes(h, key.data(), key.size());
+    // 0 表示空槽
+    return h ? h : 1;
+}
+
+uint32_t CounterStore::epoch() const
+{
+    return static_cast<uint32_t>(CoarseClock::now() / _bucket_seconds);
+}
+
+int CounterStore::find(const Group& g, uint64_t h) const
+{
+    for (int w = 0; w < kWays; ++w) {
+        if (g.keys[w].load(std::memory_order_acquire) == h) {
+            return w;
+        }
+    }
+    return -1;
+}
+
+int CounterStore::claim(size_t group, uint64_t h, uint32_t now)
+{
+    Group& g = _groups[group];
+    for (int attempt = 0; attempt < kClaimRetries; ++attempt) {
+        int w = find(g, h);
+        if (w >= 0) {
+            return w;
+        }
+        int oldest = 0;
+        uint32_t oldest_touched = UINT32_MAX;
+        for (w = 0; w < kWays; ++w) {
+            uint64_t k = g.keys[w].load(std::memory_order_relaxed);
+            if (k == 0) {
+                if (g.keys[w].compare_exchange_strong(k, h, std::memory_order_acq_rel)) {
+                    // 桶的标记属于之前的 key, 不需要清零
+                    _slots[group * kWays + w].touched.store(now, std::memory_order_relaxed);
+                    _keys.fetch_add(1, std::memory_order_relaxed);
+                    return w;
+                }
+                break;
+            }
+            uint32_t t = _slots[group * kWays + w].touched.load(std::memory_order_relaxed);
+            if (t < oldest_touched) {
+                oldest_touched = t;
+                oldest = w;
+            }
+        }
+        if (w < kWays) {
+            // 空槽被别人抢先占用, 重新查找
+            continue;
+        }
+        uint64_t k = g.keys[oldest].load(std::memory_order_relaxed);
+        if (k != h && k != 0 && g.keys[oldest].compare_exchange_strong(k, h, std::memory_order_acq_rel)) {
+            // 被替换的 key 正在进行的 add 会写入它自己标记的桶, 新 key 读不到
+            _slots[group * kWays + oldest].touched.store(now, std::memory_order_relaxed);
+            _replaced.fetch_add(1, std::memory_order_relaxed);
+            return oldest;
+        }
+    }
+    return -1;
+}
+
+void CounterStore::add(std::string_view event, std::string_view key, uint32_t n)
+{
+    uint64_t h = hashKey(event, key);
+    size_t group = (h >> 20) & _group_mask;
+    uint32_t now = epoch();
+    int w = claim(group, h, now);
+    if (w < 0) {
+        _dropped.fetch_add(n, std::memory_order_relaxed);
+        return;
+    }
+    Slot& s = _slots[group * kWays + w];
+    std::atomic<uint64_t>& b = s.buckets[now % kBuckets];
+    uint32_t tag = stamp(now, h);
+    uint64_t v = b.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        if (bucketStamp(v) == tag) {
+            next = v + n;
+            continue;
+        }
+        // 桶中是更早的时间或其他 key 的计数; 槽位已被替换时放弃, 不覆盖新 key 的计数
+        if (_groups[group].keys[w].load(std::memory_order_acquire) != h) {
+            _dropped.fetch_add(n, std::memory_order_relaxed);
+            return;
+        }
+        next = static_cast<uint64_t>(tag) << 32 | n;
+    } while (!b.compare_exchange_weak(v, next, std::memory_order_relaxed));
+    if (s.touched.load(std::memory_order_relaxed) != now) {
+        s.touched.store(now, std::memory_order_relaxed);
+    }
+}
+
+uint64_t CounterStore::count(std::string_view event, std::string_view key, uint32_t window) const
+{
+    uint64_t h = hashKey(event, key);
+    size_t group = (h >> 20) & _group_mask;
+    int w = find(_groups[group], h);
+    if (w < 0) {
+        return 0;
+    }
+    const Slot& s = _slots[group * kWays + w];
+    uint32_t now = epoch();
+    uint32_t n = std::min<uint32_t>(kBuckets, std::max<uint32_t>(1, (window + _bucket_seconds - 1) / _bucket_seconds));
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t e = now - i;
+        uint64_t v = s.buckets[e % kBuckets].load(std::memory_order_relaxed);
+        if (bucketStamp(v) == stamp(e, h)) {
+            sum += static_cast<uint32_t>(v);
+        }
+    }
+    return sum;
+}
+
+size_t CounterStore::evict()
+{
+    uint32_t now = epoch();
+    size_t evicted = 0;
+    for (size_t g = 0; g <= _group_mask; ++g) {
+        for (int w = 0; w < kWays; ++w) {
+            uint64_t k = _groups[g].keys[w].load(std::memory_order_relaxed);
+            if (k == 0) {
+                continue;
+            }
+            uint32_t t = _slots[g * kWays + w].touched.load(std::memory_order_relaxed);
+            if (now - t < static_cast<uint32_t>(kBuckets)) {
+                continue;
+            }
+            if (_groups[g].keys[w].compare_exchange_strong(k, 0, std::memory_order_acq_rel)) {
+                ++evicted;
+            }
+        }
+    }
+    if (evicted) {
+        _keys.fetch_sub(evicted, std::memory_order_relaxed);
+        _evicted.fetch_add(evicted, std::memory_order_relaxed);
+    }
+    return evicted;
+}
+
+void CounterStore::evictLoop()
+{
+    // 每个桶周期扫描一次, 按 100ms 检查退出
+    auto next = std::chrono::steady_clock::now() + std::chrono::seconds(_bucket_seconds);
+    while (!_stop.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() >= next) {
+            evict();
+            next = std::chrono::steady_clock::now() + std::chrono::seconds(_bucket_seconds);
+        }
+    }
+}
+
+CounterStats CounterStore::stats() const
+{
+    CounterStats s;
+    s.capacity = (_group_mask + 1) * kWays;
+    s.keys = static_cast<size_t>(std::max<int64_t>(0, _keys.load(std::memory_order_relaxed)));
+    s.evicted = _evicted.load(std::memory_order_relaxed);
+    s.replaced = _replaced.load(std::memory_order_relaxed);
+    s.dropped = _dropped.load(std::memory_order_relaxed);
+    return s;
+}
+
+} //end namespace route
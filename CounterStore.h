@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <string_view>
+#include <thread>
+
+namespace route {
+
+struct CounterStats {
+    size_t capacity;
+    // 当前占用的 key 数
+    size_t keys;
+    // 后台清理掉的过期 key
+    uint64_t evicted;
+    // 组内没有空位时替换掉的最久未更新的 key
+    uint64_t replaced;
+    // 多次竞争失败而丢弃的计数
+    uint64_t dropped;
+};
+
+/**
+ * @brief 按 (事件, 属性值) 计数的滑动窗口计数器, 无锁, 内存固定
+ *
+ * 时间按 bucket_seconds 分桶, 每个 key 保留最近 kBuckets 个桶, 每个桶是一个 64 位原子量:
+ * 高 32 位为桶的时间编号与 key 哈希的高 32 位异或得到的标记, 低 32 位为计数. 标记与 (当前编号, key)
+ * 不符的桶视为 0: 过期的桶, 以及槽位被其他 key 占用前后残留或迟到的更新都不会计入新 key, 不需要清零.
+ * key 按哈希分到各组, 每组 kWays 个 key 放在一个缓存行内, 用 CAS 占用空位.
+ * 组满时替换最久未更新的 key; 后台线程定期释放超过 kBuckets 个桶未更新的 key.
+ *
+ * 窗口按桶计: count(window) 为当前桶加上之前 ceil(window / bucket_seconds) - 1 个桶,
+ * 实际覆盖的时间比 window 多出当前桶已经过去的部分.
+ */
+class CounterStore {
+public:
+    static constexpr int kBuckets = 16;
+    static constexpr int kWays = 8;
+
+    CounterStore(size_t capacity, uint32_t bucket_seconds);
+    ~CounterStore();
+    CounterStore(const CounterStore&) = delete;
+    CounterStore& operator=(const CounterStore&) = delete;
+
+    // COUNT 叶子使用的全局计数器, 第一次调用时按 setDefaults 的参数创建
+    static CounterStore& instance();
+
+    // 需在第一次调用 instance() 之前设置, 之后返回 false
+    static bool setDefaults(size_t capacity, uint32_t bucket_seconds);
+
+    // 记录 n 次事件
+    void add(std::string_view event, std::string_view key, uint32_t n = 1);
+
+    // 最近 window 秒内的事件数, window 超出 kBuckets 个桶时按 kBuckets 个桶计
+    uint64_t count(std::string_view event, std::string_view key, uint32_t window) const;
+
+    // 可以统计的最长窗口
+    uint32_t maxWindow() const { return _bucket_seconds * kBuckets; }
+    uint32_t bucketSeconds() const { return _bucket_seconds; }
+
+    CounterStats stats() const;
+
+    // 释放过期的 key, 后台线程每个桶周期调用一次, 返回释放的个数
+    size_t evict();
+
+private:
+    struct alignas(64) Group {
+        std::atomic<uint64_t> keys[kWays];
+    };
+
+    struct Slot {
+        // 最后一次更新时的桶编号
+        std::atomic<uint32_t> touched;
+        std::atomic<uint64_t> buckets[kBuckets];
+    };
+
+    static uint64_t hashKey(std::string_view event, std::string_view key);
+    // 桶 epoch 属于 key h 时的标记
+    static uint32_t stamp(uint32_t epoch, uint64_t h)
+    {
+        return epoch ^ static_cast<uint32_t>(h >> 32);
+    }
+    uint32_t epoch() const;
+    // 找到 key 所在的槽, 不存在时返回 -1
+    int find(const Group& g, uint64_t h) const;
+    // 占用或替换一个槽, 失败返回 -1
+    int claim(size_t group, uint64_t h, uint32_t now);
+
+    void evictLoop();
+
+private:
+    uint32_t _bucket_seconds;
+    size_t _group_mask;
+    std::unique_ptr<Group[]> _groups;
+    std::unique_ptr<Slot[]> _slots;
+    std::atomic<int64_t> _keys;
+    std::atomic<uint64_t> _evicted;
+    std::atomic<uint64_t> _replaced;
+    std::atomic<uint64_t> _dropped;
+    std::atomic<bool> _stop;
+    std::thread _evictor;
+}; // CounterStore
+
+} // end namespace route
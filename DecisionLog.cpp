@@ -0,0 +1,555 @@
+#include "DecisionLog.h"
+#include "CoarseClock.h"
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+/*
+ * 段文件格式, 整数均为小端:
+ *   文件头  "DLOG" u32 格式版本
+ *   块      u32 负载字节数, u32 记录数, u32 负载的 FNV-1a 校验和, 负载
+ *   记录    u64 key, varint zigzag(version 差), varint zigzag(time 差), varint 规则数,
+ *           每个规则 id 为 varint zigzag(与前一个 id 的差)
+ * version/time 的差相对块内前一条记录, 规则 id 的差相对同一记录的前一个 id, 均从 0 开始.
+ *
+ * 环形缓冲中的记录为 24 字节的定长头 (u32 总长, u32 version, u32 time, u32 规则数, u64 key)
+ * 加上已编码的规则 id, 写线程把 id 部分原样拷入块.
+ */
+
+namespace route {
+
+static const char kMagic[4] = {'D', 'L', 'O', 'G'};
+static const uint32_t kFormatVersion = 1;
+static const size_t kRecordHeader = 24;
+static const size_t kBlockHeader = 12;
+// 读取时能接受的最大块, 防止损坏的长度字段
+static const uint32_t kMaxBlock = 1U << 30;
+
+static std::atomic<uint64_t> g_next_id(1);
+
+struct DecisionLog::Ring {
+    std::unique_ptr<char[]> data;
+    size_t mask;
+    // 生产者 (求值线程) 写入的位置
+    alignas(64) std::atomic<uint64_t> head;
+    // 消费者 (写线程) 读到的位置
+    alignas(64) std::atomic<uint64_t> tail;
+    // 线程退出或日志对象析构
+    std::atomic<bool> closed;
+
+    explicit Ring(size_t bytes): head(0), tail(0), closed(false)
+    {
+        size_t cap = 4096;
+        while (cap < bytes) {
+            cap <<= 1;
+        }
+        data.reset(new char[cap]);
+        mask = cap - 1;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    void put(uint64_t pos, const char* src, size_t len)
+    {
+        size_t off = pos & mask;
+        size_t first = std::min(len, capacity() - off);
+        memcpy(data.get() + off, src, first);
+        memcpy(data.get(), src + first, len - first);
+    }
+
+    void get(uint64_t pos, char* dst, size_t len) const
+    {
+        size_t off = pos & mask;
+        size_t first = std::min(len, capacity() - off);
+        memcpy(dst, data.get() + off, first);
+        memcpy(dst + first, data.get(), len - first);
+    }
+};
+
+// 本线程在各个日志对象中的缓冲, 线程退出时标记为关闭, 写线程取完剩余记录后释放
+struct LocalRings {
+    std::vector<std::pair<uint64_t, std::shared_ptr<void>>> rings;
+    std::vector<std::atomic<bool>*> flags;
+
+    ~LocalRings()
+    {
+        for (auto* f : flags) {
+            f->store(true, std::memory_order_release);
+        }
+    }
+};
+
+static inline void putVarint(std::string& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+static inline bool getVarint(const std::string& in, size_t& pos, uint64_t& v)
+{
+    v = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        uint8_t b = static_cast<uint8_t>(in[pos++]);
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline uint64_t zigzag(int64_t v)
+{
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+template<class T>
+static inline void putFixed(std::string& out, T v)
+{
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static uint32_t checksum(const char* data, size_t len)
+{
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ static_cast<uint8_t>(data[i])) * 16777619U;
+    }
+    return h;
+}
+
+DecisionLog::DecisionLog(const DecisionLogOptions& options):
+_options(options),
+_id(g_next_id.fetch_add(1)),
+_file(nullptr),
+_segment_bytes(0),
+_segment_seq(0),
+_block_records(0),
+_last_version(0),
+_last_time(0),
+_flush_request(0),
+_flush_done(0),
+_stop(false),
+_opened(false),
+_urgent(false),
+_appended(0),
+_dropped(0),
+_written(0),
+_failed(0),
+_bytes(0),
+_blocks(0),
+_segments(0)
+{
+}
+
+DecisionLog::~DecisionLog()
+{
+    if (_writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wakeup.notify_one();
+        _writer.join();
+    }
+    if (_file) {
+        fclose(_file);
+    }
+    std::lock_guard<std::mutex> lock(_rings_mutex);
+    for (auto& r : _rings) {
+        r->closed.store(true, std::memory_order_release);
+    }
+}
+
+uint64_t DecisionLog::hashKey(std::string_view key)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (char ch : key) {
+        h = (h ^ static_cast<uint8_t>(ch)) * 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+bool DecisionLog::open()
+{
+    if (_writer.joinable()) {
+        return true;
+    }
+    CoarseClock::start();
+    if (!openSegment()) {
+        return false;
+    }
+    _writer = std::thread(&DecisionLog::writeLoop, this);
+    _opened.store(true, std::memory_order_release);
+    return true;
+}
+
+bool DecisionLog::openSegment()
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.%lld-%06u.dlog", _options.prefix.c_str(),
+             static_cast<long long>(time(NULL)), ++_segment_seq);
+    _file = fopen(path, "wb");
+    if (!_file) {
+        fprintf(stderr, "open decision log %s failed: %s\n", path, strerror(errno));
+        return false;
+    }
+    std::string header(kMagic, sizeof(kMagic));
+    putFixed(header, kFormatVersion);
+    if (fwrite(header.data(), 1, header.size(), _file) != header.size()) {
+        fprintf(stderr, "write decision log %s failed: %s\n", path, strerror(errno));
+        fclose(_file);
+        _file = nullptr;
+        return false;
+    }
+    _segment_bytes = header.size();
+    _bytes.fetch_add(header.size(), std::memory_order_relaxed);
+    _segments.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+DecisionLog::Ring* DecisionLog::localRing()
+{
+    thread_local LocalRings local;
+    for (size_t i = 0; i < local.rings.size(); ++i) {
+        if (local.rings[i].first == _id) {
+            return static_cast<Ring*>(local.rings[i].second.get());
+        }
+    }
+    // 顺便清理已析构的日志对象留下的缓冲
+    for (size_t i = 0; i < local.rings.size();) {
+        if (local.flags[i]->load(std::memory_order_acquire)) {
+            local.rings.erase(local.rings.begin() + i);
+            local.flags.erase(local.flags.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+    std::shared_ptr<Ring> ring(new Ring(_options.ring_bytes));
+    {
+        std::lock_guard<std::mutex> lock(_rings_mutex);
+        _rings.push_back(ring);
+    }
+    local.rings.emplace_back(_id, ring);
+    local.flags.push_back(&ring->closed);
+    return ring.get();
+}
+
+bool DecisionLog::append(uint64_t key, uint32_t version, const uint32_t* ids, size_t n)
+{
+    if (!_opened.load(std::memory_order_acquire)) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    thread_local std::string scratch;
+    scratch.resize(kRecordHeader);
+    uint32_t prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+        putVarint(scratch, zigzag(static_cast<int64_t>(ids[i]) - prev));
+        prev = ids[i];
+    }
+    uint32_t size = static_cast<uint32_t>(scratch.size());
+    uint32_t now = static_cast<uint32_t>(CoarseClock::now());
+    uint32_t count = static_cast<uint32_t>(n);
+    char* h = &scratch[0];
+    memcpy(h, &size, 4);
+    memcpy(h + 4, &version, 4);
+    memcpy(h + 8, &now, 4);
+    memcpy(h + 12, &count, 4);
+    memcpy(h + 16, &key, 8);
+
+    Ring* ring = localRing();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t used = head - ring->tail.load(std::memory_order_acquire);
+    if (used + size > ring->capacity()) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    ring->put(head, scratch.data(), size);
+    ring->head.store(head + size, std::memory_order_release);
+    _appended.fetch_add(1, std::memory_order_relaxed);
+    // 缓冲过半时提前唤醒写线程, 每轮只唤醒一次; 不持锁通知, 错过时等到下一个周期
+    if ((used + size) * 2 > ring->capacity() && !_urgent.exchange(true, std::memory_order_relaxed)) {
+        _wakeup.notify_one();
+    }
+    return true;
+}
+
+void DecisionLog::drainRing(Ring& ring)
+{
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    char h[kRecordHeader];
+    while (tail < head) {
+        ring.get(tail, h, kRecordHeader);
+        uint32_t size, version, now, count;
+        uint64_t key;
+        memcpy(&size, h, 4);
+        memcpy(&version, h + 4, 4);
+        memcpy(&now, h + 8, 4);
+        memcpy(&count, h + 12, 4);
+        memcpy(&key, h + 16, 8);
+        putFixed(_block, key);
+        putVarint(_block, zigzag(static_cast<int64_t>(version) - _last_version));
+        putVarint(_block, zigzag(static_cast<int64_t>(now) - _last_time));
+        putVarint(_block, count);
+        size_t off = _block.size();
+        _block.resize(off + size - kRecordHeader);
+        ring.get(tail + kRecordHeader, &_block[off], size - kRecordHeader);
+        _last_version = version;
+        _last_time = now;
+        ++_block_records;
+        tail += size;
+        ring.tail.store(tail, std::memory_order_release);
+        if (_block.size() >= _options.block_bytes) {
+            writeBlock();
+        }
+    }
+}
+
+void DecisionLog::writeBlock()
+{
+    if (_block_records == 0) {
+        return;
+    }
+    if (!_file && !openSegment()) {
+        _failed.fetch_add(_block_records, std::memory_order_relaxed);
+    } else {
+        std::string& header = _scratch;
+        header.clear();
+        putFixed(header, static_cast<uint32_t>(_block.size()));
+        putFixed(header, _block_records);
+        putFixed(header, checksum(_block.data(), _block.size()));
+        if (fwrite(header.data(), 1, header.size(), _file) != header.size() ||
+            fwrite(_block.data(), 1, _block.size(), _file) != _block.size()) {
+            fprintf(stderr, "write decision log failed: %s\n", strerror(errno));
+            _failed.fetch_add(_block_records, std::memory_order_relaxed);
+            // 换一个新文件, 不在写坏的文件后追加
+            fclose(_file);
+            _file = nullptr;
+        } else {
+            _segment_bytes += kBlockHeader + _block.size();
+            _bytes.fetch_add(kBlockHeader + _block.size(), std::memory_order_relaxed);
+            _written.fetch_add(_block_records, std::memory_order_relaxed);
+            _blocks.fetch_add(1, std::memory_order_relaxed);
+            if (_segment_bytes >= _options.segment_bytes) {
+                fclose(_file);
+                _file = nullptr;
+                openSegment();
+            }
+        }
+    }
+    _block.clear();
+    _block_records = 0;
+    _last_version = 0;
+    _last_time = 0;
+}
+
+void DecisionLog::drain()
+{
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(_rings_mutex);
+        rings = _rings;
+    }
+    std::vector<Ring*> finished;
+    for (auto& r : rings) {
+        // 先看关闭标记再取记录, 关闭前写入的记录都能取到
+        bool closed = r->closed.load(std::memory_order_acquire);
+        drainRing(*r);
+        if (closed) {
+            finished.push_back(r.get());
+        }
+    }
+    writeBlock();
+    if (_file) {
+        fflush(_file);
+    }
+    if (!finished.empty()) {
+        std::lock_guard<std::mutex> lock(_rings_mutex);
+        for (Ring* f : finished) {
+            for (size_t i = 0; i < _rings.size(); ++i) {
+                if (_rings[i].get() == f) {
+                    _rings.erase(_rings.begin() + i);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void DecisionLog::writeLoop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        uint64_t request = _flush_request;
+        bool stop = _stop;
+        lock.unlock();
+        _urgent.store(false, std::memory_order_relaxed);
+        drain();
+        lock.lock();
+        _flush_done = request;
+        _flushed.notify_all();
+        if (stop) {
+            break;
+        }
+        if (_flush_request == request && !_stop) {
+            _wakeup.wait_for(lock, std::chrono::milliseconds(_options.flush_ms));
+        }
+    }
+}
+
+void DecisionLog::flush()
+{
+    if (!_opened.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    uint64_t request = ++_flush_request;
+    _wakeup.notify_one();
+    _flushed.wait(lock, [this, request] { return _flush_done >= request; });
+}
+
+DecisionStats DecisionLog::stats() const
+{
+    DecisionStats s;
+    s.appended = _appended.load(std::memory_order_relaxed);
+    s.dropped = _dropped.load(std::memory_order_relaxed);
+    s.written = _written.load(std::memory_order_relaxed);
+    s.failed = _failed.load(std::memory_order_relaxed);
+    s.bytes = _bytes.load(std::memory_order_relaxed);
+    s.blocks = _blocks.load(std::memory_order_relaxed);
+    s.segments = _segments.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(_rings_mutex);
+        s.threads = _rings.size();
+    }
+    return s;
+}
+
+DecisionLogReader::DecisionLogReader():
+_file(nullptr),
+_pos(0),
+_remaining(0),
+_last_version(0),
+_last_time(0)
+{
+}
+
+DecisionLogReader::~DecisionLogReader()
+{
+    if (_file) {
+        fclose(_file);
+    }
+}
+
+bool DecisionLogReader::open(const std::string& path)
+{
+    if (_file) {
+        fclose(_file);
+    }
+    _remaining = 0;
+    _error.clear();
+    _file = fopen(path.c_str(), "rb");
+    if (!_file) {
+        _error = strerror(errno);
+        return false;
+    }
+    char header[8];
+    uint32_t version = 0;
+    if (fread(header, 1, sizeof(header), _file) != sizeof(header) || memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+        _error = "not a decision log";
+        return false;
+    }
+    memcpy(&version, header + 4, 4);
+    if (version != kFormatVersion) {
+        _error = "unsupported format version " + std::to_string(version);
+        return false;
+    }
+    return true;
+}
+
+bool DecisionLogReader::readBlock()
+{
+    char header[kBlockHeader];
+    size_t n = fread(header, 1, sizeof(header), _file);
+    if (n == 0) {
+        return false;
+    }
+    uint32_t len, records, sum;
+    memcpy(&len, header, 4);
+    memcpy(&records, header + 4, 4);
+    memcpy(&sum, header + 8, 4);
+    if (n != sizeof(header) || len > kMaxBlock) {
+        _error = "truncated block";
+        return false;
+    }
+    _block.resize(len);
+    if (fread(&_block[0], 1, len, _file) != len) {
+        _error = "truncated block";
+        return false;
+    }
+    if (checksum(_block.data(), len) != sum) {
+        _error = "checksum mismatch";
+        return false;
+    }
+    _pos = 0;
+    _remaining = records;
+    _last_version = 0;
+    _last_time = 0;
+    return true;
+}
+
+bool DecisionLogReader::next(Decision& d)
+{
+    if (!_file || !_error.empty()) {
+        return false;
+    }
+    while (_remaining == 0) {
+        if (!readBlock()) {
+            return false;
+        }
+    }
+    uint64_t version, now, count, delta;
+    if (_pos + sizeof(d.key) > _block.size()) {
+        _error = "corrupt block";
+        return false;
+    }
+    memcpy(&d.key, _block.data() + _pos, sizeof(d.key));
+    _pos += sizeof(d.key);
+    if (!getVarint(_block, _pos, version) || !getVarint(_block, _pos, now) || !getVarint(_block, _pos, count) ||
+        count > _block.size() - _pos) {
+        _error = "corrupt block";
+        return false;
+    }
+    d.version = _last_version = static_cast<uint32_t>(_last_version + unzigzag(version));
+    d.time = _last_time = static_cast<uint32_t>(_last_time + unzigzag(now));
+    d.ids.resize(count);
+    uint32_t prev = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        if (!getVarint(_block, _pos, delta)) {
+            _error = "corrupt block";
+            return false;
+        }
+        d.ids[i] = prev = static_cast<uint32_t>(prev + unzigzag(delta));
+    }
+    --_remaining;
+    return true;
+}
+
+} //end namespace route
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace route {
+
+struct DecisionLogOptions {
+    // 段文件为 <prefix>.<创建时的秒>-<序号>.dlog
+    std::string prefix;
+    // 每个求值线程的环形缓冲, 应能容纳 flush_ms 内该线程的全部记录
+    size_t ring_bytes;
+    // 段文件超过此大小后换新文件
+    size_t segment_bytes;
+    // 写线程攒够此大小的记录后写出一个块
+    size_t block_bytes;
+    // 写线程的最长间隔
+    int flush_ms;
+    DecisionLogOptions(const std::string& p = "decision"):
+    prefix(p), ring_bytes(1 << 20), segment_bytes(64 << 20), block_bytes(64 << 10), flush_ms(100) {}
+};
+
+struct DecisionStats {
+    uint64_t appended;
+    // 缓冲满时丢弃的记录
+    uint64_t dropped;
+    uint64_t written;
+    // 写文件失败而丢失的记录
+    uint64_t failed;
+    uint64_t bytes;
+    uint64_t blocks;
+    uint64_t segments;
+    // 已注册的求值线程
+    size_t threads;
+};
+
+// 一条决策记录
+struct Decision {
+    uint64_t key;
+    uint32_t version;
+    // epoch 秒, 精度为 CoarseClock 的刷新间隔
+    uint32_t time;
+    std::vector<uint32_t> ids;
+};
+
+/**
+ * @brief 异步的二进制决策日志: 哪个请求 (key 的哈希) 在哪个规则集版本下命中了哪些规则
+ *
+ * 求值线程调用 append(), 记录写入本线程的单生产者环形缓冲, 不加锁也不做系统调用;
+ * 缓冲满时丢弃并计数, 不阻塞求值. 后台写线程每 flush_ms (或某个缓冲过半时) 取出所有缓冲中的记录,
+ * 攒成块追加到段文件, 段文件超过 segment_bytes 后换新文件.
+ *
+ * 块内的记录相对前一条做差分: 版本和时间写差值, 规则 id 写与前一个 id 的差, 均为 varint,
+ * key 写原始的 8 字节. 每个块从零开始差分并带校验和, 可以单独解码, 进程崩溃时只损失最后一个块.
+ * 文件格式见 DecisionLog.cpp, 用 DecisionLogReader 或 dlog_decode 读取.
+ */
+class DecisionLog {
+public:
+    explicit DecisionLog(const DecisionLogOptions& options = DecisionLogOptions());
+    // 写出所有缓冲中的记录后关闭文件
+    ~DecisionLog();
+    DecisionLog(const DecisionLog&) = delete;
+    DecisionLog& operator=(const DecisionLog&) = delete;
+
+    // 创建第一个段文件并启动写线程, 失败时输出错误并返回 false
+    bool open();
+
+    /**
+    * @brief 记录一次决策, 可以被多个线程同时调用
+    *
+    * @return false 缓冲已满或日志未打开, 记录被丢弃
+    */
+    bool append(uint64_t key, uint32_t version, const uint32_t* ids, size_t n);
+    bool append(uint64_t key, uint32_t version, const std::vector<uint32_t>& ids)
+    {
+        return append(key, version, ids.data(), ids.size());
+    }
+
+    // 等待调用前 append 的记录全部写入文件
+    void flush();
+
+    DecisionStats stats() const;
+
+    // 请求 key 的哈希
+    static uint64_t hashKey(std::string_view key);
+
+private:
+    struct Ring;
+
+    Ring* localRing();
+    // 取出所有缓冲中的记录并写出
+    void drain();
+    void drainRing(Ring& ring);
+    void writeBlock();
+    bool openSegment();
+    void writeLoop();
+
+private:
+    DecisionLogOptions _options;
+    // 区分不同的日志对象, 线程局部的缓冲按它查找
+    uint64_t _id;
+    mutable std::mutex _rings_mutex;
+    std::vector<std::shared_ptr<Ring>> _rings;
+
+    // 以下只由写线程访问
+    FILE* _file;
+    size_t _segment_bytes;
+    uint32_t _segment_seq;
+    std::string _block;
+    uint32_t _block_records;
+    uint32_t _last_version;
+    uint32_t _last_time;
+    std::string _scratch;
+
+    std::mutex _mutex;
+    std::condition_variable _wakeup;
+    std::condition_variable _flushed;
+    uint64_t _flush_request;
+    uint64_t _flush_done;
+    bool _stop;
+    // 写线程已启动
+    std::atomic<bool> _opened;
+    // 已有缓冲过半, 本轮不必再通知写线程
+    std::atomic<bool> _urgent;
+    std::thread _writer;
+
+    std::atomic<uint64_t> _appended;
+    std::atomic<uint64_t> _dropped;
+    std::atomic<uint64_t> _written;
+    std::atomic<uint64_t> _failed;
+    std::atomic<uint64_t> _bytes;
+    std::atomic<uint64_t> _blocks;
+    std::atomic<uint64_t> _segments;
+}; // DecisionLog
+
+/**
+ * @brief 顺序读取一个段文件
+ *
+ * 校验和不符或块不完整 (写入时进程退出) 时停止, error() 给出原因.
+ */
+class DecisionLogReader {
+public:
+    DecisionLogReader();
+    ~DecisionLogReader();
+    DecisionLogReader(const DecisionLogReader&) = delete;
+    DecisionLogReader& operator=(const DecisionLogReader&) = delete;
+
+    // 打开文件并检查文件头, 失败时 error() 给出原因
+    bool open(const std::string& path);
+
+    // 读取下一条记录, 文件结束或出错时返回 false
+    bool next(Decision& d);
+
+    const std::string& error() const { return _error; }
+
+private:
+    bool readBlock();
+
+private:
+    FILE* _file;
+    std::string _block;
+    size_t _pos;
+    uint32_t _remaining;
+    uint32_t _last_version;
+    uint32_t _last_time;
+    std::string _error;
+}; // DecisionLogReader
+
+} // end namespace route
@@ -0,0 +1,388 @@
+#include "ExternalList.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+namespace route {
+
+// bloom 分块 512 位, 每项在一个块内置 kBloomHashes 位
+static const uint64_t kBloomBlockWords = 8;
+static const int kBloomHashes = 6;
+static const uint64_t kBloomBitsPerEntry = 10;
+
+static inline uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hashKey(const char* data, size_t len)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof(w));
+        h = mix(h ^ w);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, len - i);
+    return mix(h ^ tail);
+}
+
+// 块内位置用另一组 9 位 x kBloomHashes, 与选块和选槽的位独立
+static inline uint64_t bloomBits(uint64_t h)
+{
+    return mix(h ^ 0x5bd1e9955bd1e995ULL);
+}
+
+static size_t roundUp(size_t n, size_t align)
+{
+    return (n + align - 1) / align * align;
+}
+
+static uint64_t nextPow2(uint64_t n)
+{
+    uint64_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+ListTable::~ListTable()
+{
+    if (_base) {
+        munmap(_base, _bytes);
+    }
+}
+
+std::unique_ptr<ListTable> ListTable::Load(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "open list %s failed: %s\n", path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "stat list %s failed: %s\n", path.c_str(), strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+    size_t file_len = st.st_size;
+    const char* file = nullptr;
+    if (file_len) {
+        void* addr = mmap(nullptr, file_len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            fprintf(stderr, "mmap list %s failed: %s\n", path.c_str(), strerror(errno));
+            close(fd);
+            return nullptr;
+        }
+        madvise(addr, file_len, MADV_SEQUENTIAL);
+        file = static_cast<const char*>(addr);
+    }
+    close(fd);
+
+    // 第一遍: 统计项数和字符串总长
+    struct Item {
+        uint64_t off;
+        uint32_t len;
+    };
+    std::vector<Item> items;
+    size_t string_bytes = 0;
+    size_t pos = 0;
+    while (pos < file_len) {
+        const char* nl = static_cast<const char*>(memchr(file + pos, '\n', file_len - pos));
+        size_t end = nl ? nl - file : file_len;
+        size_t b = pos;
+        size_t e = end;
+        while (b < e && isspace(static_cast<unsigned char>(file[b]))) {
+            ++b;
+        }
+        while (e > b && isspace(static_cast<unsigned char>(file[e - 1]))) {
+            --e;
+        }
+        if (e > b) {
+            items.push_back(Item{b, static_cast<uint32_t>(e - b)});
+            string_bytes += e - b;
+        }
+        pos = end + 1;
+    }
+    if (items.size() >= UINT32_MAX || string_bytes >= UINT32_MAX) {
+        fprintf(stderr, "list %s too large\n", path.c_str());
+        if (file) {
+            munmap(const_cast<char*>(file), file_len);
+        }
+        return nullptr;
+    }
+
+    std::unique_ptr<ListTable> t(new ListTable());
+    size_t n = items.size();
+    t->_bloom_blocks = std::max<uint64_t>(1, (n * kBloomBitsPerEntry + 511) / 512);
+    t->_slot_mask = nextPow2(std::max<uint64_t>(16, n + n / 3)) - 1;
+    size_t bloom_bytes = t->_bloom_blocks * kBloomBlockWords * sizeof(uint64_t);
+    size_t slots_bytes = roundUp((t->_slot_mask + 1) * sizeof(uint32_t), 64);
+    size_t hashes_bytes = roundUp(n * sizeof(uint32_t), 64);
+    size_t offsets_bytes = roundUp((n + 1) * sizeof(uint32_t), 64);
+    t->_bytes = bloom_bytes + slots_bytes + hashes_bytes + offsets_bytes + roundUp(string_bytes, 64);
+    void* base = mmap(nullptr, t->_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "mmap %zu bytes for list %s failed: %s\n", t->_bytes, path.c_str(), strerror(errno));
+        if (file) {
+            munmap(const_cast<char*>(file), file_len);
+        }
+        t->_bytes = 0;
+        return nullptr;
+    }
+    t->_base = base;
+    char* p = static_cast<char*>(base);
+    uint64_t* bloom = reinterpret_cast<uint64_t*>(p);
+    uint32_t* slots = reinterpret_cast<uint32_t*>(p + bloom_bytes);
+    uint32_t* hashes = reinterpret_cast<uint32_t*>(p + bloom_bytes + slots_bytes);
+    uint32_t* offsets = reinterpret_cast<uint32_t*>(p + bloom_bytes + slots_bytes + hashes_bytes);
+    char* strings = p + bloom_bytes + slots_bytes + hashes_bytes + offsets_bytes;
+    t->_bloom = bloom;
+    t->_slots = slots;
+    t->_hashes = hashes;
+    t->_offsets = offsets;
+    t->_strings = strings;
+
+    // 第二遍: 复制字符串, 重复项只保留第一次出现的
+    size_t count = 0;
+    uint32_t off = 0;
+    for (const Item& it : items) {
+        const char* s = file + it.off;
+        uint64_t h = hashKey(s, it.len);
+        uint64_t i = h & t->_slot_mask;
+        bool dup = false;
+        while (slots[i]) {
+            uint32_t k = slots[i] - 1;
+            if (hashes[k] == static_cast<uint32_t>(h >> 32) && offsets[k + 1] - offsets[k] == it.len &&
+                memcmp(strings + offsets[k], s, it.len) == 0) {
+                dup = true;
+                break;
+            }
+            i = (i + 1) & t->_slot_mask;
+        }
+        if (dup) {
+            continue;
+        }
+        memcpy(strings + off, s, it.len);
+        offsets[count] = off;
+        off += it.len;
+        offsets[count + 1] = off;
+        hashes[count] = static_cast<uint32_t>(h >> 32);
+        slots[i] = static_cast<uint32_t>(++count);
+        uint64_t* block = bloom + (h % t->_bloom_blocks) * kBloomBlockWords;
+        uint64_t bits = bloomBits(h);
+        for (int j = 0; j < kBloomHashes; ++j) {
+            uint32_t bit = (bits >> (j * 9)) & 511;
+            block[bit >> 6] |= 1ULL << (bit & 63);
+        }
+    }
+    t->_count = count;
+    if (file) {
+        munmap(const_cast<char*>(file), file_len);
+    }
+    mprotect(base, t->_bytes, PROT_READ);
+    return t;
+}
+
+bool ListTable::mayContain(uint64_t h) const
+{
+    const uint64_t* block = _bloom + (h % _bloom_blocks) * kBloomBlockWords;
+    uint64_t bits = bloomBits(h);
+    for (int j = 0; j < kBloomHashes; ++j) {
+        uint32_t bit = (bits >> (j * 9)) & 511;
+        if (!(block[bit >> 6] & (1ULL << (bit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ListTable::mayContain(const char* data, size_t len) const
+{
+    return mayContain(hashKey(data, len));
+}
+
+bool ListTable::contains(const char* data, size_t len) const
+{
+    uint64_t h = hashKey(data, len);
+    if (!mayContain(h)) {
+        return false;
+    }
+    uint32_t tag = static_cast<uint32_t>(h >> 32);
+    for (uint64_t i = h & _slot_mask; _slots[i]; i = (i + 1) & _slot_mask) {
+        uint32_t k = _slots[i] - 1;
+        if (_hashes[k] == tag && _offsets[k + 1] - _offsets[k] == len &&
+            memcmp(_strings + _offsets[k], data, len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 全局 epoch 从 1 开始, 槽位为 0 表示不在读
+static std::atomic<uint64_t> g_epoch{1};
+static std::mutex g_readers_mutex;
+static std::vector<std::atomic<uint64_t>*> g_readers;
+
+namespace {
+
+struct ReaderSlot {
+    alignas(64) std::atomic<uint64_t> epoch{0};
+
+    ReaderSlot()
+    {
+        std::lock_guard<std::mutex> lock(g_readers_mutex);
+        g_readers.push_back(&epoch);
+    }
+
+    ~ReaderSlot()
+    {
+        std::lock_guard<std::mutex> lock(g_readers_mutex);
+        g_readers.erase(std::find(g_readers.begin(), g_readers.end(), &epoch));
+    }
+};
+
+} // end anonymous namespace
+
+ListReaders::Guard::Guard()
+{
+    thread_local ReaderSlot slot;
+    _epoch = &slot.epoch;
+    // 与 synchronize 中的读取都用 seq_cst: 写线程看不到这次登记时, 本线程随后一定读到新版本
+    _epoch->store(g_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+}
+
+ListReaders::Guard::~Guard()
+{
+    _epoch->store(0, std::memory_order_release);
+}
+
+void ListReaders::synchronize()
+{
+    uint64_t epoch = g_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    std::lock_guard<std::mutex> lock(g_readers_mutex);
+    for (auto* reader : g_readers) {
+        for (;;) {
+            uint64_t e = reader->load(std::memory_order_seq_cst);
+            if (e == 0 || e >= epoch) {
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
+bool ListSlot::contains(const char* data, size_t len) const
+{
+    ListReaders::Guard guard;
+    return current.load(std::memory_order_seq_cst)->contains(data, len);
+}
+
+ListRegistry& ListRegistry::instance()
+{
+    static ListRegistry registry;
+    return registry;
+}
+
+void ListRegistry::setDirectory(const std::string& dir)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _dir = dir;
+}
+
+static bool validName(const std::string& name)
+{
+    if (name.empty() || name[0] == '.') {
+        return false;
+    }
+    for (char c : name) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-' && c != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ListRegistry::load(Entry& e)
+{
+    std::unique_ptr<ListTable> t = ListTable::Load(e.slot.path);
+    if (!t) {
+        return false;
+    }
+    e.slot.current.store(t.get(), std::memory_order_seq_cst);
+    if (e.table) {
+        // 发布后进入的读者只会看到新版本, 等之前进入的读者退出即可释放
+        ListReaders::synchronize();
+    }
+    e.table = std::move(t);
+    return true;
+}
+
+const ListSlot* ListRegistry::acquire(const std::string& name)
+{
+    if (!validName(name)) {
+        fprintf(stderr, "invalid list name: %s\n", name.c_str());
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(name);
+    if (it != _entries.end()) {
+        return &it->second->slot;
+    }
+    std::unique_ptr<Entry> e(new Entry());
+    e->slot.name = name;
+    e->slot.path = _dir + "/" + name;
+    if (!load(*e)) {
+        return nullptr;
+    }
+    const ListSlot* slot = &e->slot;
+    _entries.emplace(name, std::move(e));
+    return slot;
+}
+
+bool ListRegistry::reload(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(name);
+    return it != _entries.end() && load(*it->second);
+}
+
+size_t ListRegistry::reloadAll()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t n = 0;
+    for (auto& kv : _entries) {
+        n += load(*kv.second);
+    }
+    return n;
+}
+
+std::map<std::string, size_t> ListRegistry::stats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::map<std::string, size_t> out;
+    for (const auto& kv : _entries) {
+        out[kv.first] = kv.second->table->size();
+    }
+    return out;
+}
+
+} //end namespace route
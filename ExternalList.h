@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace route {
+
+/**
+ * @brief 只读的字符串集合, 用于 U=@file:vip_users 这类外部名单
+ *
+ * 名单文件每行一项, 去掉首尾空白, 忽略空行, 字符串总长不超过 4GB. 加载后所有数据放在一块匿名 mmap 内存里:
+ *
+ *   bloom (每项约 10 位, 按 512 位分块) | slots (开放寻址, 存项的下标) |
+ *   hashes (每项 32 位哈希) | offsets (n + 1 个) | 字符串
+ *
+ * 构建完成后整块 mprotect 为只读. 查询先看 bloom 的一个 64 字节块, 大部分不在名单中的值
+ * 只访问这一个缓存行.
+ */
+class ListTable {
+public:
+    ~ListTable();
+    ListTable(const ListTable&) = delete;
+    ListTable& operator=(const ListTable&) = delete;
+
+    // 失败时返回 nullptr 并输出错误
+    static std::unique_ptr<ListTable> Load(const std::string& path);
+
+    bool contains(const char* data, size_t len) const;
+
+    // 只查 bloom, false 表示一定不在名单中
+    bool mayContain(const char* data, size_t len) const;
+
+    size_t size() const { return _count; }
+    size_t bytes() const { return _bytes; }
+
+private:
+    ListTable() = default;
+
+    bool mayContain(uint64_t h) const;
+
+private:
+    void* _base = nullptr;
+    size_t _bytes = 0;
+    size_t _count = 0;
+    const uint64_t* _bloom = nullptr;
+    uint64_t _bloom_blocks = 0;
+    const uint32_t* _slots = nullptr;
+    uint64_t _slot_mask = 0;
+    const uint32_t* _hashes = nullptr;
+    const uint32_t* _offsets = nullptr;
+    const char* _strings = nullptr;
+}; // ListTable
+
+/**
+ * @brief 名单的读者登记, 确定被替换的旧版本何时可以释放
+ *
+ * 每个读线程一个槽位, 查询期间记下进入时的全局 epoch, 查询结束后清零.
+ * 替换名单后调用 synchronize(): 推进 epoch 并等待所有在此之前进入的读者退出,
+ * 之后旧版本不会再被任何线程访问. 读者只在单次 contains 期间处于读状态, 等待很短.
+ */
+class ListReaders {
+public:
+    class Guard {
+    public:
+        Guard();
+        ~Guard();
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    private:
+        std::atomic<uint64_t>* _epoch;
+    };
+
+    static void synchronize();
+};
+
+/**
+ * @brief 一个具名名单的当前版本
+ *
+ * 求值线程通过 contains 读 current; reload 发布新版本后等待读者退出 (见 ListReaders) 再释放旧版本.
+ */
+struct ListSlot {
+    std::string name;
+    std::string path;
+    std::atomic<const ListTable*> current{nullptr};
+
+    bool contains(const char* data, size_t len) const;
+
+    // 不登记读者, 返回的指针只在名单不被重新加载时有效
+    const ListTable* table() const
+    {
+        return current.load(std::memory_order_acquire);
+    }
+};
+
+/**
+ * @brief 进程内共享的名单注册表, 引用同一名单的所有规则共享一份数据
+ *
+ * 名单 name 对应文件 <directory>/<name>, 第一次被引用时加载. 重新加载不需要重新编译规则.
+ */
+class ListRegistry {
+public:
+    static ListRegistry& instance();
+
+    // 名单文件所在目录, 默认为当前目录
+    void setDirectory(const std::string& dir);
+
+    // 取得名单, 未加载时加载; 名字不合法或加载失败返回 nullptr
+    const ListSlot* acquire(const std::string& name);
+
+    // 重新加载一个名单, 失败时保留旧版本
+    bool reload(const std::string& name);
+
+    // 重新加载所有已引用的名单, 返回成功的个数
+    size_t reloadAll();
+
+    // name -> 项数
+    std::map<std::string, size_t> stats() const;
+
+private:
+    ListRegistry() = default;
+
+    struct Entry {
+        ListSlot slot;
+        std::unique_ptr<ListTable> table;
+    };
+
+    bool load(Entry& e);
+
+private:
+    mutable std::mutex _mutex;
+    std::string _dir = ".";
+    std::map<std::string, std::unique_ptr<Entry>> _entries;
+}; // ListRegistry
+
+} // end namespace route
@@ -0,0 +1,22 @@
+#include "FieldBinding.h"
+
+namespace route {
+
+bool FieldBinding::add(std::string_view name, FieldType type, const BoundField& field)
+{
+    // 冲突或不合法时 define 已输出错误
+    FieldRef ref = Schema::instance().define(name, type);
+    if (!ref.valid()) {
+        return false;
+    }
+    if (ref.id >= _fields.size()) {
+        _fields.resize(ref.id + 1, BoundField{0, nullptr, nullptr});
+    }
+    if (!_fields[ref.id].match) {
+        ++_size;
+    }
+    _fields[ref.id] = field;
+    return true;
+}
+
+} //end namespace route
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "checker.h"
+#include "Schema.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace route {
+
+/**
+ * @brief 一个绑定字段: 在结构体中的偏移, 以及按成员的 C++ 类型实例化的比较和格式化函数
+ */
+struct BoundField {
+    size_t offset;
+    // 把成员交给叶子的 checker, 整数按 IChecker 支持的宽度传入, 不构造 Variant
+    bool (*match)(IChecker* p, const char* member);
+    // 把成员格式化为轨迹中的文本, 只在 Tracer 采样时调用
+    size_t (*format)(const char* member, char* buf, size_t cap);
+};
+
+/**
+ * @brief 属性名到结构体成员的绑定, 与具体类型无关的部分, 见 Binding<T>
+ *
+ * 字段定义在全局的 Schema::instance() 中, 表达式编译时叶子已解析出 FieldRef,
+ * 求值时按 FieldRef::id 下标取到成员的偏移, 不查找属性名.
+ */
+class FieldBinding {
+public:
+    // 叶子对应的成员, 未绑定时返回 nullptr
+    const BoundField* find(const FieldRef& ref) const
+    {
+        if (!ref.valid() || ref.id >= _fields.size() || !_fields[ref.id].match) {
+            return nullptr;
+        }
+        return &_fields[ref.id];
+    }
+
+    // 已绑定的字段数
+    size_t size() const { return _size; }
+
+protected:
+    FieldBinding(): _size(0) {}
+
+    bool add(std::string_view name, FieldType type, const BoundField& field);
+
+private:
+    // 按 FieldRef::id 下标, 未绑定的位置 match 为空
+    std::vector<BoundField> _fields;
+    size_t _size;
+}; // FieldBinding
+
+namespace binding {
+
+// 成员类型对应的 Schema 字段类型, 不支持的类型在编译期报错
+template<class M>
+constexpr FieldType FieldTypeOf()
+{
+    if constexpr (std::is_integral<M>::value) {
+        static_assert(sizeof(M) <= sizeof(uint64_t), "integer members wider than 64 bits are not supported");
+        // 取值可能超出 int32 的成员用 64 位比较, 常量也按 64 位解析
+        if constexpr (std::is_signed<M>::value) {
+            return sizeof(M) <= sizeof(int32_t) ? FIELD_INT : FIELD_LONG;
+        } else {
+            return sizeof(M) < sizeof(uint32_t) ? FIELD_INT : FIELD_ULONG;
+        }
+    } else if constexpr (std::is_floating_point<M>::value) {
+        return FIELD_DOUBLE;
+    } else if constexpr (std::is_same<M, std::string>::value || std::is_same<M, std::string_view>::value) {
+        return FIELD_STRING;
+    } else if constexpr (std::is_same<M, Version>::value) {
+        return FIELD_VERSION;
+    } else {
+        static_assert(std::is_same<M, IpAddr>::value, "unsupported member type");
+        return FIELD_IP;
+    }
+}
+
+// 整数按 FieldTypeOf 选择的宽度传入: FIELD_INT 为 int32, FIELD_LONG 为 int64, FIELD_ULONG 为 uint64
+template<class M>
+bool Match(IChecker* p, const char* member)
+{
+    const M& v = *reinterpret_cast<const M*>(member);
+    if constexpr (std::is_integral<M>::value) {
+        constexpr FieldType type = FieldTypeOf<M>();
+        if constexpr (type == FIELD_INT) {
+            return p->IsValid(static_cast<int32_t>(v));
+        } else if constexpr (type == FIELD_LONG) {
+            return p->IsValid(static_cast<int64_t>(v));
+        } else {
+            return p->IsValid(static_cast<uint64_t>(v));
+        }
+    } else if constexpr (std::is_floating_point<M>::value) {
+        return p->IsValid(static_cast<double>(v));
+    } else if constexpr (std::is_same<M, std::string_view>::value) {
+        return p->IsValidRaw(v.data(), v.size());
+    } else {
+        return p->IsValid(v);
+    }
+}
+
+template<class M>
+size_t Format(const char* member, char* buf, size_t cap)
+{
+    const M& v = *reinterpret_cast<const M*>(member);
+    int n = 0;
+    if constexpr (std::is_integral<M>::value && std::is_signed<M>::value) {
+        n = snprintf(buf, cap, "%lld", static_cast<long long>(v));
+    } else if constexpr (std::is_integral<M>::value) {
+        n = snprintf(buf, cap, "%llu", static_cast<unsigned long long>(v));
+    } else if constexpr (std::is_floating_point<M>::value) {
+        n = snprintf(buf, cap, "%g", static_cast<double>(v));
+    } else if constexpr (std::is_same<M, std::string>::value || std::is_same<M, std::string_view>::value) {
+        n = snprintf(buf, cap, "%.*s", static_cast<int>(v.size()), v.data());
+    } else {
+        n = snprintf(buf, cap, "%s", v.ToString().c_str());
+    }
+    return n < 0 ? 0 : std::min(static_cast<size_t>(n), cap - 1);
+}
+
+} // end namespace binding
+
+/**
+ * @brief 结构体 T 的字段绑定, 表达式可直接在 const T& 上求值, 不经过 map 和 Variant
+ *
+ * 成员按名字, 类型和偏移注册, 一般用 ROUTE_BIND_FIELD 宏:
+ *
+ *     Binding<Request> b;
+ *     ROUTE_BIND_FIELD(b, Request, user.age);           // 属性名 "user.age"
+ *     ROUTE_BIND_FIELD_AS(b, Request, os_version, "V");
+ *
+ * 绑定需在编译引用这些属性的表达式之前完成 (字段类型决定叶子的 checker).
+ * 支持整数, 浮点, std::string, std::string_view, Version 和 IpAddr 成员; 绑定的字段总是存在,
+ * 表达式中未绑定的属性视为缺失. int64_t, uint32_t, uint64_t 成员的字段类型为 FIELD_LONG/FIELD_ULONG,
+ * 常量和比较都是 64 位.
+ */
+template<class T>
+class Binding : public FieldBinding {
+public:
+    static_assert(std::is_standard_layout<T>::value, "Binding requires a standard-layout type");
+
+    /**
+    * @brief 绑定类型为 M, 偏移为 offset 的成员
+    *
+    * @return false 属性名不合法或与 Schema 中已有的定义冲突, 已输出错误
+    */
+    template<class M>
+    bool field(std::string_view name, size_t offset)
+    {
+        return add(name, binding::FieldTypeOf<M>(), BoundField{offset, &binding::Match<M>, &binding::Format<M>});
+    }
+}; // Binding
+
+// 以成员路径作为属性名绑定, 嵌套结构体的成员写作 user.age
+#define ROUTE_BIND_FIELD(binding, Type, member) \
+    ROUTE_BIND_FIELD_AS(binding, Type, member, #member)
+
+#define ROUTE_BIND_FIELD_AS(binding, Type, member, name) \
+    (binding).template field<std::remove_cv_t<decltype(static_cast<Type*>(nullptr)->member)>>( \
+        name, offsetof(Type, member))
+
+} // end namespace route
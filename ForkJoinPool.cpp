@@ -0,0 +1,102 @@
+#include "ForkJoinPool.h"
+
+#include <algorithm>
+
+namespace route {
+
+// 空闲自旋的次数, 约几十微秒
+static const int kSpinRounds = 20000;
+
+ForkJoinPool::ForkJoinPool(size_t threads):
+_spin(false),
+_generation(0),
+_stop(false)
+{
+    size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    if (threads == 0) {
+        threads = cpus - 1;
+    }
+    _spin = threads < cpus;
+    for (size_t i = 0; i < threads; ++i) {
+        _workers.emplace_back(&ForkJoinPool::work, this);
+    }
+}
+
+ForkJoinPool::~ForkJoinPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _generation.fetch_add(1);
+    }
+    _wakeup.notify_all();
+    for (auto& t : _workers) {
+        t.join();
+    }
+}
+
+void ForkJoinPool::drain(Job& job)
+{
+    for (;;) {
+        size_t i = job.next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= job.n) {
+            return;
+        }
+        (*job.fn)(i);
+        job.done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+bool ForkJoinPool::run(size_t n, const std::function<void(size_t)>& fn)
+{
+    std::unique_lock<std::mutex> busy(_run_mutex, std::try_to_lock);
+    if (!busy.owns_lock() || _workers.empty() || n <= 1) {
+        for (size_t i = 0; i < n; ++i) {
+            fn(i);
+        }
+        return busy.owns_lock();
+    }
+    // 工作线程持有 job 的引用, 迟到的线程只会看到已领完的计数, 不会再调用 fn
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->fn = &fn;
+    job->n = n;
+    job->next.store(0, std::memory_order_relaxed);
+    job->done.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _job = job;
+        _generation.fetch_add(1, std::memory_order_release);
+    }
+    _wakeup.notify_all();
+    drain(*job);
+    while (job->done.load(std::memory_order_acquire) < n) {
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+void ForkJoinPool::work()
+{
+    uint64_t seen = 0;
+    for (;;) {
+        int spins = _spin ? kSpinRounds : 0;
+        while (spins > 0 && _generation.load(std::memory_order_acquire) == seen) {
+            --spins;
+        }
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeup.wait(lock, [this, seen] { return _generation.load(std::memory_order_relaxed) != seen; });
+            if (_stop) {
+                return;
+            }
+            seen = _generation.load(std::memory_order_relaxed);
+            job = _job;
+        }
+        if (job) {
+            drain(*job);
+        }
+    }
+}
+
+} //end namespace route
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace route {
+
+/**
+ * @brief 常驻线程的 fork-join 池
+ *
+ * run(n, fn) 把 fn(0) ... fn(n-1) 分给工作线程和调用线程, 任务按原子计数领取, 先做完的线程
+ * 继续领取剩下的任务, 全部完成后返回. 工作线程空闲时先自旋一小段时间再睡眠,
+ * 连续的请求不必每次都唤醒线程. 同一时间只执行一个 run, 池正被其他线程使用时
+ * 调用线程自己执行全部任务, 不排队等待.
+ */
+class ForkJoinPool {
+public:
+    // threads 为工作线程数 (不含调用线程), 0 表示 CPU 数减一
+    explicit ForkJoinPool(size_t threads = 0);
+    ~ForkJoinPool();
+    ForkJoinPool(const ForkJoinPool&) = delete;
+    ForkJoinPool& operator=(const ForkJoinPool&) = delete;
+
+    /**
+    * @brief 执行 fn(0) ... fn(n-1), 返回时全部完成
+    *
+    * @return false 池正忙, 任务全部在调用线程执行
+    */
+    bool run(size_t n, const std::function<void(size_t)>& fn);
+
+    size_t workers() const { return _workers.size(); }
+
+private:
+    struct Job {
+        const std::function<void(size_t)>* fn;
+        size_t n;
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+    };
+
+    void work();
+    // 领取并执行任务直到没有剩余
+    static void drain(Job& job);
+
+private:
+    std::vector<std::thread> _workers;
+    // 工作线程数小于 CPU 数时空闲自旋, 否则直接睡眠
+    bool _spin;
+    std::mutex _run_mutex;
+    std::mutex _mutex;
+    std::condition_variable _wakeup;
+    std::shared_ptr<Job> _job;
+    std::atomic<uint64_t> _generation;
+    bool _stop;
+}; // ForkJoinPool
+
+} // end namespace route
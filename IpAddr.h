@@ -0,0 +1,219 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace route {
+
+/**
+ * @brief IPv4/IPv6 地址, 按网络字节序打包为两个 64 位整数 (hi 为高 64 位)
+ *
+ * IPv4 地址存为 IPv4-mapped 形式 ::ffff:a.b.c.d, 两种地址可以放在同一个属性里比较.
+ */
+struct IpAddr {
+    uint64_t hi;
+    uint64_t lo;
+
+    constexpr IpAddr(): hi(0), lo(0) {}
+    constexpr IpAddr(uint64_t h, uint64_t l): hi(h), lo(l) {}
+
+    // 主机序的 IPv4 地址
+    static constexpr IpAddr V4(uint32_t v4)
+    {
+        return IpAddr(0, 0xffff00000000ULL | v4);
+    }
+
+    bool isV4() const
+    {
+        return hi == 0 && (lo >> 32) == 0xffff;
+    }
+
+    uint32_t v4() const
+    {
+        return static_cast<uint32_t>(lo);
+    }
+
+    /**
+    * @brief 解析 "10.1.2.3" 或 "2001:db8::1"
+    *
+    * @return 0 成功, -1 格式错误 (同 gsl::check_cast)
+    */
+    static int Parse(std::string_view s, IpAddr& addr)
+    {
+        uint32_t v4;
+        if (ParseV4(s, v4)) {
+            addr = V4(v4);
+            return 0;
+        }
+        // IPv6 交给 inet_pton, 最长 45 个字符
+        char buf[INET6_ADDRSTRLEN];
+        if (s.empty() || s.size() >= sizeof(buf) || s.find(':') == std::string_view::npos) {
+            return -1;
+        }
+        memcpy(buf, s.data(), s.size());
+        buf[s.size()] = '\0';
+        unsigned char bytes[16];
+        if (inet_pton(AF_INET6, buf, bytes) != 1) {
+            return -1;
+        }
+        addr = FromBytes(bytes);
+        return 0;
+    }
+
+    // 16 字节网络序
+    static IpAddr FromBytes(const unsigned char* bytes)
+    {
+        IpAddr addr;
+        for (int i = 0; i < 8; ++i) {
+            addr.hi = addr.hi << 8 | bytes[i];
+            addr.lo = addr.lo << 8 | bytes[i + 8];
+        }
+        return addr;
+    }
+
+    std::string ToString() const
+    {
+        char buf[INET6_ADDRSTRLEN];
+        if (isV4()) {
+            uint32_t n = htonl(v4());
+            inet_ntop(AF_INET, &n, buf, sizeof(buf));
+        } else {
+            unsigned char bytes[16];
+            for (int i = 0; i < 8; ++i) {
+                bytes[i] = static_cast<unsigned char>(hi >> (56 - 8 * i));
+                bytes[i + 8] = static_cast<unsigned char>(lo >> (56 - 8 * i));
+            }
+            inet_ntop(AF_INET6, bytes, buf, sizeof(buf));
+        }
+        return buf;
+    }
+
+    bool operator==(const IpAddr& o) const { return hi == o.hi && lo == o.lo; }
+    bool operator!=(const IpAddr& o) const { return !(*this == o); }
+    bool operator<(const IpAddr& o) const { return hi < o.hi || (hi == o.hi && lo < o.lo); }
+
+private:
+    // 严格的点分十进制, 每段 0-255, 不允许前导 0
+    static bool ParseV4(std::string_view s, uint32_t& v4)
+    {
+        uint32_t addr = 0;
+        size_t i = 0;
+        for (int part = 0; part < 4; ++part) {
+            if (part) {
+                if (i >= s.size() || s[i] != '.') {
+                    return false;
+                }
+                ++i;
+            }
+            size_t b = i;
+            uint32_t n = 0;
+            while (i < s.size() && i - b < 3 && s[i] >= '0' && s[i] <= '9') {
+                n = n * 10 + (s[i] - '0');
+                ++i;
+            }
+            if (i == b || n > 255 || (s[b] == '0' && i - b > 1)) {
+                return false;
+            }
+            addr = addr << 8 | n;
+        }
+        if (i != s.size()) {
+            return false;
+        }
+        v4 = addr;
+        return true;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const IpAddr& addr)
+{
+    return os << addr.ToString();
+}
+
+/**
+ * @brief 地址前缀, len 按 128 位地址计, IPv4 前缀 10.0.0.0/8 存为 ::ffff:10.0.0.0/104
+ *
+ * 主机位总是清零, 相同的网段只有一种表示.
+ */
+struct IpPrefix {
+    IpAddr addr;
+    uint8_t len;
+
+    IpPrefix(): len(0) {}
+    IpPrefix(const IpAddr& a, int l): addr(Mask(a, l)), len(static_cast<uint8_t>(l)) {}
+
+    static IpAddr Mask(const IpAddr& a, int len)
+    {
+        uint64_t mh = len >= 64 ? ~0ULL : (len <= 0 ? 0 : ~0ULL << (64 - len));
+        uint64_t ml = len <= 64 ? 0 : (len >= 128 ? ~0ULL : ~0ULL << (128 - len));
+        return IpAddr(a.hi & mh, a.lo & ml);
+    }
+
+    /**
+    * @brief 解析 "10.0.0.0/8" "2001:db8::/32", 省略长度时为单个地址
+    *
+    * @return 0 成功, -1 格式错误或长度超出范围
+    */
+    static int Parse(std::string_view s, IpPrefix& prefix)
+    {
+        size_t slash = s.find('/');
+        IpAddr addr;
+        if (IpAddr::Parse(s.substr(0, slash), addr) != 0) {
+            return -1;
+        }
+        bool v4 = addr.isV4() && s.find(':') == std::string_view::npos;
+        int len = v4 ? 32 : 128;
+        if (slash != std::string_view::npos) {
+            std::string_view n = s.substr(slash + 1);
+            if (n.empty() || n.size() > 3) {
+                return -1;
+            }
+            int v = 0;
+            for (char c : n) {
+                if (c < '0' || c > '9') {
+                    return -1;
+                }
+                v = v * 10 + (c - '0');
+            }
+            if (v > len) {
+                return -1;
+            }
+            len = v;
+        }
+        prefix = IpPrefix(addr, v4 ? len + 96 : len);
+        return 0;
+    }
+
+    bool contains(const IpAddr& a) const
+    {
+        return Mask(a, len) == addr;
+    }
+
+    // IPv4 前缀按点分十进制输出
+    std::string ToString() const
+    {
+        if (addr.isV4() && len >= 96) {
+            return addr.ToString() + "/" + std::to_string(len - 96);
+        }
+        return addr.ToString() + "/" + std::to_string(len);
+    }
+
+    bool operator==(const IpPrefix& o) const { return addr == o.addr && len == o.len; }
+    bool operator<(const IpPrefix& o) const { return addr < o.addr || (addr == o.addr && len < o.len); }
+};
+
+} // end namespace route
+
+namespace std {
+template<>
+struct hash<route::IpAddr> {
+    size_t operator()(const route::IpAddr& a) const
+    {
+        return std::hash<uint64_t>()(a.hi * 0x9e3779b97f4a7c15ULL ^ a.lo);
+    }
+};
+} // end namespace std
@@ -0,0 +1,119 @@
+#include "LazyAttributes.h"
+
+namespace route {
+
+AttributeProviders::AttributeProviders():
+_contexts(0)
+{
+}
+
+bool AttributeProviders::add(const std::string& name, Provider provider)
+{
+    if (!provider || _index.count(name)) {
+        return false;
+    }
+    std::unique_ptr<Entry> e(new Entry());
+    e->name = name;
+    e->provider = std::move(provider);
+    _index.emplace(name, _entries.size());
+    _entries.push_back(std::move(e));
+    return true;
+}
+
+std::map<std::string, FetchStats> AttributeProviders::stats() const
+{
+    std::map<std::string, FetchStats> out;
+    for (const auto& e : _entries) {
+        FetchStats& s = out[e->name];
+        s.fetches = e->fetches.load(std::memory_order_relaxed);
+        s.reuses = e->reuses.load(std::memory_order_relaxed);
+        s.absent = e->absent.load(std::memory_order_relaxed);
+    }
+    return out;
+}
+
+LazyAttributes::LazyAttributes(const AttributeProviders& providers):
+_providers(providers),
+_slots(providers._entries.size())
+{
+    _providers._contexts.fetch_add(1, std::memory_order_relaxed);
+}
+
+LazyAttributes::~LazyAttributes()
+{
+    flush();
+}
+
+void LazyAttributes::set(const std::string& name, const Variant& value)
+{
+    _values[name] = value;
+}
+
+const Variant* LazyAttributes::find(const std::string& name)
+{
+    if (!_values.empty()) {
+        auto it = _values.find(name);
+        if (it != _values.end()) {
+            return &it->second;
+        }
+    }
+    auto idx = _providers._index.find(name);
+    if (idx == _providers._index.end()) {
+        return nullptr;
+    }
+    Slot& s = _slots[idx->second];
+    switch (s.state) {
+        case PRESENT:
+            ++s.reuses;
+            return &s.value;
+        case ABSENT:
+            ++s.reuses;
+            return nullptr;
+        case FETCHING:
+            // provider 直接或间接依赖自己
+            return nullptr;
+        case UNKNOWN:
+            break;
+    }
+    s.state = FETCHING;
+    Variant value;
+    bool ok = _providers._entries[idx->second]->provider(*this, value);
+    // provider 中的 find 不会改变 _slots 的大小, s 仍然有效
+    s.state = ok ? PRESENT : ABSENT;
+    if (ok) {
+        s.value = value;
+        return &s.value;
+    }
+    return nullptr;
+}
+
+void LazyAttributes::flush()
+{
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        const Slot& s = _slots[i];
+        if (s.state == UNKNOWN) {
+            continue;
+        }
+        auto& e = *_providers._entries[i];
+        e.fetches.fetch_add(1, std::memory_order_relaxed);
+        if (s.state == ABSENT) {
+            e.absent.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (s.reuses) {
+            e.reuses.fetch_add(s.reuses, std::memory_order_relaxed);
+        }
+    }
+}
+
+void LazyAttributes::reset()
+{
+    flush();
+    _values.clear();
+    for (auto& s : _slots) {
+        s.state = UNKNOWN;
+        s.reuses = 0;
+    }
+    _providers._contexts.fetch_add(1, std::memory_order_relaxed);
+}
+
+} //end namespace route
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Variant.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace route {
+
+class LazyAttributes;
+
+struct FetchStats {
+    // provider 被调用的次数
+    uint64_t fetches;
+    // 同一次求值中再次用到, 直接取缓存的次数
+    uint64_t reuses;
+    // provider 返回 "没有该属性" 的次数
+    uint64_t absent;
+};
+
+/**
+ * @brief 按需计算属性的 provider 表, 进程内注册一次, 由所有请求共享
+ *
+ * 注册需在开始求值之前完成. 计数由每个 LazyAttributes 在析构或 reset 时合并进来.
+ */
+class AttributeProviders {
+public:
+    /**
+    * @brief 计算一个属性, 可以通过 attrs.find 读取同一请求的其他属性
+    *
+    * @return false 表示该请求没有这个属性, 引用它的叶子为 false
+    */
+    using Provider = std::function<bool(LazyAttributes& attrs, Variant& value)>;
+
+    AttributeProviders();
+    AttributeProviders(const AttributeProviders&) = delete;
+    AttributeProviders& operator=(const AttributeProviders&) = delete;
+
+    // 同名的 provider 只能注册一次
+    bool add(const std::string& name, Provider provider);
+
+    // 属性名 -> 计数
+    std::map<std::string, FetchStats> stats() const;
+
+    // 创建过的 LazyAttributes 个数 (按 reset 计为多个请求)
+    uint64_t contexts() const { return _contexts.load(std::memory_order_relaxed); }
+
+private:
+    friend class LazyAttributes;
+
+    struct Entry {
+        std::string name;
+        Provider provider;
+        std::atomic<uint64_t> fetches{0};
+        std::atomic<uint64_t> reuses{0};
+        std::atomic<uint64_t> absent{0};
+    };
+
+    std::vector<std::unique_ptr<Entry>> _entries;
+    std::unordered_map<std::string, size_t> _index;
+    mutable std::atomic<uint64_t> _contexts;
+}; // AttributeProviders
+
+/**
+ * @brief 一次请求的属性: 预先给定的值加上按需调用 provider 计算并缓存的值
+ *
+ * 表达式只在叶子真正用到某个属性时才调用它的 provider, 同一个 LazyAttributes 上的后续叶子
+ * 和后续规则直接使用缓存. 不是线程安全的, 每个请求 (或每个线程复用) 一个.
+ */
+class LazyAttributes {
+public:
+    explicit LazyAttributes(const AttributeProviders& providers);
+    ~LazyAttributes();
+    LazyAttributes(const LazyAttributes&) = delete;
+    LazyAttributes& operator=(const LazyAttributes&) = delete;
+
+    // 预先给定的属性, 优先于 provider
+    void set(const std::string& name, const Variant& value);
+
+    // 属性值, 需要时调用 provider; 没有该属性时返回 nullptr
+    const Variant* find(const std::string& name);
+
+    // 清空缓存和预先给定的属性, 用于下一个请求
+    void reset();
+
+private:
+    enum State : uint8_t {
+        UNKNOWN,
+        FETCHING,
+        PRESENT,
+        ABSENT,
+    };
+
+    struct Slot {
+        State state = UNKNOWN;
+        uint32_t reuses = 0;
+        Variant value;
+    };
+
+    void flush();
+
+private:
+    const AttributeProviders& _providers;
+    std::map<std::string, Variant> _values;
+    std::vector<Slot> _slots;
+}; // LazyAttributes
+
+} // end namespace route
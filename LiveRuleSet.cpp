@@ -0,0 +1,339 @@
+#include "LiveRuleSet.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <unordered_set>
+
+#include "CoarseClock.h"
+
+namespace route {
+
+// (priority, seq) 是否排在 r 之前: 优先级高的在前, 相同时先加入的在前
+static inline bool before(int32_t priority, uint64_t seq, const LiveRule& r)
+{
+    return priority > r.rule.priority || (priority == r.rule.priority && seq < r.seq);
+}
+
+template<class Request>
+size_t LiveSnapshot::evaluateRules(Request& request, std::vector<uint32_t>& matched) const
+{
+    size_t n = 0;
+    int64_t now = CoarseClock::now();
+    for (const auto& seg : _segments) {
+        for (const auto& lr : seg->rules) {
+            const Rule& r = lr->rule;
+            if (r.active(now) && r.exp->evaluate(request)) {
+                matched.push_back(r.id);
+                ++n;
+            }
+        }
+    }
+    return n;
+}
+
+size_t LiveSnapshot::evaluate(const std::map<std::string, Variant>& values, std::vector<uint32_t>& matched) const
+{
+    return evaluateRules(values, matched);
+}
+
+size_t LiveSnapshot::evaluate(RequestBuffer& buffer, std::vector<uint32_t>& matched) const
+{
+    return evaluateRules(buffer, matched);
+}
+
+LiveRuleSet::LiveRuleSet(double compact_threshold):
+_threshold(std::max(1.0, compact_threshold)),
+_pools(std::make_shared<ConstantPools>()),
+_attrs(std::make_shared<std::vector<std::string>>()),
+_attrs_dirty(false),
+_seq(0),
+_publishes(0),
+_compactions(0),
+_compiled(0),
+_current(std::make_shared<LiveSnapshot>()),
+_compact_requested(false),
+_stop(false)
+{
+    std::const_pointer_cast<LiveSnapshot>(_current)->_attrs = _attrs;
+    _compactor = std::thread(&LiveRuleSet::compactLoop, this);
+}
+
+LiveRuleSet::~LiveRuleSet()
+{
+    {
+        std::lock_guard<std::mutex> lock(_compact_mutex);
+        _stop = true;
+    }
+    _compact_cv.notify_one();
+    _compactor.join();
+}
+
+std::shared_ptr<LiveRule> LiveRuleSet::compileRule(uint32_t id, const std::string& exp, int32_t priority)
+{
+    std::shared_ptr<LiveRule> r = std::make_shared<LiveRule>();
+    r->pools = _pools;
+    if (!RuleSet::compile(id, exp, priority, *_pools, r->rule)) {
+        return nullptr;
+    }
+    return r;
+}
+
+bool LiveRuleSet::load(const std::string& path)
+{
+    std::vector<RuleText> texts;
+    if (!readRuleFile(path, texts)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    std::unordered_set<uint32_t> ids;
+    std::vector<std::shared_ptr<LiveRule>> changed;
+    for (const auto& t : texts) {
+        if (!ids.insert(t.id).second) {
+            fprintf(stderr, "%s:%zu: duplicate rule id %u\n", path.c_str(), t.line, t.id);
+            return false;
+        }
+        auto it = _by_id.find(t.id);
+        if (it != _by_id.end() && it->second->rule.priority == t.priority &&
+            it->second->rule.exp->getExp() == t.exp) {
+            continue;
+        }
+        std::shared_ptr<LiveRule> r = compileRule(t.id, t.exp, t.priority);
+        if (!r) {
+            fprintf(stderr, "%s:%zu: compile failed: %s\n", path.c_str(), t.line, t.exp.c_str());
+            return false;
+        }
+        changed.push_back(r);
+    }
+    std::vector<std::shared_ptr<const LiveRule>> removed;
+    for (const auto& kv : _by_id) {
+        if (!ids.count(kv.first)) {
+            removed.push_back(kv.second);
+        }
+    }
+    for (const auto& r : removed) {
+        erase(r);
+    }
+    for (const auto& r : changed) {
+        put(r);
+    }
+    _compiled += changed.size();
+    publish();
+    return true;
+}
+
+bool LiveRuleSet::upsert(uint32_t id, const std::string& exp, int32_t priority)
+{
+    // 编译不持锁, 与读者和其他修改并行
+    std::shared_ptr<LiveRule> r = compileRule(id, exp, priority);
+    if (!r) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    put(r);
+    ++_compiled;
+    publish();
+    return true;
+}
+
+bool LiveRuleSet::remove(uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    auto it = _by_id.find(id);
+    if (it == _by_id.end()) {
+        return false;
+    }
+    erase(it->second);
+    publish();
+    return true;
+}
+
+std::shared_ptr<const LiveSnapshot> LiveRuleSet::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(_publish_mutex);
+    return _current;
+}
+
+size_t LiveRuleSet::locate(int32_t priority, uint64_t seq) const
+{
+    auto it = std::upper_bound(_segments.begin(), _segments.end(), 0,
+                               [priority, seq](int, const std::shared_ptr<const LiveSegment>& s) {
+                                   return before(priority, seq, *s->rules.front());
+                               });
+    return it == _segments.begin() ? 0 : it - _segments.begin() - 1;
+}
+
+void LiveRuleSet::put(const std::shared_ptr<LiveRule>& r)
+{
+    auto it = _by_id.find(r->rule.id);
+    if (it != _by_id.end()) {
+        std::shared_ptr<const LiveRule> old = it->second;
+        if (old->rule.priority == r->rule.priority) {
+            // 优先级不变时原位替换, 求值顺序不变
+            r->seq = old->seq;
+            size_t i = locate(old->rule.priority, old->seq);
+            std::shared_ptr<LiveSegment> seg = std::make_shared<LiveSegment>(*_segments[i]);
+            std::replace(seg->rules.begin(), seg->rules.end(), old, std::shared_ptr<const LiveRule>(r));
+            _segments[i] = seg;
+            reference(*old, -1);
+            reference(*r, 1);
+            it->second = r;
+            return;
+        }
+        erase(old);
+    }
+    r->seq = ++_seq;
+    if (_segments.empty()) {
+        std::shared_ptr<LiveSegment> seg = std::make_shared<LiveSegment>();
+        seg->rules.push_back(r);
+        _segments.push_back(seg);
+    } else {
+        size_t i = locate(r->rule.priority, r->seq);
+        std::shared_ptr<LiveSegment> seg = std::make_shared<LiveSegment>(*_segments[i]);
+        auto pos = std::upper_bound(seg->rules.begin(), seg->rules.end(), 0,
+                                    [&r](int, const std::shared_ptr<const LiveRule>& x) {
+                                        return before(r->rule.priority, r->seq, *x);
+                                    });
+        seg->rules.insert(pos, r);
+        _segments[i] = seg;
+        if (seg->rules.size() > 2 * kSegmentRules) {
+            std::shared_ptr<LiveSegment> tail = std::make_shared<LiveSegment>();
+            tail->rules.assign(seg->rules.begin() + kSegmentRules, seg->rules.end());
+            seg->rules.resize(kSegmentRules);
+            _segments.insert(_segments.begin() + i + 1, tail);
+        }
+    }
+    _by_id[r->rule.id] = r;
+    reference(*r, 1);
+}
+
+void LiveRuleSet::erase(std::shared_ptr<const LiveRule> r)
+{
+    size_t i = locate(r->rule.priority, r->seq);
+    std::shared_ptr<LiveSegment> seg = std::make_shared<LiveSegment>(*_segments[i]);
+    seg->rules.erase(std::remove(seg->rules.begin(), seg->rules.end(), r), seg->rules.end());
+    if (seg->rules.empty()) {
+        _segments.erase(_segments.begin() + i);
+    } else {
+        _segments[i] = seg;
+    }
+    _by_id.erase(r->rule.id);
+    reference(*r, -1);
+}
+
+void LiveRuleSet::reference(const LiveRule& r, int delta)
+{
+    for (const auto& name : r.rule.exp->attributes()) {
+        size_t& n = _attr_refs[name];
+        n += delta;
+        if (n == 0) {
+            _attr_refs.erase(name);
+            _attrs_dirty = true;
+        } else if (delta > 0 && n == 1) {
+            _attrs_dirty = true;
+        }
+    }
+}
+
+double LiveRuleSet::fragmentation() const
+{
+    // 实际段数 / 装满时的段数
+    size_t packed = (_by_id.size() + kSegmentRules - 1) / kSegmentRules;
+    return packed ? static_cast<double>(_segments.size()) / packed : 0;
+}
+
+void LiveRuleSet::publish()
+{
+    if (_attrs_dirty) {
+        std::shared_ptr<std::vector<std::string>> attrs = std::make_shared<std::vector<std::string>>();
+        for (const auto& kv : _attr_refs) {
+            attrs->push_back(kv.first);
+        }
+        _attrs = attrs;
+        _attrs_dirty = false;
+    }
+    std::shared_ptr<LiveSnapshot> snap = std::make_shared<LiveSnapshot>();
+    snap->_segments = _segments;
+    snap->_attrs = _attrs;
+    snap->_size = _by_id.size();
+    std::shared_ptr<const LiveSnapshot> old = snap;
+    {
+        std::lock_guard<std::mutex> lock(_publish_mutex);
+        _current.swap(old);
+    }
+    ++_publishes;
+    // old 在锁外释放, 可能连带释放被删除的规则
+    old.reset();
+    if (fragmentation() > _threshold) {
+        {
+            std::lock_guard<std::mutex> lock(_compact_mutex);
+            _compact_requested = true;
+        }
+        _compact_cv.notify_one();
+    }
+}
+
+void LiveRuleSet::repack()
+{
+    std::vector<std::shared_ptr<const LiveSegment>> segments;
+    std::shared_ptr<LiveSegment> seg;
+    for (const auto& s : _segments) {
+        for (const auto& r : s->rules) {
+            if (!seg || seg->rules.size() == kSegmentRules) {
+                seg = std::make_shared<LiveSegment>();
+                seg->rules.reserve(kSegmentRules);
+                segments.push_back(seg);
+            }
+            seg->rules.push_back(r);
+        }
+    }
+    _segments.swap(segments);
+    ++_compactions;
+}
+
+void LiveRuleSet::compact()
+{
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    repack();
+    publish();
+}
+
+void LiveRuleSet::compactLoop()
+{
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(_compact_mutex);
+            _compact_cv.wait(lock, [this]() { return _stop || _compact_requested; });
+            if (_stop) {
+                return;
+            }
+            _compact_requested = false;
+        }
+        std::lock_guard<std::mutex> lock(_write_mutex);
+        // 等待期间可能已被插入填满
+        if (fragmentation() > _threshold) {
+            repack();
+            publish();
+        }
+    }
+}
+
+LiveStats LiveRuleSet::stats() const
+{
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    LiveStats s;
+    s.rules = _by_id.size();
+    s.segments = _segments.size();
+    s.publishes = _publishes;
+    s.compactions = _compactions;
+    s.compiled = _compiled;
+    return s;
+}
+
+PoolStats LiveRuleSet::memoryStats() const
+{
+    PoolStats s = _pools->stats();
+    snapshot()->forEach([&s](const Rule& r) { r.exp->footprint(s); });
+    return s;
+}
+
+} //end namespace route
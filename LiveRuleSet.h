@@ -0,0 +1,179 @@
+#pragma once
+
+#include "RuleSet.h"
+
+#include <stdint.h>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace route {
+
+// 可单独增删的规则, 最后一个引用它的快照释放时析构
+struct LiveRule {
+    // 后于 rule.exp 析构, exp 析构时归还常量池引用
+    std::shared_ptr<ConstantPools> pools;
+    Rule rule;
+    // 同优先级内的先后, 替换时沿用
+    uint64_t seq;
+
+    LiveRule(): seq(0) {}
+    ~LiveRule()
+    {
+        SAFE_RELEASE(rule.exp);
+    }
+};
+
+// 按求值顺序排好的一段规则, 发布后不再修改
+struct LiveSegment {
+    std::vector<std::shared_ptr<const LiveRule>> rules;
+};
+
+/**
+ * @brief LiveRuleSet 某一时刻的只读视图
+ *
+ * 修改只复制受影响的段, 未修改的段在新旧快照间共享. 持有快照期间其中的规则不会被释放.
+ */
+class LiveSnapshot {
+public:
+    size_t size() const { return _size; }
+    size_t segments() const { return _segments.size(); }
+
+    // 同 RuleSet::evaluate, 按优先级求值, 跳过不在生效时间内的规则
+    size_t evaluate(const std::map<std::string, Variant>& values, std::vector<uint32_t>& matched) const;
+    size_t evaluate(RequestBuffer& buffer, std::vector<uint32_t>& matched) const;
+
+    // 所有规则引用到的属性名, 排序去重
+    const std::vector<std::string>& attributes() const { return *_attrs; }
+
+    // 按求值顺序访问每条规则
+    template<class F>
+    void forEach(F f) const
+    {
+        for (const auto& seg : _segments) {
+            for (const auto& r : seg->rules) {
+                f(r->rule);
+            }
+        }
+    }
+
+private:
+    friend class LiveRuleSet;
+
+    template<class Request>
+    size_t evaluateRules(Request& request, std::vector<uint32_t>& matched) const;
+
+private:
+    std::vector<std::shared_ptr<const LiveSegment>> _segments;
+    std::shared_ptr<const std::vector<std::string>> _attrs;
+    size_t _size = 0;
+};
+
+struct LiveStats {
+    size_t rules;
+    size_t segments;
+    uint64_t publishes;
+    uint64_t compactions;
+    // 规则编译次数, load 时未变化的规则不重新编译
+    uint64_t compiled;
+};
+
+/**
+ * @brief 可按 id 增删改单条规则的规则集
+ *
+ * 规则按优先级 (相同时按加入顺序) 分段存放, 每段约 kSegmentRules 条. 修改时只重新编译变化的规则,
+ * 复制它所在的一段 (过长时拆成两段) 和段指针数组, 然后整体发布新快照; 常量池和属性列表只增减
+ * 变化的规则的引用. 读者通过 snapshot() 取得快照, 不会看到修改到一半的状态.
+ *
+ * 删除使段变短, 段数超过装满时所需段数的 compact_threshold 倍时, 后台线程把规则重新
+ * 装满各段 (只复制指针, 不重新编译) 并发布.
+ *
+ * CIDR 叶子使用各自的前缀树, 不建 RuleSet::indexPrefixes 那样的共享索引, 以免每次修改重建.
+ */
+class LiveRuleSet {
+public:
+    static constexpr size_t kSegmentRules = 64;
+
+    explicit LiveRuleSet(double compact_threshold = 2.0);
+    ~LiveRuleSet();
+    LiveRuleSet(const LiveRuleSet&) = delete;
+    LiveRuleSet& operator=(const LiveRuleSet&) = delete;
+
+    /**
+    * @brief 与规则文件同步: 编译新增和文本/优先级有变化的规则, 删除文件中没有的规则, 一次发布
+    *
+    * 任意一条规则编译失败或 id 重复时不做任何修改
+    */
+    bool load(const std::string& path);
+
+    // 插入或替换 id 对应的规则, 编译失败时不修改
+    bool upsert(uint32_t id, const std::string& exp, int32_t priority = 0);
+
+    // 删除 id 对应的规则, 不存在时返回 false
+    bool remove(uint32_t id);
+
+    // 当前发布的快照, 每个请求取一次
+    std::shared_ptr<const LiveSnapshot> snapshot() const;
+
+    size_t evaluate(const std::map<std::string, Variant>& values, std::vector<uint32_t>& matched) const
+    {
+        return snapshot()->evaluate(values, matched);
+    }
+
+    size_t evaluate(RequestBuffer& buffer, std::vector<uint32_t>& matched) const
+    {
+        return snapshot()->evaluate(buffer, matched);
+    }
+
+    // 立即整理分段
+    void compact();
+
+    LiveStats stats() const;
+    // 常量池和当前快照中表达式树的内存统计
+    PoolStats memoryStats() const;
+
+private:
+    std::shared_ptr<LiveRule> compileRule(uint32_t id, const std::string& exp, int32_t priority);
+
+    // 以下在 _write_mutex 内调用
+    void put(const std::shared_ptr<LiveRule>& r);
+    void erase(std::shared_ptr<const LiveRule> r);
+    size_t locate(int32_t priority, uint64_t seq) const;
+    void reference(const LiveRule& r, int delta);
+    void publish();
+    void repack();
+    double fragmentation() const;
+
+    void compactLoop();
+
+private:
+    double _threshold;
+    std::shared_ptr<ConstantPools> _pools;
+
+    mutable std::mutex _write_mutex;
+    std::vector<std::shared_ptr<const LiveSegment>> _segments;
+    std::unordered_map<uint32_t, std::shared_ptr<const LiveRule>> _by_id;
+    std::map<std::string, size_t> _attr_refs;
+    std::shared_ptr<const std::vector<std::string>> _attrs;
+    bool _attrs_dirty;
+    uint64_t _seq;
+    uint64_t _publishes;
+    uint64_t _compactions;
+    uint64_t _compiled;
+
+    mutable std::mutex _publish_mutex;
+    std::shared_ptr<const LiveSnapshot> _current;
+
+    std::mutex _compact_mutex;
+    std::condition_variable _compact_cv;
+    bool _compact_requested;
+    bool _stop;
+    std::thread _compactor;
+}; // LiveRuleSet
+
+} // end namespace route
@@ -0,0 +1,324 @@
+#include "Optimizer.h"
+
+#include <map>
+
+namespace route {
+
+// 同一属性的叶子在两两合并后, 每个叶子再与之前最多几个同属性的叶子尝试合并
+static const size_t kMergeTries = 8;
+
+static inline uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+ExpOptimizer::ExpOptimizer(std::vector<std::string>* report):
+_report(report)
+{
+}
+
+void ExpOptimizer::note(const std::string& msg)
+{
+    if (_report) {
+        _report->push_back(msg);
+    }
+}
+
+TreeNode* ExpOptimizer::makeConst(Type type)
+{
+    TreeNode* t = new TreeNode();
+    t->type = type;
+    t->name = type == ALWAYS ? "true" : "false";
+    return t;
+}
+
+static std::string describeLeaf(const TreeNode* t)
+{
+    switch (t->type) {
+        case NUM:
+        case CLOCK:
+            return t->name + "=" + (t->p ? t->p->Describe() : std::string());
+        case ALWAYS:
+            return "true";
+        case NEVER:
+            return "false";
+        default:
+            return "?";
+    }
+}
+
+std::string ExpOptimizer::describe(const TreeNode* t)
+{
+    if (!t) {
+        return "true";
+    }
+    struct Frame {
+        const TreeNode* node;
+        size_t next;
+    };
+    std::string out;
+    std::vector<Frame> stack(1, Frame{t, 0});
+    while (!stack.empty()) {
+        Frame& f = stack.back();
+        const TreeNode* n = f.node;
+        if (n->type != AND && n->type != OR) {
+            out += describeLeaf(n);
+            stack.pop_back();
+            continue;
+        }
+        if (f.next == 0) {
+            out += "(";
+        }
+        if (f.next == n->children.size()) {
+            out += ")";
+            stack.pop_back();
+            continue;
+        }
+        if (f.next) {
+            out += n->type == AND ? " && " : " || ";
+        }
+        const TreeNode* c = n->children[f.next++];
+        stack.push_back(Frame{c, 0});
+    }
+    return out;
+}
+
+uint64_t ExpOptimizer::signature(const TreeNode* t) const
+{
+    if (t->type == AND || t->type == OR) {
+        auto it = _signatures.find(t);
+        if (it != _signatures.end()) {
+            return it->second;
+        }
+    }
+    return std::hash<std::string>()(t->type == AND || t->type == OR ? describe(t) : describeLeaf(t));
+}
+
+bool ExpOptimizer::same(const TreeNode* a, const TreeNode* b)
+{
+    std::vector<std::pair<const TreeNode*, const TreeNode*>> stack(1, std::make_pair(a, b));
+    while (!stack.empty()) {
+        const TreeNode* x = stack.back().first;
+        const TreeNode* y = stack.back().second;
+        stack.pop_back();
+        if (x->type != y->type || x->children.size() != y->children.size()) {
+            return false;
+        }
+        if (x->type != AND && x->type != OR) {
+            if (describeLeaf(x) != describeLeaf(y)) {
+                return false;
+            }
+            continue;
+        }
+        for (size_t i = 0; i < x->children.size(); ++i) {
+            stack.push_back(std::make_pair(x->children[i], y->children[i]));
+        }
+    }
+    return true;
+}
+
+bool ExpOptimizer::mergeLeaves(std::vector<TreeNode*>& operands, Type op)
+{
+    const char* sep = op == AND ? " && " : " || ";
+    bool changed = false;
+    std::unordered_map<uint64_t, std::vector<size_t>> seen;
+    std::vector<TreeNode*> out;
+    for (TreeNode* t : operands) {
+        uint64_t sig = signature(t);
+        bool dup = false;
+        for (size_t i : seen[sig]) {
+            if (same(out[i], t)) {
+                dup = true;
+                break;
+            }
+        }
+        if (dup) {
+            if (_report) {
+                note("drop duplicate " + describe(t));
+            }
+            TreeNode::destroy(t);
+            changed = true;
+            continue;
+        }
+        seen[sig].push_back(out.size());
+        out.push_back(t);
+    }
+
+    // 合并 out[j] 到 out[i], 成功时 out[j] 置空
+    auto merge = [&](size_t i, size_t j) {
+        TreeNode* prev = out[i];
+        TreeNode* t = out[j];
+        IChecker* p = prev->p->Merge(t->p, op == AND);
+        if (!p) {
+            return false;
+        }
+        std::string before = _report ? describe(prev) + sep + describe(t) : std::string();
+        SAFE_RELEASE(prev->p);
+        prev->p = p;
+        if (_report) {
+            note("merge " + before + " -> " + describe(prev));
+        }
+        TreeNode::destroy(t);
+        out[j] = nullptr;
+        if (p->IsEmpty()) {
+            if (_report) {
+                note("fold " + describe(prev) + " -> false");
+            }
+            TreeNode::destroy(prev);
+            out[i] = makeConst(NEVER);
+        }
+        changed = true;
+        return true;
+    };
+
+    std::map<std::string, std::vector<size_t>> leaves;
+    for (size_t i = 0; i < out.size(); ++i) {
+        if (out[i]->type == NUM && out[i]->p) {
+            leaves[out[i]->name].push_back(i);
+        }
+    }
+    for (auto& kv : leaves) {
+        std::vector<size_t>& group = kv.second;
+        // 相邻的两两合并, 每轮数量减半, 大集合的并不会被反复复制
+        bool merged = group.size() > 1;
+        while (merged) {
+            merged = false;
+            std::vector<size_t> next;
+            for (size_t k = 0; k < group.size(); k += 2) {
+                size_t a = group[k];
+                if (k + 1 == group.size()) {
+                    next.push_back(a);
+                } else if (merge(a, group[k + 1])) {
+                    merged = true;
+                    // 合并为空时已折叠为 NEVER
+                    if (out[a]->type == NUM) {
+                        next.push_back(a);
+                    }
+                } else {
+                    next.push_back(a);
+                    next.push_back(group[k + 1]);
+                }
+            }
+            group.swap(next);
+        }
+        // 不相邻的也可能合并, 如 [0,1] [5,6] [1,5]
+        for (size_t k = 1; k < group.size(); ++k) {
+            size_t from = k > kMergeTries ? k - kMergeTries : 0;
+            for (size_t m = from; m < k; ++m) {
+                if (out[group[m]] && out[group[m]]->type == NUM && merge(group[m], group[k])) {
+                    break;
+                }
+            }
+        }
+    }
+    operands.clear();
+    for (TreeNode* t : out) {
+        if (t) {
+            operands.push_back(t);
+        }
+    }
+    return changed;
+}
+
+TreeNode* ExpOptimizer::reduce(TreeNode* t)
+{
+    if (t->type == NUM || t->type == CLOCK) {
+        if (t->p && t->p->IsEmpty()) {
+            note("fold " + describe(t) + " -> false");
+            TreeNode::destroy(t);
+            return makeConst(NEVER);
+        }
+        return t;
+    }
+    if (t->type != AND && t->type != OR) {
+        return t;
+    }
+    Type op = t->type;
+    Type absorb = op == AND ? NEVER : ALWAYS;
+    Type identity = op == AND ? ALWAYS : NEVER;
+    // 操作数化简后可能变成同类操作符, 其操作数已经化简过, 直接展开
+    std::vector<TreeNode*> operands;
+    for (TreeNode* c : t->children) {
+        if (c->type == op) {
+            operands.insert(operands.end(), c->children.begin(), c->children.end());
+            c->children.clear();
+            delete c;
+        } else {
+            operands.push_back(c);
+        }
+    }
+    t->children.clear();
+    while (mergeLeaves(operands, op)) {
+    }
+
+    for (TreeNode* c : operands) {
+        if (c->type == absorb) {
+            if (_report && operands.size() > 1) {
+                std::string what;
+                for (TreeNode* n : operands) {
+                    what += (what.empty() ? "" : (op == AND ? " && " : " || ")) + describe(n);
+                }
+                note("fold " + what + " -> " + (absorb == ALWAYS ? "true" : "false"));
+            }
+            for (TreeNode* n : operands) {
+                TreeNode::destroy(n);
+            }
+            delete t;
+            return makeConst(absorb);
+        }
+    }
+    std::vector<TreeNode*> rest;
+    for (TreeNode* c : operands) {
+        if (c->type == identity) {
+            TreeNode::destroy(c);
+        } else {
+            rest.push_back(c);
+        }
+    }
+    if (rest.size() <= 1) {
+        delete t;
+        return rest.empty() ? makeConst(identity) : rest[0];
+    }
+    t->children.swap(rest);
+    uint64_t h = mix(op);
+    for (TreeNode* c : t->children) {
+        h = mix(h ^ signature(c));
+    }
+    _signatures[t] = h;
+    return t;
+}
+
+TreeNode* ExpOptimizer::optimize(TreeNode* t)
+{
+    if (!t) {
+        return t;
+    }
+    // 后序遍历, 操作数化简完后再化简节点本身, 结果写回父节点的操作数数组
+    struct Frame {
+        TreeNode* node;
+        TreeNode** slot;
+        size_t next;
+    };
+    TreeNode* root = t;
+    std::vector<Frame> stack(1, Frame{t, &root, 0});
+    while (!stack.empty()) {
+        Frame& f = stack.back();
+        TreeNode* n = f.node;
+        if (f.next < n->children.size()) {
+            TreeNode** slot = &n->children[f.next++];
+            stack.push_back(Frame{*slot, slot, 0});
+            continue;
+        }
+        TreeNode** slot = f.slot;
+        stack.pop_back();
+        *slot = reduce(n);
+    }
+    return root;
+}
+
+} //end namespace route
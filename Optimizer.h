@@ -0,0 +1,49 @@
+#pragma once
+
+#include "xExpression.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace route {
+
+/**
+ * @brief 表达式树的化简
+ *
+ * 1. 连续的同类逻辑操作符展开为同一层的操作数
+ * 2. AND 中同一属性的区间/集合求交, OR 中求并 (能用单个叶子表示时)
+ * 3. 去掉重复的叶子和子表达式
+ * 4. 空区间/空集合折叠为 NEVER, 并按 AND/OR 向上传播常量
+ *
+ * 叶子在属性缺失时不成立, 因此合并只发生在同一属性的叶子之间, 语义不变.
+ * 按后序逐个节点化简, 不递归; 子表达式去重比较 hash, 代价与树的大小成线性.
+ */
+class ExpOptimizer {
+public:
+    explicit ExpOptimizer(std::vector<std::string>* report = nullptr);
+
+    // 返回化简后的树, 被替换的节点已释放
+    TreeNode* optimize(TreeNode* t);
+
+    // 子树的规范化文本
+    static std::string describe(const TreeNode* t);
+
+private:
+    // 化简单个节点, 其操作数已经化简过; 返回替换它的节点
+    TreeNode* reduce(TreeNode* t);
+    bool mergeLeaves(std::vector<TreeNode*>& operands, Type op);
+    void note(const std::string& msg);
+
+    // 子树的结构 hash, 与 describe 相同的子树 hash 相同
+    uint64_t signature(const TreeNode* t) const;
+    static bool same(const TreeNode* a, const TreeNode* b);
+    static TreeNode* makeConst(Type type);
+
+private:
+    std::vector<std::string>* _report;
+    // reduce 返回的 AND/OR 节点的 signature, 用于去重时不必展开整棵子树
+    std::unordered_map<const TreeNode*, uint64_t> _signatures;
+}; // ExpOptimizer
+
+} // end namespace route
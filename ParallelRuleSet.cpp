@@ -0,0 +1,72 @@
+#include "ParallelRuleSet.h"
+#include "CoarseClock.h"
+
+namespace route {
+
+ParallelRuleSet::ParallelRuleSet(const RuleSet* rules, ForkJoinPool* pool, const ParallelOptions& options):
+_rules(rules),
+_pool(pool),
+_parallel(false)
+{
+    size_t total = 0;
+    size_t nodes = 0;
+    _bounds.push_back(0);
+    for (size_t i = 0; i < _rules->size(); ++i) {
+        nodes += _rules->rule(i).exp->size();
+        // 分片边界对齐到位图的字
+        if (nodes >= options.shard_nodes && (i + 1) % 64 == 0) {
+            _bounds.push_back(i + 1);
+            total += nodes;
+            nodes = 0;
+        }
+    }
+    total += nodes;
+    if (_bounds.back() != _rules->size()) {
+        _bounds.push_back(_rules->size());
+    }
+    _parallel = total >= options.min_nodes && shards() > 1 && _pool->workers() > 0;
+}
+
+size_t ParallelRuleSet::evaluate(const std::map<std::string, Variant>& values, std::vector<uint32_t>& matched) const
+{
+    if (!_parallel) {
+        _serial_evals.fetch_add(1, std::memory_order_relaxed);
+        return _rules->evaluate(values, matched);
+    }
+    thread_local std::vector<uint64_t> bits;
+    bits.assign((_rules->size() + 63) / 64, 0);
+    uint64_t* words = bits.data();
+    int64_t now = CoarseClock::now();
+    std::function<void(size_t)> shard = [this, &values, words, now](size_t s) {
+        for (size_t i = _bounds[s]; i < _bounds[s + 1]; ++i) {
+            const Rule& r = _rules->rule(i);
+            if (r.active(now) && r.exp->evaluate(values)) {
+                words[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    };
+    if (_pool->run(shards(), shard)) {
+        _parallel_evals.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        _busy_evals.fetch_add(1, std::memory_order_relaxed);
+    }
+    size_t n = 0;
+    for (size_t w = 0; w < bits.size(); ++w) {
+        for (uint64_t word = words[w]; word; word &= word - 1) {
+            matched.push_back(_rules->rule(w * 64 + __builtin_ctzll(word)).id);
+            ++n;
+        }
+    }
+    return n;
+}
+
+ParallelStats ParallelRuleSet::stats() const
+{
+    ParallelStats s;
+    s.parallel = _parallel_evals.load(std::memory_order_relaxed);
+    s.serial = _serial_evals.load(std::memory_order_relaxed);
+    s.busy = _busy_evals.load(std::memory_order_relaxed);
+    return s;
+}
+
+} //end namespace route
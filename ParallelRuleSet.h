@@ -0,0 +1,62 @@
+#pragma once
+
+#include "RuleSet.h"
+#include "ForkJoinPool.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace route {
+
+struct ParallelOptions {
+    // 每个分片的表达式节点数, 默认约等于 L2 能放下的规则
+    size_t shard_nodes;
+    // 节点总数低于此值时单线程求值, 分发和合并的开销超过并行的收益
+    size_t min_nodes;
+    ParallelOptions(size_t shard = 4096, size_t min = 65536): shard_nodes(shard), min_nodes(min) {}
+};
+
+struct ParallelStats {
+    uint64_t parallel;
+    // 规则集太小, 单线程求值
+    uint64_t serial;
+    // 池正被其他请求使用, 在调用线程求值
+    uint64_t busy;
+};
+
+/**
+ * @brief 单个请求在大规则集上的 fork-join 求值, 不拥有 rules 和 pool
+ *
+ * 规则按顺序切成节点数约为 shard_nodes 的分片, 分片边界对齐到 64 条规则.
+ * 各分片在池中并行求值, 命中写入按规则下标的位图, 每个 64 位字只属于一个分片, 不需要原子操作;
+ * 最后按位图顺序输出 id, 命中顺序与 RuleSet::evaluate 相同.
+ * 规则集不能在求值期间修改, 修改后需重新构造.
+ */
+class ParallelRuleSet {
+public:
+    ParallelRuleSet(const RuleSet* rules, ForkJoinPool* pool, const ParallelOptions& options = ParallelOptions());
+
+    // 同 RuleSet::evaluate, 可以被多个线程同时调用
+    size_t evaluate(const std::map<std::string, Variant>& values, std::vector<uint32_t>& matched) const;
+
+    size_t shards() const { return _bounds.size() - 1; }
+    // 是否会尝试并行求值
+    bool parallel() const { return _parallel; }
+
+    ParallelStats stats() const;
+
+private:
+    const RuleSet* _rules;
+    ForkJoinPool* _pool;
+    // 第 i 个分片为规则 [_bounds[i], _bounds[i + 1])
+    std::vector<size_t> _bounds;
+    bool _parallel;
+    mutable std::atomic<uint64_t> _parallel_evals{0};
+    mutable std::atomic<uint64_t> _serial_evals{0};
+    mutable std::atomic<uint64_t> _busy_evals{0};
+}; // ParallelRuleSet
+
+} // end namespace route
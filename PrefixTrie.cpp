@@ -0,0 +1,150 @@
+#include "PrefixTrie.h"
+
+#include <atomic>
+
+namespace route {
+
+static const int kStride = 6;
+
+PrefixTrie::PrefixTrie():
+_root4(0),
+_root6(0)
+{
+}
+
+void PrefixTrie::clear()
+{
+    std::vector<Node>().swap(_nodes);
+    std::vector<uint32_t>().swap(_leaves);
+    std::vector<uint32_t>().swap(_set_offsets);
+    std::vector<uint32_t>().swap(_set_labels);
+    _set_ids.clear();
+    _root4 = 0;
+    _root6 = 0;
+}
+
+void PrefixTrie::build(const std::vector<Entry>& entries)
+{
+    clear();
+    _set_offsets.assign(2, 0);
+    _set_ids.emplace(std::vector<uint32_t>(), 0);
+
+    // ::ffff:0:0/96 之外的 IPv6 前缀也可能覆盖全部 IPv4 地址, 如 ::/0
+    static const IpAddr kMapped(0, 0xffff00000000ULL);
+    std::vector<Key> v4;
+    std::vector<Key> v6;
+    std::vector<uint32_t> all_v4;
+    for (const auto& e : entries) {
+        const IpPrefix& p = e.prefix;
+        if (p.len >= 96 && p.addr.isV4()) {
+            v4.push_back(Key{static_cast<uint64_t>(p.addr.v4()) << 32, 0, p.len - 96, e.label});
+        } else {
+            v6.push_back(Key{p.addr.hi, p.addr.lo, p.len, e.label});
+            if (p.contains(kMapped)) {
+                all_v4.push_back(e.label);
+            }
+        }
+    }
+    _root4 = buildRoot(v4, all_v4);
+    _root6 = buildRoot(v6, std::vector<uint32_t>());
+    _set_ids.clear();
+}
+
+uint32_t PrefixTrie::buildRoot(const std::vector<Key>& keys, const std::vector<uint32_t>& inherited)
+{
+    uint32_t index = static_cast<uint32_t>(_nodes.size());
+    _nodes.emplace_back();
+    std::vector<const Key*> ptrs;
+    ptrs.reserve(keys.size());
+    for (const auto& k : keys) {
+        ptrs.push_back(&k);
+    }
+    buildNode(index, 0, inherited, ptrs);
+    return index;
+}
+
+void PrefixTrie::buildNode(uint32_t index, int depth, const std::vector<uint32_t>& inherited,
+                           const std::vector<const Key*>& keys)
+{
+    // 在本层结束的前缀覆盖一段连续的分支, 更长的前缀落到某个分支的子节点
+    std::vector<uint32_t> covered[64];
+    std::vector<const Key*> below[64];
+    for (const Key* k : keys) {
+        uint32_t c = chunk(k->hi, k->lo, depth);
+        int bits = k->len - depth;
+        if (bits <= kStride) {
+            uint32_t span = 1u << (kStride - bits);
+            for (uint32_t j = c; j < c + span; ++j) {
+                covered[j].push_back(k->label);
+            }
+        } else {
+            below[c].push_back(k);
+        }
+    }
+
+    uint32_t sets[64];
+    uint32_t children = 0;
+    for (int i = 0; i < 64; ++i) {
+        std::vector<uint32_t> labels(inherited);
+        labels.insert(labels.end(), covered[i].begin(), covered[i].end());
+        sets[i] = internSet(labels);
+        children += !below[i].empty();
+    }
+
+    Node node = {0, 0, static_cast<uint32_t>(_leaves.size()), static_cast<uint32_t>(_nodes.size())};
+    _nodes.resize(_nodes.size() + children);
+    bool have = false;
+    uint32_t last = 0;
+    for (int i = 0; i < 64; ++i) {
+        if (!below[i].empty()) {
+            node.vector |= 1ULL << i;
+        } else if (!have || sets[i] != last) {
+            node.leafvec |= 1ULL << i;
+            _leaves.push_back(sets[i]);
+            last = sets[i];
+            have = true;
+        }
+    }
+    _nodes[index] = node;
+
+    uint32_t child = node.base1;
+    for (int i = 0; i < 64; ++i) {
+        if (below[i].empty()) {
+            continue;
+        }
+        uint32_t n;
+        const uint32_t* labels = this->labels(sets[i], n);
+        buildNode(child++, depth + kStride, std::vector<uint32_t>(labels, labels + n), below[i]);
+    }
+}
+
+uint32_t PrefixTrie::internSet(std::vector<uint32_t>& labels)
+{
+    std::sort(labels.begin(), labels.end());
+    labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+    auto it = _set_ids.find(labels);
+    if (it != _set_ids.end()) {
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(_set_offsets.size() - 1);
+    _set_labels.insert(_set_labels.end(), labels.begin(), labels.end());
+    _set_offsets.push_back(static_cast<uint32_t>(_set_labels.size()));
+    _set_ids.emplace(labels, id);
+    return id;
+}
+
+size_t PrefixTrie::bytes() const
+{
+    return _nodes.capacity() * sizeof(Node) + _leaves.capacity() * sizeof(uint32_t) +
+           (_set_offsets.capacity() + _set_labels.capacity()) * sizeof(uint32_t);
+}
+
+static std::atomic<uint64_t> g_index_generation{0};
+
+PrefixIndex::PrefixIndex(const std::vector<PrefixTrie::Entry>& entries):
+_generation(++g_index_generation)
+{
+    _trie.build(entries);
+}
+
+} //end namespace route
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "IpAddr.h"
+
+namespace route {
+
+/**
+ * @brief 压缩的多路前缀树 (poptrie), 查询覆盖一个地址的所有前缀
+ *
+ * 每层取地址的 6 位, 节点用两个 64 位位图表示 64 个分支:
+ *   vector  第 i 位为 1 表示分支 i 有子节点, 子节点连续存放, 下标为 base1 + popcount(vector 的低 i+1 位) - 1
+ *   leafvec 相邻的相同叶子只存一份, 第 i 位为 1 表示分支 i 开始一个新叶子, 下标同样用 popcount 计算
+ * 查询的访存次数只与最长前缀的长度有关 (IPv4 /24 最多 4 层), 与前缀个数无关.
+ * IPv4 和 IPv6 各一棵树, IPv4 按 32 位地址建树, 不经过 mapped 地址的前 96 位.
+ *
+ * 每个前缀带一个 label, 叶子存覆盖该位置的所有前缀的 label 集合的编号, 编号 0 为空集.
+ */
+class PrefixTrie {
+public:
+    struct Entry {
+        IpPrefix prefix;
+        uint32_t label;
+    };
+
+    PrefixTrie();
+
+    void build(const std::vector<Entry>& entries);
+
+    void clear();
+
+    // 覆盖 addr 的前缀的 label 集合编号, 0 表示没有前缀覆盖 addr
+    inline uint32_t lookup(const IpAddr& addr) const
+    {
+        if (_nodes.empty()) {
+            return 0;
+        }
+        if (addr.isV4()) {
+            return walk(_root4, static_cast<uint64_t>(addr.v4()) << 32, 0);
+        }
+        return walk(_root6, addr.hi, addr.lo);
+    }
+
+    // 编号为 set 的 label 集合, 升序
+    const uint32_t* labels(uint32_t set, uint32_t& n) const
+    {
+        n = _set_offsets[set + 1] - _set_offsets[set];
+        return _set_labels.data() + _set_offsets[set];
+    }
+
+    size_t nodes() const { return _nodes.size(); }
+    size_t sets() const { return _set_offsets.size() - 1; }
+    size_t bytes() const;
+
+private:
+    struct Node {
+        uint64_t vector;
+        uint64_t leafvec;
+        uint32_t base0;
+        uint32_t base1;
+    };
+
+    // 建树时的前缀, 地址左对齐到 128 位
+    struct Key {
+        uint64_t hi;
+        uint64_t lo;
+        int len;
+        uint32_t label;
+    };
+
+    // hi:lo 的第 [pos, pos + 6) 位, 超出 128 位的部分为 0
+    static inline uint32_t chunk(uint64_t hi, uint64_t lo, int pos)
+    {
+        if (pos >= 64) {
+            return static_cast<uint32_t>((lo << (pos - 64)) >> 58);
+        }
+        if (pos <= 58) {
+            return static_cast<uint32_t>((hi << pos) >> 58);
+        }
+        return static_cast<uint32_t>(((hi << pos) >> 58) | (lo >> (122 - pos)));
+    }
+
+    inline uint32_t walk(uint32_t root, uint64_t hi, uint64_t lo) const
+    {
+        const Node* n = &_nodes[root];
+        for (int pos = 0; ; pos += 6) {
+            uint32_t v = chunk(hi, lo, pos);
+            uint64_t bit = 1ULL << v;
+            uint64_t mask = bit | (bit - 1);
+            if (!(n->vector & bit)) {
+                return _leaves[n->base0 + __builtin_popcountll(n->leafvec & mask) - 1];
+            }
+            n = &_nodes[n->base1 + __builtin_popcountll(n->vector & mask) - 1];
+        }
+    }
+
+    uint32_t buildRoot(const std::vector<Key>& keys, const std::vector<uint32_t>& inherited);
+    void buildNode(uint32_t index, int depth, const std::vector<uint32_t>& inherited,
+                   const std::vector<const Key*>& keys);
+    uint32_t internSet(std::vector<uint32_t>& labels);
+
+private:
+    std::vector<Node> _nodes;
+    std::vector<uint32_t> _leaves;
+    // 第 i 个集合为 _set_labels[_set_offsets[i], _set_offsets[i + 1])
+    std::vector<uint32_t> _set_offsets;
+    std::vector<uint32_t> _set_labels;
+    std::map<std::vector<uint32_t>, uint32_t> _set_ids;
+    uint32_t _root4;
+    uint32_t _root6;
+}; // PrefixTrie
+
+/**
+ * @brief 规则集内同一属性上所有 CIDR 叶子共用的前缀树
+ *
+ * label 为叶子的编号. 每个线程记住最近一次查询的地址和结果, 同一个请求中
+ * 该属性上的所有叶子只查一次树, 之后每个叶子只在结果集合里找自己的编号.
+ */
+class PrefixIndex {
+public:
+    explicit PrefixIndex(const std::vector<PrefixTrie::Entry>& entries);
+
+    inline bool contains(const IpAddr& addr, uint32_t label) const
+    {
+        struct Memo {
+            uint64_t generation;
+            IpAddr addr;
+            uint32_t set;
+        };
+        static thread_local Memo memo = {0, IpAddr(), 0};
+        if (memo.generation != _generation || memo.addr != addr) {
+            memo.generation = _generation;
+            memo.addr = addr;
+            memo.set = _trie.lookup(addr);
+        }
+        uint32_t n;
+        const uint32_t* labels = _trie.labels(memo.set, n);
+        if (n > 8) {
+            return std::binary_search(labels, labels + n, label);
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            if (labels[i] == label) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const PrefixTrie& trie() const { return _trie; }
+
+private:
+    PrefixTrie _trie;
+    // 进程内唯一, 区分线程缓存属于哪个索引
+    uint64_t _generation;
+}; // PrefixIndex
+
+} // end namespace route
@@ -0,0 +1,161 @@
+#include "ProfileIndex.h"
+
+#include <stdio.h>
+#include <fstream>
+
+namespace route {
+
+bool ProfileIndex::load(const std::string& path)
+{
+    std::ifstream in(path.c_str());
+    if (!in) {
+        fprintf(stderr, "open profile file failed: %s\n", path.c_str());
+        return false;
+    }
+    _ids.clear();
+    _columns.clear();
+    std::string line;
+    if (!std::getline(in, line)) {
+        fprintf(stderr, "%s: missing header\n", path.c_str());
+        return false;
+    }
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+    std::vector<Column*> columns;
+    for (std::string_view name : gsl::SplitView(line, ',')) {
+        // 第一列为用户 id, 不建索引
+        columns.push_back(columns.empty() ? nullptr : &_columns[std::string(name)]);
+    }
+    if (columns.size() < 2) {
+        fprintf(stderr, "%s: header needs an id column and at least one attribute\n", path.c_str());
+        return false;
+    }
+    size_t lineno = 1;
+    while (std::getline(in, line)) {
+        ++lineno;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        if (_ids.size() == UINT32_MAX) {
+            fprintf(stderr, "%s:%zu: too many rows\n", path.c_str(), lineno);
+            return false;
+        }
+        uint32_t row = static_cast<uint32_t>(_ids.size());
+        size_t i = 0;
+        for (std::string_view cell : gsl::SplitView(line, ',')) {
+            if (i >= columns.size()) {
+                fprintf(stderr, "%s:%zu: too many columns\n", path.c_str(), lineno);
+                return false;
+            }
+            if (i == 0) {
+                _ids.emplace_back(cell);
+            } else if (!cell.empty()) {
+                (*columns[i])[std::string(cell)].add(row);
+            }
+            ++i;
+        }
+    }
+    return true;
+}
+
+Bitmap ProfileIndex::select(const ASTExp& exp) const
+{
+    return select(exp.tree());
+}
+
+Bitmap ProfileIndex::select(const TreeNode* t) const
+{
+    if (!t) {
+        return Bitmap::Range(rows());
+    }
+    // 后序遍历, 栈中为 AND/OR 节点, 下一个操作数和已合并的结果
+    struct Frame {
+        const TreeNode* node;
+        size_t next;
+        Bitmap acc;
+    };
+    std::vector<Frame> stack;
+    Bitmap ret;
+    for (;;) {
+        while ((t->type == AND || t->type == OR) && !t->children.empty()) {
+            stack.push_back(Frame{t, 1, Bitmap()});
+            t = t->children[0];
+        }
+        switch (t->type) {
+            case NUM:
+                ret = leaf(t);
+                break;
+            case CLOCK:
+                ret = t->p->IsValidNow() ? Bitmap::Range(rows()) : Bitmap();
+                break;
+            case ALWAYS:
+            case AND:
+                ret = Bitmap::Range(rows());
+                break;
+            default:
+                ret = Bitmap();
+        }
+        t = nullptr;
+        while (!t) {
+            if (stack.empty()) {
+                return ret;
+            }
+            Frame& f = stack.back();
+            if (f.next == 1) {
+                f.acc = std::move(ret);
+            } else if (f.node->type == AND) {
+                f.acc &= ret;
+            } else {
+                f.acc |= ret;
+            }
+            if (f.next < f.node->children.size() && !(f.node->type == AND && f.acc.empty())) {
+                t = f.node->children[f.next++];
+            } else {
+                ret = std::move(f.acc);
+                stack.pop_back();
+            }
+        }
+    }
+}
+
+Bitmap ProfileIndex::leaf(const TreeNode* t) const
+{
+    Bitmap b;
+    auto it = _columns.find(t->name);
+    if (it == _columns.end() || !t->p) {
+        return b;
+    }
+    // 每个不同的取值只比较一次
+    for (const auto& kv : it->second) {
+        if (t->p->IsValidRaw(kv.first.data(), kv.first.size())) {
+            b |= kv.second;
+        }
+    }
+    return b;
+}
+
+std::map<std::string, size_t> ProfileIndex::cardinalities() const
+{
+    std::map<std::string, size_t> out;
+    for (const auto& kv : _columns) {
+        out[kv.first] = kv.second.size();
+    }
+    return out;
+}
+
+size_t ProfileIndex::bytes() const
+{
+    size_t n = 0;
+    for (const auto& kv : _columns) {
+        for (const auto& v : kv.second) {
+            n += v.second.bytes();
+        }
+    }
+    return n;
+}
+
+} //end namespace route
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "xExpression.h"
+#include "Bitmap.h"
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace route {
+
+/**
+ * @brief 用户画像数据集上的位图索引, 用于离线估算一条规则覆盖的人群
+ *
+ * 数据文件为逗号分隔, 首行为表头, 第一列为用户 id, 其余列为表达式使用的属性名:
+ *
+ *   id,V,P,A,L,E
+ *   10001,1208,1,1,3,abtest
+ *
+ * 空单元格视为缺少该属性. 每个 (属性, 取值) 一个 Bitmap, 位为行号.
+ * 求值时叶子翻译为满足条件的各取值位图的并集, AND/OR 翻译为位图的交/并.
+ */
+class ProfileIndex {
+public:
+    bool load(const std::string& path);
+
+    uint32_t rows() const { return static_cast<uint32_t>(_ids.size()); }
+
+    // 满足表达式的行
+    Bitmap select(const ASTExp& exp) const;
+
+    uint64_t count(const ASTExp& exp) const { return select(exp).cardinality(); }
+
+    // 行号对应的用户 id
+    const std::string& id(uint32_t row) const { return _ids[row]; }
+
+    // 属性名 -> 不同取值的个数
+    std::map<std::string, size_t> cardinalities() const;
+
+    // 所有位图占用的字节数
+    size_t bytes() const;
+
+private:
+    typedef std::unordered_map<std::string, Bitmap> Column;
+
+    Bitmap select(const TreeNode* t) const;
+    Bitmap leaf(const TreeNode* t) const;
+
+private:
+    std::vector<std::string> _ids;
+    std::map<std::string, Column> _columns;
+}; // ProfileIndex
+
+} // end namespace route
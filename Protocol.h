@@ -0,0 +1,160 @@
+#pragma once
+
+#include "Variant.h"
+#include "StringUtil.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace route {
+namespace proto {
+
+/*
+ * routed 的二进制协议, 本机 Unix domain socket 使用, 字节序为主机序.
+ *
+ * frame    : uint32 body_len | body
+ * request  : uint32 seq | uint16 count | count * (uint8 slot | uint8 type | value)
+ * value    : T_INT32 int32 | T_UINT32 uint32 | T_DOUBLE double | T_STRING uint16 len + bytes |
+ *            T_VERSION uint64 (打包的版本号, 见 Version.h) | T_IP uint64 hi + uint64 lo (见 IpAddr.h)
+ * response : uint32 seq | uint32 count | count * uint32 rule_id
+ *
+ * slot 是属性名在属性表中的下标, 客户端和服务端需使用同一张属性表 (-a 参数).
+ * 同一连接上可以连续发送多个请求 (pipeline), 响应按请求顺序返回.
+ */
+
+enum ValueType : uint8_t {
+    T_INT32 = 1,
+    T_UINT32 = 2,
+    T_DOUBLE = 3,
+    T_STRING = 4,
+    T_VERSION = 5,
+    T_IP = 6,
+};
+
+const uint32_t kMaxFrameSize = 1 << 20;
+const char* const kDefaultAttributes = "V,P,A,L,E";
+
+inline void SplitAttributes(const std::string& str, std::vector<std::string>& names)
+{
+    names.clear();
+    gsl::StringSplit(str, names, ',');
+}
+
+class Writer {
+public:
+    explicit Writer(std::string& buf): _buf(buf) {}
+
+    template<class T>
+    void put(const T& v)
+    {
+        _buf.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    void putString(const std::string& s)
+    {
+        put<uint16_t>(static_cast<uint16_t>(s.size()));
+        _buf.append(s.data(), s.size());
+    }
+
+    // 预留帧长度, 由 endFrame 回填
+    size_t beginFrame()
+    {
+        size_t pos = _buf.size();
+        put<uint32_t>(0);
+        return pos;
+    }
+
+    void endFrame(size_t pos)
+    {
+        uint32_t len = static_cast<uint32_t>(_buf.size() - pos - sizeof(uint32_t));
+        memcpy(&_buf[pos], &len, sizeof(len));
+    }
+
+private:
+    std::string& _buf;
+};
+
+class Reader {
+public:
+    Reader(const char* data, size_t len): _p(data), _end(data + len) {}
+
+    template<class T>
+    bool get(T& v)
+    {
+        if (static_cast<size_t>(_end - _p) < sizeof(T)) {
+            return false;
+        }
+        memcpy(&v, _p, sizeof(T));
+        _p += sizeof(T);
+        return true;
+    }
+
+    bool getString(std::string& s)
+    {
+        uint16_t len = 0;
+        if (!get(len) || static_cast<size_t>(_end - _p) < len) {
+            return false;
+        }
+        s.assign(_p, len);
+        _p += len;
+        return true;
+    }
+
+    bool getValue(Variant& v)
+    {
+        uint8_t type = 0;
+        if (!get(type)) {
+            return false;
+        }
+        switch (type) {
+            case T_INT32: {
+                int32_t i;
+                if (!get(i)) return false;
+                v = Variant(static_cast<int>(i));
+                return true;
+            }
+            case T_UINT32: {
+                uint32_t u;
+                if (!get(u)) return false;
+                v = Variant(static_cast<unsigned int>(u));
+                return true;
+            }
+            case T_DOUBLE: {
+                double d;
+                if (!get(d)) return false;
+                v = Variant(d);
+                return true;
+            }
+            case T_STRING: {
+                std::string s;
+                if (!getString(s)) return false;
+                v = Variant(s);
+                return true;
+            }
+            case T_VERSION: {
+                uint64_t packed;
+                if (!get(packed)) return false;
+                v = Variant(Version(packed));
+                return true;
+            }
+            case T_IP: {
+                IpAddr addr;
+                if (!get(addr.hi) || !get(addr.lo)) return false;
+                v = Variant(addr);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool eof() const { return _p == _end; }
+
+private:
+    const char* _p;
+    const char* _end;
+};
+
+} // end namespace proto
+} // end namespace route
@@ -0,0 +1,185 @@
+#include "ReplicatedRuleSet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fstream>
+#include <thread>
+
+namespace route {
+
+static std::atomic<uint64_t> g_instances(0);
+
+struct LocalReplica {
+    uint64_t instance;
+    uint64_t version;
+    std::atomic<uint64_t>* published;
+    std::shared_ptr<const RuleSet> rules;
+    LocalReplica(): instance(0), version(0), published(nullptr) {}
+};
+
+static thread_local LocalReplica t_local;
+
+// 解析 "0-3,8-11" 形式的 cpu 列表
+static void parseCpuList(const std::string& str, std::vector<int>& cpus)
+{
+    std::vector<std::string> ranges;
+    gsl::StringSplit(str, ranges, ',');
+    for (const auto& r : ranges) {
+        if (r.empty()) {
+            continue;
+        }
+        int lo = 0;
+        int hi = 0;
+        if (sscanf(r.c_str(), "%d-%d", &lo, &hi) == 2) {
+            for (int c = lo; c <= hi; ++c) {
+                cpus.push_back(c);
+            }
+        } else if (sscanf(r.c_str(), "%d", &lo) == 1) {
+            cpus.push_back(lo);
+        }
+    }
+}
+
+// 读取 sysfs 中的 NUMA 节点, 没有时视为单节点
+static void readNodes(std::vector<std::vector<int>>& nodes)
+{
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir) {
+        struct dirent* ent;
+        while ((ent = readdir(dir)) != NULL) {
+            int id = 0;
+            if (sscanf(ent->d_name, "node%d", &id) != 1) {
+                continue;
+            }
+            std::ifstream in(std::string("/sys/devices/system/node/") + ent->d_name + "/cpulist");
+            std::string line;
+            std::vector<int> cpus;
+            if (std::getline(in, line)) {
+                parseCpuList(line, cpus);
+            }
+            if (!cpus.empty()) {
+                nodes.push_back(cpus);
+            }
+        }
+        closedir(dir);
+    }
+    if (nodes.empty()) {
+        long n = sysconf(_SC_NPROCESSORS_CONF);
+        std::vector<int> cpus;
+        for (long c = 0; c < (n > 0 ? n : 1); ++c) {
+            cpus.push_back(static_cast<int>(c));
+        }
+        nodes.push_back(cpus);
+    }
+}
+
+ReplicatedRuleSet::ReplicatedRuleSet(Mode mode):
+_instance(++g_instances)
+{
+    std::vector<std::vector<int>> groups;
+    readNodes(groups);
+    if (mode == PER_CPU) {
+        std::vector<std::vector<int>> cpus;
+        for (const auto& node : groups) {
+            for (int c : node) {
+                cpus.push_back(std::vector<int>(1, c));
+            }
+        }
+        groups.swap(cpus);
+    }
+    for (const auto& g : groups) {
+        std::unique_ptr<Replica> r(new Replica());
+        r->cpus = g;
+        for (int c : g) {
+            if (c >= static_cast<int>(_cpu_to_replica.size())) {
+                _cpu_to_replica.resize(c + 1, 0);
+            }
+            _cpu_to_replica[c] = static_cast<int>(_replicas.size());
+        }
+        _replicas.push_back(std::move(r));
+    }
+}
+
+ReplicatedRuleSet::~ReplicatedRuleSet()
+{
+}
+
+int ReplicatedRuleSet::replicaOf(int cpu) const
+{
+    if (cpu < 0 || cpu >= static_cast<int>(_cpu_to_replica.size())) {
+        return 0;
+    }
+    return _cpu_to_replica[cpu];
+}
+
+std::shared_ptr<const RuleSet> ReplicatedRuleSet::build(const RuleSet& master, const std::vector<int>& cpus)
+{
+    // 绑定到目标节点的 CPU 上编译, 副本内存按 first-touch 落在该节点
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) {
+        CPU_SET(c, &set);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    std::shared_ptr<RuleSet> rules(new RuleSet());
+    if (!rules->assign(master)) {
+        return nullptr;
+    }
+    return rules;
+}
+
+bool ReplicatedRuleSet::load(const std::string& path)
+{
+    std::lock_guard<std::mutex> reload(_reload_mutex);
+    std::unique_ptr<RuleSet> master(new RuleSet());
+    if (!master->load(path)) {
+        return false;
+    }
+    // 每个副本一个编译线程
+    std::vector<std::shared_ptr<const RuleSet>> built(_replicas.size());
+    std::vector<std::thread> builders;
+    for (size_t i = 0; i < _replicas.size(); ++i) {
+        builders.emplace_back([&, i]() {
+            built[i] = build(*master, _replicas[i]->cpus);
+        });
+    }
+    for (auto& th : builders) {
+        th.join();
+    }
+    for (const auto& b : built) {
+        if (!b) {
+            fprintf(stderr, "build replica failed: %s\n", path.c_str());
+            return false;
+        }
+    }
+    for (size_t i = 0; i < _replicas.size(); ++i) {
+        Replica& r = *_replicas[i];
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.rules = built[i];
+        r.version.fetch_add(1, std::memory_order_release);
+    }
+    _master.swap(master);
+    return true;
+}
+
+const RuleSet& ReplicatedRuleSet::local()
+{
+    LocalReplica& c = t_local;
+    if (c.instance == _instance &&
+        c.version == c.published->load(std::memory_order_acquire)) {
+        return *c.rules;
+    }
+    Replica& r = *_replicas[replicaOf(sched_getcpu())];
+    std::lock_guard<std::mutex> lock(r.mutex);
+    c.instance = _instance;
+    c.published = &r.version;
+    c.version = r.version.load(std::memory_order_relaxed);
+    c.rules = r.rules;
+    return *c.rules;
+}
+
+} //end namespace route
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "RuleSet.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace route {
+
+/**
+ * @brief 按 NUMA 节点 (或按 CPU) 复制的规则集
+ *
+ * 每个副本由绑定在该节点 CPU 上的线程编译, 依靠 first-touch 策略把内存分配在本节点.
+ * 求值线程通过 local() 取得本节点的副本, 只读一个本地副本的版本号, 不与其他节点共享缓存行.
+ * reload 时先编译主副本校验规则, 再逐个重建并发布各节点副本.
+ */
+class ReplicatedRuleSet {
+public:
+    enum Mode { PER_NODE, PER_CPU };
+
+    explicit ReplicatedRuleSet(Mode mode = PER_NODE);
+    ~ReplicatedRuleSet();
+    ReplicatedRuleSet(const ReplicatedRuleSet&) = delete;
+    ReplicatedRuleSet& operator=(const ReplicatedRuleSet&) = delete;
+
+    // 加载或重新加载规则文件, 失败时保留原有副本
+    bool load(const std::string& path);
+
+    // 当前线程所在节点的副本, 需先 load 成功
+    const RuleSet& local();
+
+    size_t replicas() const { return _replicas.size(); }
+    const RuleSet& master() const { return *_master; }
+
+private:
+    struct alignas(64) Replica {
+        std::atomic<uint64_t> version;
+        std::mutex mutex;
+        std::shared_ptr<const RuleSet> rules;
+        std::vector<int> cpus;
+        Replica(): version(0) {}
+    };
+
+    int replicaOf(int cpu) const;
+    // 在调用线程上编译, 调用线程会被绑定到 cpus
+    static std::shared_ptr<const RuleSet> build(const RuleSet& master, const std::vector<int>& cpus);
+
+private:
+    uint64_t _instance;
+    std::vector<std::unique_ptr<Replica>> _replicas;
+    std::vector<int> _cpu_to_replica;
+    std::unique_ptr<RuleSet> _master;
+    std::mutex _reload_mutex;
+}; // ReplicatedRuleSet
+
+} // end namespace route
@@ -0,0 +1,112 @@
+#include "RequestBuffer.h"
+#include "IpAddr.h"
+
+namespace route {
+
+RequestBuffer::RequestBuffer(const char* data, size_t len, const BufferFormat& format):
+_data(data),
+_len(len),
+_pos(0),
+_format(format),
+_corrupted(false)
+{
+}
+
+void RequestBuffer::reset(const char* data, size_t len)
+{
+    _data = data;
+    _len = len;
+    _pos = 0;
+    _corrupted = false;
+    _entries.clear();
+}
+
+bool RequestBuffer::find(const char* name, size_t nlen, RawValue& value)
+{
+    for (const auto& e : _entries) {
+        if (e.nlen == nlen && memcmp(e.name, name, nlen) == 0) {
+            value = e.value;
+            return true;
+        }
+    }
+    Entry e;
+    while (next(e)) {
+        _entries.push_back(e);
+        if (e.nlen == nlen && memcmp(e.name, name, nlen) == 0) {
+            value = e.value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RequestBuffer::next(Entry& e)
+{
+    return _format.kind == BufferFormat::TLV ? nextTlv(e) : nextQuery(e);
+}
+
+bool RequestBuffer::nextQuery(Entry& e)
+{
+    while (_pos < _len) {
+        const char* begin = _data + _pos;
+        const char* end = static_cast<const char*>(memchr(begin, _format.pair_sep, _len - _pos));
+        if (!end) {
+            end = _data + _len;
+        }
+        _pos = end - _data + (end < _data + _len ? 1 : 0);
+        const char* eq = static_cast<const char*>(memchr(begin, _format.kv_sep, end - begin));
+        if (!eq || eq == begin) {
+            continue;
+        }
+        e.name = begin;
+        e.nlen = static_cast<uint32_t>(eq - begin);
+        e.value.type = RawValue::TEXT;
+        e.value.data = eq + 1;
+        e.value.len = static_cast<uint32_t>(end - eq - 1);
+        return true;
+    }
+    return false;
+}
+
+bool RequestBuffer::nextTlv(Entry& e)
+{
+    if (_pos >= _len || _corrupted) {
+        return false;
+    }
+    size_t remain = _len - _pos;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(_data + _pos);
+    size_t nlen = p[0];
+    if (remain < 1 + nlen + 1 + sizeof(uint16_t)) {
+        _corrupted = true;
+        return false;
+    }
+    uint16_t vlen = 0;
+    memcpy(&vlen, p + 1 + nlen + 1, sizeof(vlen));
+    size_t total = 1 + nlen + 1 + sizeof(uint16_t) + vlen;
+    uint8_t type = p[1 + nlen];
+    bool ok = total <= remain;
+    if (type == RawValue::INT32 || type == RawValue::UINT32) {
+        ok = ok && vlen == sizeof(int32_t);
+    } else if (type == RawValue::DOUBLE) {
+        ok = ok && vlen == sizeof(double);
+    } else if (type == RawValue::VERSION) {
+        ok = ok && vlen == sizeof(uint64_t);
+    } else if (type == RawValue::IP) {
+        ok = ok && vlen == sizeof(IpAddr);
+    } else if (type != RawValue::STRING) {
+        ok = false;
+    }
+    if (!ok) {
+        _corrupted = true;
+        return false;
+    }
+    e.name = _data + _pos + 1;
+    e.nlen = static_cast<uint32_t>(nlen);
+    e.value.type = type;
+    e.value.data = _data + _pos + total - vlen;
+    e.value.len = vlen;
+    _pos += total;
+    return true;
+}
+
+} //end namespace route
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace route {
+
+/**
+ * @brief 请求缓冲区的格式描述
+ *
+ * QUERY_STRING: "V=1208&P=1&E=abtest", 分隔符可配置, 值按原文比较 (不做 %xx 解码)
+ * TLV         : 重复的 uint8 name_len | name | uint8 type | uint16 value_len | value,
+ *               type 取值同 proto::ValueType, 数值为主机序
+ */
+struct BufferFormat {
+    enum Kind { QUERY_STRING, TLV };
+    Kind kind;
+    char pair_sep;
+    char kv_sep;
+
+    static BufferFormat QueryString(char pair_sep = '&', char kv_sep = '=')
+    {
+        return BufferFormat{QUERY_STRING, pair_sep, kv_sep};
+    }
+
+    static BufferFormat Tlv()
+    {
+        return BufferFormat{TLV, 0, 0};
+    }
+};
+
+// 指向缓冲区内部的属性值, 不拥有内存
+struct RawValue {
+    enum Type : uint8_t { TEXT = 0, INT32 = 1, UINT32 = 2, DOUBLE = 3, STRING = 4, VERSION = 5, IP = 6 };
+    uint8_t type;
+    const char* data;
+    uint32_t len;
+};
+
+/**
+ * @brief 序列化请求的惰性视图
+ *
+ * 只在表达式查询某个属性时才向后扫描, 扫描过的属性偏移会缓存下来,
+ * 同一个 RequestBuffer 可以被多个表达式共享, 整个缓冲区最多扫描一遍.
+ * 同名属性以第一次出现的为准. 缓冲区需在 RequestBuffer 的生命周期内保持有效.
+ */
+class RequestBuffer {
+public:
+    RequestBuffer(const char* data, size_t len, const BufferFormat& format);
+
+    // 重新绑定到新的缓冲区, 复用缓存的内存
+    void reset(const char* data, size_t len);
+
+    bool find(const char* name, size_t nlen, RawValue& value);
+
+    bool find(const std::string& name, RawValue& value)
+    {
+        return find(name.data(), name.size(), value);
+    }
+
+    // TLV 格式出错时为 true, 已解析出的属性仍然可用
+    bool corrupted() const { return _corrupted; }
+
+private:
+    struct Entry {
+        const char* name;
+        uint32_t nlen;
+        RawValue value;
+    };
+
+    bool next(Entry& e);
+    bool nextQuery(Entry& e);
+    bool nextTlv(Entry& e);
+
+private:
+    const char* _data;
+    size_t _len;
+    size_t _pos;
+    BufferFormat _format;
+    bool _corrupted;
+    std::vector<Entry> _entries;
+}; // RequestBuffer
+
+} // end namespace route
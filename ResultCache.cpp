@@ -0,0 +1,140 @@
+#include "ResultCache.h"
+#include "CoarseClock.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace route {
+
+static inline uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hashBytes(const char* data, size_t len)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof(w));
+        h = mix(h ^ w);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, len - i);
+    return mix(h ^ tail);
+}
+
+uint64_t ProjectionKey(const std::vector<std::string>& attrs,
+                       const std::map<std::string, Variant>& values,
+                       const std::vector<IChecker*>& windows,
+                       std::string& key)
+{
+    key.clear();
+    for (const auto& name : attrs) {
+        if (name == "@TIME") {
+            // 按秒区分会让每条带 TIME 的 key 每秒换一个, 只区分各窗口是否生效
+            key.push_back('@');
+            for (IChecker* p : windows) {
+                key.push_back(p->IsValidNow() ? '1' : '0');
+            }
+            continue;
+        }
+        if (name[0] == '@') {
+            long long ll = name == "@HOUR" ? CoarseClock::hour() : CoarseClock::wday();
+            key.push_back('@');
+            key.append(reinterpret_cast<const char*>(&ll), sizeof(ll));
+            continue;
+        }
+        auto it = values.find(name);
+        if (it == values.end()) {
+            key.push_back(static_cast<char>(Invalid));
+            continue;
+        }
+        const Variant& v = it->second;
+        key.push_back(static_cast<char>(v.type()));
+        if (v.isString()) {
+            const std::string& s = v.asConstString();
+            uint32_t len = static_cast<uint32_t>(s.size());
+            key.append(reinterpret_cast<const char*>(&len), sizeof(len));
+            key.append(s);
+        } else if (v.isIp()) {
+            IpAddr addr = v.asConstIp();
+            key.append(reinterpret_cast<const char*>(&addr), sizeof(addr));
+        } else if (v.isFloat() || v.isDouble()) {
+            double d = v.asConstDouble();
+            key.append(reinterpret_cast<const char*>(&d), sizeof(d));
+        } else {
+            long long ll = v.asConstLongLong();
+            key.append(reinterpret_cast<const char*>(&ll), sizeof(ll));
+        }
+    }
+    return hashBytes(key.data(), key.size());
+}
+
+void CollectWindows(const TreeNode* tree, std::vector<IChecker*>& windows)
+{
+    TreeNode::visit(tree, [&windows](const TreeNode* t) {
+      if (t->type == CLOCK && t->name == "TIME") {
+          windows.push_back(t->p);
+      }
+      return true;
+    });
+}
+
+ExpressionCache::ExpressionCache(ASTExp* exp, size_t capacity, size_t shards):
+_exp(exp),
+_cache(capacity, shards)
+{
+    CollectWindows(_exp->tree(), _windows);
+}
+
+bool ExpressionCache::evaluate(const std::map<std::string, Variant>& values)
+{
+    // 含 COUNT 或外部名单叶子时结果随计数或名单内容变化, 不经过缓存
+    if (_exp->isVolatile()) {
+        return _exp->evaluate(values);
+    }
+    thread_local std::string key;
+    uint64_t hash = ProjectionKey(_exp->attributes(), values, _windows, key);
+    bool result = false;
+    if (_cache.get(key, hash, result)) {
+        return result;
+    }
+    result = _exp->evaluate(values);
+    _cache.put(key, hash, result);
+    return result;
+}
+
+RuleSetCache::RuleSetCache(const RuleSet* rules, size_t capacity, size_t shards):
+_rules(rules),
+_cache(capacity, shards)
+{
+    for (size_t i = 0; i < _rules->size(); ++i) {
+        CollectWindows(_rules->rule(i).exp->tree(), _windows);
+    }
+}
+
+size_t RuleSetCache::evaluate(const std::map<std::string, Variant>& values, std::vector<uint32_t>& matched)
+{
+    thread_local std::string key;
+    thread_local std::vector<uint32_t> ids;
+    if (_rules->isVolatile()) {
+        return _rules->evaluate(values, matched);
+    }
+    uint64_t hash = ProjectionKey(_rules->attributes(), values, _windows, key);
+    if (!_cache.get(key, hash, ids)) {
+        ids.clear();
+        _rules->evaluate(values, ids);
+        _cache.put(key, hash, ids);
+    }
+    matched.insert(matched.end(), ids.begin(), ids.end());
+    return ids.size();
+}
+
+} //end namespace route
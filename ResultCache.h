@@ -0,0 +1,196 @@
+#pragma once
+
+#include "xExpression.h"
+#include "RuleSet.h"
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace route {
+
+/**
+ * @brief 分片的定长结果缓存, CLOCK 淘汰
+ *
+ * key 为表达式引用属性值的投影 (见 ProjectionKey), 按 hash 选择分片,
+ * 每个分片一把锁, 命中/未命中计数在分片锁内累加, 不引入额外的共享写.
+ */
+template<class V>
+class ResultCache {
+public:
+    /**
+    * @param capacity 总条目数上限, 均分到各分片
+    * @param shards 分片数, 向上取整为 2 的幂
+    */
+    ResultCache(size_t capacity, size_t shards = 16)
+    {
+        size_t n = 1;
+        while (n < shards) {
+            n <<= 1;
+        }
+        _mask = n - 1;
+        size_t per = (capacity + n - 1) / n;
+        if (per == 0) {
+            per = 1;
+        }
+        _shards = std::vector<Shard>(n);
+        for (auto& s : _shards) {
+            s.slots.resize(per);
+            s.index.reserve(per * 2);
+        }
+    }
+
+    bool get(const std::string& key, uint64_t hash, V& value)
+    {
+        Shard& s = _shards[hash & _mask];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.index.find(hash);
+        if (it != s.index.end()) {
+            Slot& slot = s.slots[it->second];
+            if (slot.key == key) {
+                slot.referenced = true;
+                value = slot.value;
+                ++s.hits;
+                return true;
+            }
+        }
+        ++s.misses;
+        return false;
+    }
+
+    void put(const std::string& key, uint64_t hash, const V& value)
+    {
+        Shard& s = _shards[hash & _mask];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.index.find(hash);
+        if (it != s.index.end()) {
+            Slot& slot = s.slots[it->second];
+            slot.key = key;
+            slot.value = value;
+            slot.referenced = true;
+            return;
+        }
+        // CLOCK: 跳过最近被访问过的槽位并清除其访问位
+        for (;;) {
+            Slot& slot = s.slots[s.hand];
+            if (slot.used && slot.referenced) {
+                slot.referenced = false;
+                s.hand = (s.hand + 1) % s.slots.size();
+                continue;
+            }
+            if (slot.used) {
+                s.index.erase(slot.hash);
+                ++s.evictions;
+            }
+            slot.used = true;
+            slot.referenced = false;
+            slot.hash = hash;
+            slot.key = key;
+            slot.value = value;
+            s.index[hash] = static_cast<uint32_t>(s.hand);
+            s.hand = (s.hand + 1) % s.slots.size();
+            return;
+        }
+    }
+
+    void clear()
+    {
+        for (auto& s : _shards) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            for (auto& slot : s.slots) {
+                slot = Slot();
+            }
+            s.index.clear();
+            s.hand = 0;
+        }
+    }
+
+    uint64_t hits() const { return sum(&Shard::hits); }
+    uint64_t misses() const { return sum(&Shard::misses); }
+    uint64_t evictions() const { return sum(&Shard::evictions); }
+
+private:
+    struct Slot {
+        bool used;
+        bool referenced;
+        uint64_t hash;
+        std::string key;
+        V value;
+        Slot(): used(false), referenced(false), hash(0), value() {}
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::vector<Slot> slots;
+        std::unordered_map<uint64_t, uint32_t> index;
+        size_t hand;
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        Shard(): hand(0), hits(0), misses(0), evictions(0) {}
+        Shard(const Shard&): Shard() {}
+    };
+
+    uint64_t sum(uint64_t Shard::*field) const
+    {
+        uint64_t n = 0;
+        for (auto& s : _shards) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            n += s.*field;
+        }
+        return n;
+    }
+
+private:
+    std::vector<Shard> _shards;
+    size_t _mask;
+}; // ResultCache
+
+/**
+ * @brief 把 attrs 对应的属性值序列化为缓存 key, 返回 key 的 hash
+ *
+ * 缺失的属性也参与编码, 因此 "缺失" 与任何取值都不相同.
+ * "@TIME" 编码为 windows 中各 TIME 叶子当前是否生效, 而不是当前时间, 窗口内外各只有一个 key;
+ * "@HOUR"/"@WDAY" 编码为当前的小时和星期.
+ */
+uint64_t ProjectionKey(const std::vector<std::string>& attrs,
+                       const std::map<std::string, Variant>& values,
+                       const std::vector<IChecker*>& windows,
+                       std::string& key);
+
+// 收集 tree 中的 TIME 叶子, 供 ProjectionKey 使用
+void CollectWindows(const TreeNode* tree, std::vector<IChecker*>& windows);
+
+// 带缓存的单个表达式求值, 不拥有 exp
+class ExpressionCache {
+public:
+    ExpressionCache(ASTExp* exp, size_t capacity, size_t shards = 16);
+
+    bool evaluate(const std::map<std::string, Variant>& values);
+
+    ResultCache<bool>& cache() { return _cache; }
+
+private:
+    ASTExp* _exp;
+    std::vector<IChecker*> _windows;
+    ResultCache<bool> _cache;
+}; // ExpressionCache
+
+// 带缓存的规则集求值, 缓存命中的规则 id 列表, 不拥有 rules
+class RuleSetCache {
+public:
+    RuleSetCache(const RuleSet* rules, size_t capacity, size_t shards = 16);
+
+    size_t evaluate(const std::map<std::string, Variant>& values, std::vector<uint32_t>& matched);
+
+    ResultCache<std::vector<uint32_t>>& cache() { return _cache; }
+
+private:
+    const RuleSet* _rules;
+    std::vector<IChecker*> _windows;
+    ResultCache<std::vector<uint32_t>> _cache;
+}; // RuleSetCache
+
+} // end namespace route
@@ -0,0 +1,376 @@
+#include "RuleSet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+
+#include "CoarseClock.h"
+
+namespace route {
+
+RuleSet::RuleSet()
+{
+}
+
+RuleSet::~RuleSet()
+{
+    clear();
+}
+
+void RuleSet::clear()
+{
+    for (auto& r : _rules) {
+        SAFE_RELEASE(r.exp);
+    }
+    _rules.clear();
+    _prefixes.clear();
+    _attrs.clear();
+    _volatile = false;
+}
+
+bool readRuleFile(const std::string& path, std::vector<RuleText>& rules)
+{
+    std::ifstream in(path.c_str());
+    if (!in) {
+        fprintf(stderr, "open rule file failed: %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    size_t lineno = 0;
+    while (std::getline(in, line)) {
+        ++lineno;
+        size_t b = line.find_first_not_of(" \t\r");
+        if (b == std::string::npos || line[b] == '#') {
+            continue;
+        }
+        size_t e = line.find_first_of(" \t", b);
+        if (e == std::string::npos) {
+            fprintf(stderr, "%s:%zu: missing expression\n", path.c_str(), lineno);
+            return false;
+        }
+        char* end = nullptr;
+        unsigned long id = strtoul(line.c_str() + b, &end, 10);
+        long priority = 0;
+        if (*end == ':') {
+            char* p = end + 1;
+            priority = strtol(p, &end, 10);
+            if (end == p || priority < INT32_MIN || priority > INT32_MAX) {
+                end = nullptr;
+            }
+        }
+        if (end != line.c_str() + e || id > UINT32_MAX) {
+            fprintf(stderr, "%s:%zu: invalid rule id\n", path.c_str(), lineno);
+            return false;
+        }
+        std::string exp;
+        size_t s = line.find_first_not_of(" \t", e);
+        if (s != std::string::npos) {
+            exp = line.substr(s);
+        }
+        while (!exp.empty() && (exp.back() == '\r' || exp.back() == ' ')) {
+            exp.pop_back();
+        }
+        rules.push_back(RuleText{static_cast<uint32_t>(id), static_cast<int32_t>(priority), exp, lineno});
+    }
+    return true;
+}
+
+bool RuleSet::load(const std::string& path, std::vector<std::string>* report)
+{
+    std::vector<RuleText> texts;
+    if (!readRuleFile(path, texts)) {
+        return false;
+    }
+    clear();
+    _path = path;
+    for (const auto& t : texts) {
+        if (!add(t.id, t.exp, report, t.priority)) {
+            fprintf(stderr, "%s:%zu: compile failed: %s\n", path.c_str(), t.line, t.exp.c_str());
+            clear();
+            return false;
+        }
+    }
+    indexPrefixes();
+    return true;
+}
+
+bool RuleSet::assign(const RuleSet& master)
+{
+    clear();
+    _path = master._path;
+    _rules.reserve(master._rules.size());
+    for (const auto& r : master._rules) {
+        if (!add(r.id, r.exp->getExp(), nullptr, r.priority)) {
+            clear();
+            return false;
+        }
+    }
+    indexPrefixes();
+    return true;
+}
+
+bool RuleSet::compile(uint32_t id, const std::string& exp, int32_t priority, ConstantPools& pools,
+                      Rule& out, std::vector<std::string>* report)
+{
+    if (exp.empty()) {
+        return false;
+    }
+    Rule r;
+    r.id = id;
+    r.priority = priority;
+    r.exp = XExpression::compile(exp);
+    if (!r.exp) {
+        return false;
+    }
+    std::vector<std::string> notes;
+    r.exp->optimize(report ? &notes : nullptr);
+    for (const auto& n : notes) {
+        report->push_back("rule " + std::to_string(id) + ": " + n);
+    }
+    r.exp->intern(pools);
+    r.exp->activeWindow(r.active_from, r.active_until);
+    out = r;
+    return true;
+}
+
+bool RuleSet::add(uint32_t id, const std::string& exp, std::vector<std::string>* report, int32_t priority)
+{
+    Rule r;
+    if (!compile(id, exp, priority, _pools, r, report)) {
+        return false;
+    }
+    auto pos = std::upper_bound(_rules.begin(), _rules.end(), r,
+                                [](const Rule& a, const Rule& b) { return a.priority > b.priority; });
+    _rules.insert(pos, r);
+    std::vector<std::string> merged;
+    std::set_union(_attrs.begin(), _attrs.end(),
+                   r.exp->attributes().begin(), r.exp->attributes().end(),
+                   std::back_inserter(merged));
+    _attrs.swap(merged);
+    _volatile = _volatile || r.exp->isVolatile();
+    return true;
+}
+
+static void collectCidr(const TreeNode* t, std::map<std::string, std::vector<CidrChecker*>>& leaves)
+{
+    TreeNode::visit(t, [&leaves](const TreeNode* n) {
+        CidrChecker* c = n->type == NUM ? dynamic_cast<CidrChecker*>(n->p) : nullptr;
+        if (c) {
+            leaves[n->name].push_back(c);
+        }
+        return true;
+    });
+}
+
+void RuleSet::indexPrefixes()
+{
+    std::map<std::string, std::vector<CidrChecker*>> leaves;
+    for (const auto& r : _rules) {
+        collectCidr(r.exp->tree(), leaves);
+    }
+    std::map<std::string, std::unique_ptr<PrefixIndex>> indexes;
+    for (const auto& kv : leaves) {
+        std::vector<PrefixTrie::Entry> entries;
+        for (size_t i = 0; i < kv.second.size(); ++i) {
+            for (const auto& p : kv.second[i]->Prefixes()) {
+                entries.push_back(PrefixTrie::Entry{p, static_cast<uint32_t>(i)});
+            }
+        }
+        std::unique_ptr<PrefixIndex> index(new PrefixIndex(entries));
+        for (size_t i = 0; i < kv.second.size(); ++i) {
+            kv.second[i]->Attach(index.get(), static_cast<uint32_t>(i));
+        }
+        indexes.emplace(kv.first, std::move(index));
+    }
+    // 叶子已指向新索引, 旧索引可以释放
+    _prefixes.swap(indexes);
+}
+
+PoolStats RuleSet::memoryStats() const
+{
+    PoolStats s = _pools.stats();
+    for (const auto& r : _rules) {
+        r.exp->footprint(s);
+    }
+    return s;
+}
+
+size_t RuleSet::evaluate(const std::map<std::string, Variant>& values, std::vector<uint32_t>& matched) const
+{
+    size_t n = 0;
+    int64_t now = CoarseClock::now();
+    for (const auto& r : _rules) {
+        if (r.active(now) && r.exp->evaluate(values)) {
+            matched.push_back(r.id);
+            ++n;
+        }
+    }
+    return n;
+}
+
+size_t RuleSet::evaluate(RequestBuffer& buffer, std::vector<uint32_t>& matched) const
+{
+    size_t n = 0;
+    int64_t now = CoarseClock::now();
+    for (const auto& r : _rules) {
+        if (r.active(now) && r.exp->evaluate(buffer)) {
+            matched.push_back(r.id);
+            ++n;
+        }
+    }
+    return n;
+}
+
+size_t RuleSet::evaluate(LazyAttributes& attrs, std::vector<uint32_t>& matched) const
+{
+    size_t n = 0;
+    int64_t now = CoarseClock::now();
+    for (const auto& r : _rules) {
+        if (r.active(now) && r.exp->evaluate(attrs)) {
+            matched.push_back(r.id);
+            ++n;
+        }
+    }
+    return n;
+}
+
+size_t RuleSet::evaluate(const Record& record, std::vector<uint32_t>& matched) const
+{
+    size_t n = 0;
+    int64_t now = CoarseClock::now();
+    for (const auto& r : _rules) {
+        if (r.active(now) && r.exp->evaluate(record)) {
+            matched.push_back(r.id);
+            ++n;
+        }
+    }
+    return n;
+}
+
+size_t RuleSet::evaluateBound(const char* obj, const FieldBinding& binding, std::vector<uint32_t>& matched) const
+{
+    size_t n = 0;
+    int64_t now = CoarseClock::now();
+    for (const auto& r : _rules) {
+        if (r.active(now) && r.exp->evaluateBound(obj, binding)) {
+            matched.push_back(r.id);
+            ++n;
+        }
+    }
+    return n;
+}
+
+// 预取距离 (规则数): 先预取 ASTExp 本身, 再预取它的节点和常量
+static const size_t kPrefetchAhead = 4;
+
+template<class Request>
+size_t RuleSet::evaluateBatch(Request* const* requests, size_t n, std::vector<uint32_t>* matched) const
+{
+    size_t hits = 0;
+    int64_t now = CoarseClock::now();
+    for (size_t i = 0; i < _rules.size(); ++i) {
+        if (i + 2 * kPrefetchAhead < _rules.size()) {
+            __builtin_prefetch(_rules[i + 2 * kPrefetchAhead].exp);
+        }
+        if (i + kPrefetchAhead < _rules.size()) {
+            _rules[i + kPrefetchAhead].exp->prefetch();
+        }
+        const Rule& r = _rules[i];
+        if (!r.active(now)) {
+            continue;
+        }
+        for (size_t j = 0; j < n; ++j) {
+            if (r.exp->evaluate(*requests[j])) {
+                matched[j].push_back(r.id);
+                ++hits;
+            }
+        }
+    }
+    return hits;
+}
+
+size_t RuleSet::evaluate(RequestBuffer* const* buffers, size_t n, std::vector<uint32_t>* matched) const
+{
+    return evaluateBatch(buffers, n, matched);
+}
+
+size_t RuleSet::evaluate(const std::map<std::string, Variant>* const* values, size_t n,
+                         std::vector<uint32_t>* matched) const
+{
+    return evaluateBatch(values, n, matched);
+}
+
+// 每求值这么多个节点读一次时钟
+static const uint64_t kClockCheckNodes = 256;
+
+template<class Request>
+BudgetResult RuleSet::evaluateBudget(Request& request, const EvalBudget& budget,
+                                     std::vector<uint32_t>& matched) const
+{
+    _budget_evals.fetch_add(1, std::memory_order_relaxed);
+    BudgetResult res = {true, _rules.size(), 0};
+    // 只有设置了时间预算才读时钟
+    std::chrono::steady_clock::time_point deadline;
+    if (budget.micros) {
+        deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget.micros);
+    }
+    uint64_t next_check = kClockCheckNodes;
+    int64_t now = CoarseClock::now();
+    for (size_t i = 0; i < _rules.size(); ++i) {
+        const Rule& r = _rules[i];
+        uint64_t cost = r.exp->size();
+        if (budget.nodes && res.nodes + cost > budget.nodes) {
+            _node_exhausted.fetch_add(1, std::memory_order_relaxed);
+            res.complete = false;
+            res.next = i;
+            return res;
+        }
+        if (budget.micros && res.nodes >= next_check) {
+            next_check = res.nodes + kClockCheckNodes;
+            if (std::chrono::steady_clock::now() >= deadline) {
+                _time_exhausted.fetch_add(1, std::memory_order_relaxed);
+                res.complete = false;
+                res.next = i;
+                return res;
+            }
+        }
+        if (!r.active(now)) {
+            continue;
+        }
+        res.nodes += cost;
+        if (r.exp->evaluate(request)) {
+            matched.push_back(r.id);
+        }
+    }
+    return res;
+}
+
+BudgetResult RuleSet::evaluate(RequestBuffer& buffer, const EvalBudget& budget, std::vector<uint32_t>& matched) const
+{
+    return evaluateBudget(buffer, budget, matched);
+}
+
+BudgetResult RuleSet::evaluate(const std::map<std::string, Variant>& values, const EvalBudget& budget,
+                               std::vector<uint32_t>& matched) const
+{
+    return evaluateBudget(values, budget, matched);
+}
+
+BudgetResult RuleSet::evaluate(LazyAttributes& attrs, const EvalBudget& budget, std::vector<uint32_t>& matched) const
+{
+    return evaluateBudget(attrs, budget, matched);
+}
+
+BudgetStats RuleSet::budgetStats() const
+{
+    BudgetStats s;
+    s.evaluations = _budget_evals.load(std::memory_order_relaxed);
+    s.node_exhausted = _node_exhausted.load(std::memory_order_relaxed);
+    s.time_exhausted = _time_exhausted.load(std::memory_order_relaxed);
+    return s;
+}
+
+} //end namespace route
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "xExpression.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <limits>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+namespace route {
+
+struct Rule {
+    uint32_t id;
+    ASTExp* exp;
+    // 越大越先求值, 相同时按加入顺序
+    int32_t priority;
+    // 顶层 TIME 区间给出的生效时间 [active_from, active_until), 之外不必求值
+    int64_t active_from;
+    int64_t active_until;
+    Rule(): id(0), exp(nullptr), priority(0),
+            active_from(std::numeric_limits<int64_t>::min()),
+            active_until(std::numeric_limits<int64_t>::max()) {}
+
+    bool active(int64_t now) const
+    {
+        return active_from <= now && now < active_until;
+    }
+};
+
+// 规则文件中的一行
+struct RuleText {
+    uint32_t id;
+    int32_t priority;
+    std::string exp;
+    size_t line;
+};
+
+/**
+* @brief 读取规则文件: 每行 "<id>[:<priority>] <expression>", 空行和以 '#' 开头的行忽略
+*
+* @return false 文件无法打开或格式错误, 已输出错误
+*/
+bool readRuleFile(const std::string& path, std::vector<RuleText>& rules);
+
+/**
+ * @brief 有预算的求值的上限, 0 表示不限
+ *
+ * nodes 按已求值规则的表达式树节点数计. 时间在规则之间检查, 每累计求值 256 个节点 (kClockCheckNodes)
+ * 读一次时钟, 因此可能超出约 256 个节点加一条规则的耗时.
+ */
+struct EvalBudget {
+    uint64_t nodes;
+    uint64_t micros;
+    EvalBudget(uint64_t n = 0, uint64_t us = 0): nodes(n), micros(us) {}
+};
+
+struct BudgetResult {
+    // false 表示预算耗尽, 只求值了 [0, next) 的规则
+    bool complete;
+    size_t next;
+    uint64_t nodes;
+};
+
+struct BudgetStats {
+    uint64_t evaluations;
+    uint64_t node_exhausted;
+    uint64_t time_exhausted;
+};
+
+/**
+ * @brief 一组编译好的规则
+ *
+ * 规则文件每行一条规则: "<id>[:<priority>] <expression>", 空行和以 '#' 开头的行忽略.
+ * 规则按优先级从高到低存放和求值, 优先级相同时保持文件中的顺序.
+ * 所有规则的常量 (集合/区间端点) 放在同一个常量池里, 相同的列表只保存一份.
+ */
+class RuleSet {
+public:
+    RuleSet();
+    ~RuleSet();
+    RuleSet(const RuleSet&) = delete;
+    RuleSet& operator=(const RuleSet&) = delete;
+
+    /**
+    * @brief 加载规则文件, 任意一条规则编译失败则整体失败
+    *
+    * @param report 非空时追加每条规则的化简说明
+    *
+    * @return true success
+    */
+    bool load(const std::string& path, std::vector<std::string>* report = nullptr);
+
+    // 按 master 的规则文本重新编译一份, 新副本的内存由调用线程分配
+    bool assign(const RuleSet& master);
+
+    // 编译并化简表达式, 按优先级插入; 含 CIDR 叶子时之后需调用 indexPrefixes
+    bool add(uint32_t id, const std::string& exp, std::vector<std::string>* report = nullptr,
+             int32_t priority = 0);
+
+    // 编译, 化简并把常量放入 pools, 填好 out 的生效时间; 失败返回 false
+    static bool compile(uint32_t id, const std::string& exp, int32_t priority, ConstantPools& pools,
+                        Rule& out, std::vector<std::string>* report = nullptr);
+
+    /**
+    * @brief 依次求值所有规则, 命中的规则 id 追加到 matched
+    *
+    * 不在生效时间内的规则直接跳过
+    * @return 命中的规则数
+    */
+    size_t evaluate(const std::map<std::string, Variant>& values, std::vector<uint32_t>& matched) const;
+
+    // 所有规则共享 buffer 的扫描结果
+    size_t evaluate(RequestBuffer& buffer, std::vector<uint32_t>& matched) const;
+
+    // 所有规则共享 attrs 中已计算的属性, 每个属性最多计算一次
+    size_t evaluate(LazyAttributes& attrs, std::vector<uint32_t>& matched) const;
+
+    // 属性从按 Schema 填充的嵌套记录中取值
+    size_t evaluate(const Record& record, std::vector<uint32_t>& matched) const;
+
+    // 属性直接从结构体成员取值, 见 Binding
+    template<class T>
+    size_t evaluate(const T& obj, const Binding<T>& binding, std::vector<uint32_t>& matched) const
+    {
+        return evaluateBound(reinterpret_cast<const char*>(&obj), binding, matched);
+    }
+
+    /**
+    * @brief 批量求值 n 个请求, 第 j 个请求命中的规则 id 追加到 matched[j]
+    *
+    * 按规则依次处理整批请求, 每条规则的节点和常量只从内存取一次,
+    * 同时预取后面几条规则, 规则集远大于缓存时比逐个请求求值快.
+    * 每个请求的命中顺序与 evaluate 相同.
+    *
+    * @return 所有请求的命中数之和
+    */
+    size_t evaluate(RequestBuffer* const* buffers, size_t n, std::vector<uint32_t>* matched) const;
+    size_t evaluate(const std::map<std::string, Variant>* const* values, size_t n,
+                    std::vector<uint32_t>* matched) const;
+
+    /**
+    * @brief 在预算内按优先级求值, 预算耗尽时停止
+    *
+    * 命中的规则 id 追加到 matched; 结果不完整时 next 为下一条未求值规则的下标 (同 rule(i)).
+    */
+    BudgetResult evaluate(RequestBuffer& buffer, const EvalBudget& budget, std::vector<uint32_t>& matched) const;
+    BudgetResult evaluate(const std::map<std::string, Variant>& values, const EvalBudget& budget,
+                          std::vector<uint32_t>& matched) const;
+    BudgetResult evaluate(LazyAttributes& attrs, const EvalBudget& budget, std::vector<uint32_t>& matched) const;
+
+    // 有预算的求值次数和因节点数/时间耗尽而提前结束的次数
+    BudgetStats budgetStats() const;
+
+    /**
+    * @brief 每个属性上所有 CIDR 叶子的前缀合成一棵前缀树, 叶子改用这棵树
+    *
+    * 一个请求在该属性上只查一次树. load/assign 结束时自动调用.
+    */
+    void indexPrefixes();
+
+    // 属性名 -> 共用前缀树
+    const std::map<std::string, std::unique_ptr<PrefixIndex>>& prefixIndexes() const { return _prefixes; }
+
+    // 所有规则引用到的属性名的并集, 排序去重
+    const std::vector<std::string>& attributes() const { return _attrs; }
+
+    // 任一规则 isVolatile() 时为 true
+    bool isVolatile() const { return _volatile; }
+
+    // 规则常量池和表达式树的内存统计
+    PoolStats memoryStats() const;
+
+    size_t size() const { return _rules.size(); }
+    const Rule& rule(size_t i) const { return _rules[i]; }
+    const std::string& path() const { return _path; }
+
+private:
+    void clear();
+
+    size_t evaluateBound(const char* obj, const FieldBinding& binding, std::vector<uint32_t>& matched) const;
+
+    template<class Request>
+    size_t evaluateBatch(Request* const* requests, size_t n, std::vector<uint32_t>* matched) const;
+
+    template<class Request>
+    BudgetResult evaluateBudget(Request& request, const EvalBudget& budget, std::vector<uint32_t>& matched) const;
+
+private:
+    // 先于规则构造, 后于规则析构
+    ConstantPools _pools;
+    std::vector<Rule> _rules;
+    std::map<std::string, std::unique_ptr<PrefixIndex>> _prefixes;
+    std::vector<std::string> _attrs;
+    bool _volatile = false;
+    std::string _path;
+    mutable std::atomic<uint64_t> _budget_evals{0};
+    mutable std::atomic<uint64_t> _node_exhausted{0};
+    mutable std::atomic<uint64_t> _time_exhausted{0};
+}; // RuleSet
+
+} // end namespace route
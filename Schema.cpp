@@ -0,0 +1,199 @@
+#include "Schema.h"
+#include "StringUtil.h"
+
+#include <stdio.h>
+#include <ctype.h>
+
+namespace route {
+
+struct Schema::Node {
+    struct Field {
+        FieldType type;
+        uint16_t slot;
+        uint32_t id;
+        // FIELD_RECORD 的子结构
+        std::unique_ptr<Node> child;
+        // 非 FIELD_RECORD 字段的完整位置, 供 resolve 返回
+        std::unique_ptr<FieldRef> ref;
+    };
+    std::map<std::string, Field, std::less<>> fields;
+};
+
+static bool validName(std::string_view name)
+{
+    if (name.empty()) {
+        return false;
+    }
+    for (char ch : name) {
+        if (!isalnum(static_cast<unsigned char>(ch)) && ch != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+Schema::Schema():
+_root(new Node()),
+_fields(0)
+{
+}
+
+Schema::~Schema()
+{
+}
+
+Schema& Schema::instance()
+{
+    static Schema schema;
+    return schema;
+}
+
+FieldRef Schema::define(std::string_view path, FieldType type)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<std::string_view> names;
+    for (std::string_view name : gsl::SplitView(path, '.')) {
+        names.push_back(name);
+    }
+    FieldRef ref;
+    if (type == FIELD_RECORD || names.empty() || names.size() > FieldRef::kMaxDepth) {
+        fprintf(stderr, "invalid field path: %.*s\n", static_cast<int>(path.size()), path.data());
+        return FieldRef();
+    }
+    Node* node = _root.get();
+    for (size_t i = 0; i < names.size(); ++i) {
+        bool last = i + 1 == names.size();
+        FieldType want = last ? type : FIELD_RECORD;
+        if (!validName(names[i]) || node->fields.size() >= UINT16_MAX) {
+            fprintf(stderr, "invalid field path: %.*s\n", static_cast<int>(path.size()), path.data());
+            return FieldRef();
+        }
+        auto it = node->fields.find(names[i]);
+        if (it == node->fields.end()) {
+            Node::Field f;
+            f.type = want;
+            f.slot = static_cast<uint16_t>(node->fields.size());
+            f.id = 0;
+            if (!last) {
+                f.child.reset(new Node());
+            } else {
+                f.id = static_cast<uint32_t>(_fields++);
+            }
+            it = node->fields.emplace(std::string(names[i]), std::move(f)).first;
+        } else if (it->second.type != want) {
+            fprintf(stderr, "field path conflicts with existing definition: %.*s\n",
+                    static_cast<int>(path.size()), path.data());
+            return FieldRef();
+        }
+        ref.slots[ref.depth++] = it->second.slot;
+        ref.id = it->second.id;
+        if (last && !it->second.ref) {
+            it->second.ref.reset(new FieldRef(ref));
+        }
+        node = it->second.child.get();
+    }
+    return ref;
+}
+
+bool Schema::lookup(std::string_view path, FieldRef& ref, FieldType& type) const
+{
+    const Node* node = _root.get();
+    for (std::string_view name : gsl::SplitView(path, '.')) {
+        if (!node || ref.depth >= FieldRef::kMaxDepth) {
+            return false;
+        }
+        auto it = node->fields.find(name);
+        if (it == node->fields.end()) {
+            return false;
+        }
+        ref.slots[ref.depth++] = it->second.slot;
+        ref.id = it->second.id;
+        type = it->second.type;
+        node = it->second.child.get();
+    }
+    return ref.valid() && type != FIELD_RECORD;
+}
+
+FieldRef Schema::find(std::string_view path, FieldType* type) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    FieldRef ref;
+    FieldType t = FIELD_RECORD;
+    if (!lookup(path, ref, t)) {
+        return FieldRef();
+    }
+    if (type) {
+        *type = t;
+    }
+    return ref;
+}
+
+const FieldRef* Schema::resolve(std::string_view path, FieldType* type) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const Node* node = _root.get();
+    const Node::Field* field = nullptr;
+    for (std::string_view name : gsl::SplitView(path, '.')) {
+        if (!node) {
+            return nullptr;
+        }
+        auto it = node->fields.find(name);
+        if (it == node->fields.end()) {
+            return nullptr;
+        }
+        field = &it->second;
+        node = field->child.get();
+    }
+    if (!field || !field->ref) {
+        return nullptr;
+    }
+    if (type) {
+        *type = field->type;
+    }
+    return field->ref.get();
+}
+
+size_t Schema::fields() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _fields;
+}
+
+void Record::set(const FieldRef& ref, const Variant& value)
+{
+    if (!ref.valid()) {
+        return;
+    }
+    Record* r = this;
+    for (uint8_t i = 0; i + 1 < ref.depth; ++i) {
+        uint16_t s = ref.slots[i];
+        if (s >= r->_children.size()) {
+            r->_children.resize(s + 1);
+        }
+        if (!r->_children[s]) {
+            r->_children[s].reset(new Record());
+        }
+        r = r->_children[s].get();
+    }
+    uint16_t s = ref.slots[ref.depth - 1];
+    if (s >= r->_values.size()) {
+        r->_values.resize(s + 1);
+    }
+    r->_values[s] = value;
+}
+
+void Record::clear()
+{
+    for (auto& v : _values) {
+        if (!v.isEmpty()) {
+            v = Variant();
+        }
+    }
+    for (auto& c : _children) {
+        if (c) {
+            c->clear();
+        }
+    }
+}
+
+} //end namespace route
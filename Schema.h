@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Variant.h"
+
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace route {
+
+enum FieldType {
+    FIELD_RECORD,
+    FIELD_INT,
+    // 超出 int32 的整数: int64_t 和 uint32_t/uint64_t 成员
+    FIELD_LONG,
+    FIELD_ULONG,
+    FIELD_DOUBLE,
+    FIELD_STRING,
+    FIELD_VERSION,
+    FIELD_IP,
+};
+
+/**
+ * @brief 嵌套字段的位置: 从根记录起每一层的槽位下标, 编译时解析, 求值时不再查名字
+ */
+struct FieldRef {
+    static constexpr size_t kMaxDepth = 8;
+    uint16_t slots[kMaxDepth];
+    uint8_t depth = 0;
+    // 字段按定义顺序的编号, 从 0 开始, 供 Binding 按下标查找
+    uint32_t id = 0;
+
+    bool valid() const { return depth > 0; }
+};
+
+/**
+ * @brief 嵌套属性的结构, 如 user.age, device.os.version
+ *
+ * 字段只能增加, 槽位一经分配不再改变, 因此已编译的表达式和已填充的记录在新增字段后仍然有效.
+ * 表达式中带点的属性名按全局的 instance() 解析, 叶子的比较方式由字段类型决定.
+ */
+class Schema {
+public:
+    Schema();
+    ~Schema();
+    Schema(const Schema&) = delete;
+    Schema& operator=(const Schema&) = delete;
+
+    // 表达式编译时使用的全局 schema
+    static Schema& instance();
+
+    /**
+    * @brief 定义一个字段, 中间各段自动定义为嵌套记录
+    *
+    * 已存在且类型相同时返回原来的位置; 与已有定义冲突, 路径不合法或超过 kMaxDepth 层时
+    * 输出错误并返回无效的 FieldRef
+    */
+    FieldRef define(std::string_view path, FieldType type);
+
+    // 查找已定义的字段, 不存在时返回无效的 FieldRef
+    FieldRef find(std::string_view path, FieldType* type = nullptr) const;
+
+    // 同 find, 返回 schema 中保存的 FieldRef, 地址在 schema 的生命周期内不变; 不存在时返回 nullptr
+    const FieldRef* resolve(std::string_view path, FieldType* type = nullptr) const;
+
+    // 已定义的字段数 (不含中间的嵌套记录), 即 FieldRef::id 的上界
+    size_t fields() const;
+
+private:
+    struct Node;
+
+    bool lookup(std::string_view path, FieldRef& ref, FieldType& type) const;
+
+private:
+    mutable std::mutex _mutex;
+    std::unique_ptr<Node> _root;
+    size_t _fields;
+}; // Schema
+
+/**
+ * @brief 按 Schema 填充的嵌套记录, 每个请求一个, 可用 clear() 复用
+ *
+ * 字段按 FieldRef 的槽位链存取, 不构造也不比较字符串. 未设置的字段视为缺失.
+ */
+class Record {
+public:
+    Record() = default;
+    Record(const Record&) = delete;
+    Record& operator=(const Record&) = delete;
+
+    // 设置字段, 按需创建中间的嵌套记录; ref 无效时忽略
+    void set(const FieldRef& ref, const Variant& value);
+
+    // 字段的值, 缺失时返回 nullptr
+    const Variant* find(const FieldRef& ref) const
+    {
+        if (ref.depth == 0) {
+            return nullptr;
+        }
+        const Record* r = this;
+        for (uint8_t i = 0; i + 1 < ref.depth; ++i) {
+            uint16_t s = ref.slots[i];
+            if (s >= r->_children.size() || !r->_children[s]) {
+                return nullptr;
+            }
+            r = r->_children[s].get();
+        }
+        uint16_t s = ref.slots[ref.depth - 1];
+        if (s >= r->_values.size() || r->_values[s].isEmpty()) {
+            return nullptr;
+        }
+        return &r->_values[s];
+    }
+
+    // 清空所有字段, 保留已分配的内存
+    void clear();
+
+private:
+    std::vector<Variant> _values;
+    std::vector<std::unique_ptr<Record>> _children;
+}; // Record
+
+} // end namespace route
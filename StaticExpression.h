@@ -0,0 +1,358 @@
+#pragma once
+
+#include <stddef.h>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace route {
+
+/**
+ * @brief 编译期解析的表达式, 适用于写死在代码里的规则
+ *
+ * 文法与 XExpression 相同 (NAME=区间/集合, 以 && || 从左到右连接, 无优先级),
+ * 在编译期解析为常量, 求值展开为对上下文字段的直接比较, 没有树遍历和虚函数调用.
+ * 表达式格式错误, 属性名不在上下文中, 数值属性使用了非数值常量, 都会导致编译失败.
+ *
+ * 上下文是任意类型, 需提供属性名列表和按下标取值:
+ *
+ *   struct Request {
+ *       int version, platform;
+ *       std::string_view exp;
+ *       static constexpr std::string_view names[] = {"V", "P", "E"};
+ *       template<size_t I> auto get() const { return std::get<I>(std::tie(version, platform, exp)); }
+ *       // 可选: 属性缺失时叶子为 false
+ *       template<size_t I> bool has() const { return I != 2 || !exp.empty(); }
+ *   };
+ *
+ *   ROUTE_STATIC_EXPRESSION(Gray, "V=(1206,1209] && P={1} && E={abtest}");
+ *   if (Gray::evaluate(req)) { ... }
+ *
+ * get<I>() 返回整数时按整数比较, 无符号属性的常量不能为负; 返回浮点数时按 double 比较, 常量可以是小数;
+ * 其他类型转换为 string_view 按字典序比较.
+ */
+namespace sx {
+
+constexpr size_t kMaxLeaves = 32;
+constexpr size_t kMaxValues = 128;
+
+struct Leaf {
+    std::string_view name;
+    // '(' '[' 为区间, '{' 为集合
+    char l_ch;
+    char r_ch;
+    // 所有常量都是数值
+    bool numeric;
+    // 所有常量都是整数, 且在 long long 或 unsigned long long 范围内
+    bool integral;
+    // 有负数常量
+    bool negative;
+    // 有超出 long long 的常量
+    bool wide;
+    size_t first;
+    size_t count;
+};
+
+struct Parsed {
+    bool ok = false;
+    // 出错的位置, 供 constexpr 调试
+    size_t error_pos = 0;
+    size_t leaves = 0;
+    Leaf leaf[kMaxLeaves] = {};
+    // ops[i] 连接前 i 个叶子的结果与第 i 个叶子, '&' 或 '|'
+    char ops[kMaxLeaves] = {};
+    size_t values = 0;
+    std::string_view text[kMaxValues] = {};
+    // 数值常量分别按有符号, 无符号整数和 double 存放, 比较时按属性类型选用
+    long long number[kMaxValues] = {};
+    unsigned long long unumber[kMaxValues] = {};
+    double real[kMaxValues] = {};
+};
+
+// 一个数值常量的解析结果
+struct Number {
+    bool integral = false;
+    bool negative = false;
+    bool wide = false;
+    long long i = 0;
+    unsigned long long u = 0;
+    double d = 0;
+};
+
+constexpr bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+constexpr bool IsNameChar(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+/**
+ * @brief 解析整数或小数常量
+ *
+ * 小数按全部数字组成的整数除以 10 的幂计算, 两者都能精确表示为 double 时结果与 strtod 相同,
+ * 因此有效数字不超过 15 位.
+ */
+constexpr bool ParseNumber(std::string_view s, Number& out)
+{
+    constexpr unsigned long long kMaxMagnitude = ~0ULL;
+    size_t i = 0;
+    out = Number();
+    if (i < s.size() && (s[i] == '-' || s[i] == '+')) {
+        out.negative = s[i] == '-';
+        ++i;
+    }
+    unsigned long long m = 0;
+    size_t digits = 0;
+    size_t scale = 0;
+    bool point = false;
+    bool overflow = false;
+    for (; i < s.size(); ++i) {
+        if (s[i] == '.' && !point) {
+            point = true;
+            continue;
+        }
+        if (s[i] < '0' || s[i] > '9') {
+            return false;
+        }
+        unsigned d = static_cast<unsigned>(s[i] - '0');
+        overflow = overflow || m > (kMaxMagnitude - d) / 10;
+        m = m * 10 + d;
+        ++digits;
+        scale += point;
+    }
+    if (digits == 0 || overflow) {
+        return false;
+    }
+    if (point && digits > 15) {
+        return false;
+    }
+    double p = 1;
+    for (size_t k = 0; k < scale; ++k) {
+        p *= 10;
+    }
+    out.d = static_cast<double>(m) / p;
+    out.d = out.negative ? -out.d : out.d;
+    out.integral = !point && (!out.negative || m <= (1ULL << 63));
+    out.negative = out.negative && m != 0;
+    out.wide = m > static_cast<unsigned long long>(~0ULL >> 1) && !out.negative;
+    out.u = out.negative ? 0 : m;
+    out.i = out.wide ? 0 : out.negative ? static_cast<long long>(0 - m) : static_cast<long long>(m);
+    return true;
+}
+
+constexpr Parsed Parse(std::string_view s)
+{
+    Parsed p;
+    size_t i = 0;
+    auto skip = [&]() {
+        while (i < s.size() && IsSpace(s[i])) {
+            ++i;
+        }
+    };
+    auto fail = [&]() {
+        p.ok = false;
+        p.error_pos = i;
+        return p;
+    };
+    for (;;) {
+        if (p.leaves == kMaxLeaves) {
+            return fail();
+        }
+        Leaf& leaf = p.leaf[p.leaves];
+        skip();
+        size_t b = i;
+        while (i < s.size() && IsNameChar(s[i])) {
+            ++i;
+        }
+        if (i == b) {
+            return fail();
+        }
+        leaf.name = s.substr(b, i - b);
+        skip();
+        if (i == s.size() || s[i] != '=') {
+            return fail();
+        }
+        ++i;
+        skip();
+        if (i == s.size() || (s[i] != '(' && s[i] != '[' && s[i] != '{')) {
+            return fail();
+        }
+        leaf.l_ch = s[i++];
+        leaf.first = p.values;
+        leaf.numeric = true;
+        leaf.integral = true;
+        leaf.negative = false;
+        leaf.wide = false;
+        for (;;) {
+            skip();
+            b = i;
+            while (i < s.size() && s[i] != ',' && s[i] != ')' && s[i] != ']' && s[i] != '}' &&
+                   !IsSpace(s[i])) {
+                ++i;
+            }
+            if (i == b || p.values == kMaxValues) {
+                return fail();
+            }
+            std::string_view v = s.substr(b, i - b);
+            p.text[p.values] = v;
+            Number n;
+            bool numeric = ParseNumber(v, n);
+            leaf.numeric = leaf.numeric && numeric;
+            leaf.integral = leaf.integral && numeric && n.integral;
+            leaf.negative = leaf.negative || n.negative;
+            leaf.wide = leaf.wide || n.wide;
+            p.number[p.values] = n.i;
+            p.unumber[p.values] = n.u;
+            p.real[p.values] = n.d;
+            ++p.values;
+            skip();
+            if (i == s.size()) {
+                return fail();
+            }
+            if (s[i] != ',') {
+                break;
+            }
+            ++i;
+        }
+        leaf.r_ch = s[i++];
+        leaf.count = p.values - leaf.first;
+        bool closed = leaf.l_ch == '{' ? leaf.r_ch == '}'
+                                       : (leaf.r_ch == ')' || leaf.r_ch == ']') && leaf.count == 2;
+        if (!closed) {
+            return fail();
+        }
+        ++p.leaves;
+        skip();
+        if (i == s.size()) {
+            break;
+        }
+        if (i + 1 >= s.size() || (s[i] != '&' && s[i] != '|') || s[i + 1] != s[i]) {
+            return fail();
+        }
+        if (p.leaves == kMaxLeaves) {
+            return fail();
+        }
+        p.ops[p.leaves] = s[i];
+        i += 2;
+    }
+    p.ok = true;
+    return p;
+}
+
+template<class Ctx>
+constexpr size_t IndexOf(std::string_view name)
+{
+    size_t n = sizeof(Ctx::names) / sizeof(Ctx::names[0]);
+    for (size_t i = 0; i < n; ++i) {
+        if (Ctx::names[i] == name) {
+            return i;
+        }
+    }
+    return n;
+}
+
+template<class Ctx, size_t I, class = void>
+struct HasAttr {
+    static constexpr bool check(const Ctx&) { return true; }
+};
+
+template<class Ctx, size_t I>
+struct HasAttr<Ctx, I, std::void_t<decltype(std::declval<const Ctx&>().template has<I>())>> {
+    static constexpr bool check(const Ctx& c) { return c.template has<I>(); }
+};
+
+} // end namespace sx
+
+template<class Source>
+class StaticExpression {
+public:
+    static constexpr sx::Parsed P = sx::Parse(Source::value());
+    static_assert(P.ok, "malformed static expression");
+
+    template<class Ctx>
+    static constexpr bool evaluate(const Ctx& ctx)
+    {
+        return fold<1>(ctx, leaf<0>(ctx));
+    }
+
+    template<class Ctx>
+    constexpr bool operator()(const Ctx& ctx) const
+    {
+        return evaluate(ctx);
+    }
+
+    static constexpr std::string_view text() { return Source::value(); }
+
+private:
+    template<size_t I, class Ctx>
+    static constexpr bool fold(const Ctx& ctx, bool acc)
+    {
+        if constexpr (I == P.leaves) {
+            return acc;
+        } else if constexpr (P.ops[I] == '&') {
+            return fold<I + 1>(ctx, acc && leaf<I>(ctx));
+        } else {
+            return fold<I + 1>(ctx, acc || leaf<I>(ctx));
+        }
+    }
+
+    template<size_t I, class Ctx>
+    static constexpr bool leaf(const Ctx& ctx)
+    {
+        constexpr sx::Leaf L = P.leaf[I];
+        constexpr size_t A = sx::IndexOf<Ctx>(L.name);
+        static_assert(A < sizeof(Ctx::names) / sizeof(Ctx::names[0]), "unknown attribute in static expression");
+        if (!sx::HasAttr<Ctx, A>::check(ctx)) {
+            return false;
+        }
+        auto v = ctx.template get<A>();
+        using V = std::decay_t<decltype(v)>;
+        if constexpr (std::is_floating_point<V>::value) {
+            static_assert(L.numeric, "non-numeric constant for a numeric attribute in static expression");
+            return match<I>(static_cast<double>(v), P.real);
+        } else if constexpr (std::is_unsigned<V>::value) {
+            static_assert(L.numeric, "non-numeric constant for a numeric attribute in static expression");
+            static_assert(L.integral, "decimal constant for an integer attribute in static expression");
+            static_assert(!L.negative, "negative constant for an unsigned attribute in static expression");
+            return match<I>(static_cast<unsigned long long>(v), P.unumber);
+        } else if constexpr (std::is_integral<V>::value) {
+            static_assert(L.numeric, "non-numeric constant for a numeric attribute in static expression");
+            static_assert(L.integral, "decimal constant for an integer attribute in static expression");
+            static_assert(!L.wide, "constant out of range for a signed attribute in static expression");
+            return match<I>(static_cast<long long>(v), P.number);
+        } else {
+            return match<I>(std::string_view(v), P.text);
+        }
+    }
+
+    template<size_t I, class V, class C>
+    static constexpr bool match(const V& v, const C& values)
+    {
+        constexpr sx::Leaf L = P.leaf[I];
+        if constexpr (L.l_ch == '{') {
+            return inSet<I>(v, values, std::make_index_sequence<L.count>());
+        } else {
+            constexpr size_t lo = L.first;
+            constexpr size_t hi = L.first + 1;
+            bool left = L.l_ch == '(' ? values[lo] < v : values[lo] <= v;
+            bool right = L.r_ch == ')' ? v < values[hi] : v <= values[hi];
+            return left && right;
+        }
+    }
+
+    template<size_t I, class V, class C, size_t... J>
+    static constexpr bool inSet(const V& v, const C& values, std::index_sequence<J...>)
+    {
+        return ((v == values[P.leaf[I].first + J]) || ...);
+    }
+}; // StaticExpression
+
+} // end namespace route
+
+// 在当前作用域定义名为 name 的 StaticExpression 类型
+#define ROUTE_STATIC_EXPRESSION(name, str) \
+    struct name##_source { static constexpr std::string_view value() { return str; } }; \
+    using name = ::route::StaticExpression<name##_source>
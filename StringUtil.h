@@ -1,23 +1,121 @@
-#pragma once 
+#pragma once
 
 #include <vector>
 #include <iostream>
-#include <sstream>
+#include <string_view>
 #include "CheckCastNoThrow.h"
 
 namespace gsl {
 
+/**
+ * @brief 按分隔符切分 string_view, 切出的片段指向原字符串, 不复制
+ *
+ * 切分规则与 StringSplit 一致: 空串不产生片段, 结尾的分隔符不产生空片段.
+ *
+ *   for (std::string_view piece : gsl::SplitView("a,b,c", ',')) { ... }
+ */
+class SplitIterator {
+public:
+  SplitIterator(): _str(), _sep(0), _pos(std::string_view::npos), _end(0) {}
+
+  SplitIterator(std::string_view str, char sep): _str(str), _sep(sep), _pos(0), _end(0)
+  {
+    if (_str.empty()) {
+      _pos = std::string_view::npos;
+    } else {
+      find();
+    }
+  }
+
+  std::string_view operator*() const
+  {
+    return _str.substr(_pos, _end - _pos);
+  }
+
+  SplitIterator& operator++()
+  {
+    if (_end >= _str.size() || _end + 1 == _str.size()) {
+      _pos = std::string_view::npos;
+    } else {
+      _pos = _end + 1;
+      find();
+    }
+    return *this;
+  }
+
+  bool operator==(const SplitIterator& other) const
+  {
+    return _pos == other._pos;
+  }
+
+  bool operator!=(const SplitIterator& other) const
+  {
+    return _pos != other._pos;
+  }
+
+private:
+  void find()
+  {
+    _end = _str.find(_sep, _pos);
+    if (_end == std::string_view::npos) {
+      _end = _str.size();
+    }
+  }
+
+private:
+  std::string_view _str;
+  char _sep;
+  size_t _pos;
+  size_t _end;
+};
+
+class SplitRange {
+public:
+  SplitRange(std::string_view str, char sep): _str(str), _sep(sep) {}
+  SplitIterator begin() const { return SplitIterator(_str, _sep); }
+  SplitIterator end() const { return SplitIterator(); }
+private:
+  std::string_view _str;
+  char _sep;
+};
+
+inline SplitRange SplitView(std::string_view str, char sep)
+{
+  return SplitRange(str, sep);
+}
+
+// 片段转换失败时保留 T() 继续切分
 template<class T>
 int StringSplit(const std::string& str, std::vector<T>& tokens, const char& sep)
 {
-  std::stringstream ss(str);        
-  std::string tok;
-  while (getline(ss, tok, sep)) {
-    T value;
-    gsl::check_cast(tok.c_str(), value);
+  for (std::string_view piece : SplitView(str, sep)) {
+    T value = T();
+    gsl::check_cast(piece, value);
     tokens.push_back(value);
   }
   return tokens.size();
 }
 
+/**
+ * @brief 切分并转换每个片段, T 为 std::string_view 时不复制
+ *
+ * @return tokens 的大小; 任一片段转换失败 (包括结尾有无效字符) 返回 -1
+ */
+template<class T>
+int StringSplitView(std::string_view str, std::vector<T>& tokens, char sep)
+{
+  for (std::string_view piece : SplitView(str, sep)) {
+    if constexpr (std::is_same<T, std::string_view>::value) {
+      tokens.push_back(piece);
+    } else {
+      T value;
+      if (gsl::check_cast(piece, value) != 0) {
+        return -1;
+      }
+      tokens.push_back(value);
+    }
+  }
+  return tokens.size();
+}
+
 } //end namespace gsl
@@ -0,0 +1,134 @@
+#include "Tracer.h"
+
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+namespace route {
+
+// 关闭采样时的重新检查间隔, setSampleRate 最迟在这么多次求值后生效
+static const int32_t kIdleCountdown = 1 << 16;
+
+static std::atomic<uint32_t> g_sample_rate(0);
+static std::mutex g_rings_mutex;
+static std::vector<std::unique_ptr<TraceRing>> g_rings;
+static thread_local TraceRing* t_ring = nullptr;
+
+void TraceRing::snapshot(std::vector<TraceEvent>& out) const
+{
+    uint64_t head = _head.load(std::memory_order_acquire);
+    uint64_t begin = head > kCapacity ? head - kCapacity : 0;
+    for (uint64_t i = begin; i < head; ++i) {
+        const Slot& s = _slots[i & (kCapacity - 1)];
+        if (s.seq.load(std::memory_order_acquire) != i + 1) {
+            continue;
+        }
+        TraceEvent e;
+        e.thread = _id;
+        e.record = s.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.seq.load(std::memory_order_relaxed) != i + 1) {
+            continue;
+        }
+        out.push_back(e);
+    }
+}
+
+void Tracer::setSampleRate(uint32_t n)
+{
+    g_sample_rate.store(n, std::memory_order_relaxed);
+}
+
+uint32_t Tracer::sampleRate()
+{
+    return g_sample_rate.load(std::memory_order_relaxed);
+}
+
+bool Tracer::resample()
+{
+    uint32_t rate = g_sample_rate.load(std::memory_order_relaxed);
+    if (rate == 0) {
+        t_trace_countdown = kIdleCountdown;
+        return false;
+    }
+    t_trace_countdown = static_cast<int32_t>(std::min<uint32_t>(rate, INT32_MAX));
+    return true;
+}
+
+TraceRing& Tracer::ring()
+{
+    if (!t_ring) {
+        std::lock_guard<std::mutex> lock(g_rings_mutex);
+        g_rings.emplace_back(new TraceRing(static_cast<uint32_t>(g_rings.size())));
+        t_ring = g_rings.back().get();
+    }
+    return *t_ring;
+}
+
+void Tracer::collect(std::vector<TraceEvent>& out)
+{
+    std::lock_guard<std::mutex> lock(g_rings_mutex);
+    for (const auto& r : g_rings) {
+        r->snapshot(out);
+    }
+}
+
+void Tracer::dump(FILE* out)
+{
+    std::vector<TraceEvent> events;
+    collect(events);
+    for (const auto& e : events) {
+        const TraceRecord& r = e.record;
+        if (r.kind == TraceRecord::LEAF) {
+            fprintf(out, "T%u #%llu   %s=%s %s %llu cycles\n", e.thread, (unsigned long long)r.eval,
+                    r.name, r.value, r.result ? "pass" : "fail", (unsigned long long)r.cycles);
+        } else {
+            fprintf(out, "T%u #%llu %s %s %llu cycles\n", e.thread, (unsigned long long)r.eval,
+                    r.value, r.result ? "MATCH" : "NO MATCH", (unsigned long long)r.cycles);
+        }
+    }
+}
+
+static void copyField(char* dst, size_t cap, const char* src, size_t len)
+{
+    len = std::min(len, cap - 1);
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+TraceScope::TraceScope(const void* exp):
+_ring(Tracer::ring()),
+_exp(exp),
+_eval(_ring.nextEval()),
+_start(Tracer::cycles())
+{
+}
+
+void TraceScope::leaf(const std::string& name, const char* value, size_t len, bool result, uint64_t cycles)
+{
+    TraceRecord r;
+    r.eval = _eval;
+    r.cycles = cycles;
+    r.exp = _exp;
+    r.kind = TraceRecord::LEAF;
+    r.result = result;
+    copyField(r.name, sizeof(r.name), name.data(), name.size());
+    copyField(r.value, sizeof(r.value), value, len);
+    _ring.push(r);
+}
+
+void TraceScope::finish(const std::string& exp, bool result)
+{
+    TraceRecord r;
+    r.eval = _eval;
+    r.cycles = Tracer::cycles() - _start;
+    r.exp = _exp;
+    r.kind = TraceRecord::RESULT;
+    r.result = result;
+    r.name[0] = '\0';
+    copyField(r.value, sizeof(r.value), exp.data(), exp.size());
+    _ring.push(r);
+}
+
+} //end namespace route
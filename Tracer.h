@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace route {
+
+/**
+ * @brief 一条求值轨迹记录
+ *
+ * LEAF  : 访问过的叶子, name 为属性名, value 为输入值, cycles 为叶子比较耗时
+ * RESULT: 一次求值结束, value 为表达式文本 (截断), cycles 为整次求值耗时
+ */
+struct TraceRecord {
+    enum Kind : uint8_t { LEAF = 0, RESULT = 1 };
+    uint64_t eval;
+    uint64_t cycles;
+    const void* exp;
+    uint8_t kind;
+    uint8_t result;
+    char name[16];
+    char value[48];
+};
+
+struct TraceEvent {
+    uint32_t thread;
+    TraceRecord record;
+};
+
+/**
+ * @brief 单写者的定长环形缓冲区, 写满后覆盖最旧的记录
+ *
+ * 每个槽位带序号, 读者通过前后两次读取序号判断记录是否在复制时被覆盖.
+ */
+class TraceRing {
+public:
+    static constexpr size_t kCapacity = 4096;
+
+    explicit TraceRing(uint32_t id): _id(id), _head(0), _evals(0) {}
+
+    uint32_t id() const { return _id; }
+    uint64_t nextEval() { return ++_evals; }
+
+    void push(const TraceRecord& r)
+    {
+        uint64_t h = _head.load(std::memory_order_relaxed);
+        Slot& s = _slots[h & (kCapacity - 1)];
+        s.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.record = r;
+        s.seq.store(h + 1, std::memory_order_release);
+        _head.store(h + 1, std::memory_order_release);
+    }
+
+    // 复制当前仍有效的记录, 按写入顺序
+    void snapshot(std::vector<TraceEvent>& out) const;
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        TraceRecord record;
+        Slot(): seq(0) {}
+    };
+
+    uint32_t _id;
+    std::atomic<uint64_t> _head;
+    uint64_t _evals;
+    Slot _slots[kCapacity];
+}; // TraceRing
+
+// 距离下一次采样还剩的求值次数, 未采样路径上只做一次递减
+inline thread_local int32_t t_trace_countdown = 1;
+
+/**
+ * @brief 按 1/N 采样记录表达式的求值路径
+ *
+ * 每个线程写自己的 TraceRing, 线程退出后记录仍保留, 可随时 dump.
+ */
+class Tracer {
+public:
+    /**
+    * @param n 0 关闭, 1 每次都记录, N 每 N 次求值记录一次
+    */
+    static void setSampleRate(uint32_t n);
+    static uint32_t sampleRate();
+
+    static inline bool sample()
+    {
+        if (__builtin_expect(--t_trace_countdown > 0, 1)) {
+            return false;
+        }
+        return resample();
+    }
+
+    static inline uint64_t cycles()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    // 当前线程的缓冲区, 第一次调用时创建
+    static TraceRing& ring();
+
+    static void collect(std::vector<TraceEvent>& out);
+    static void dump(FILE* out);
+
+private:
+    static bool resample();
+}; // Tracer
+
+/**
+ * @brief 一次被采样的求值, 析构前需调用 finish
+ */
+class TraceScope {
+public:
+    explicit TraceScope(const void* exp);
+
+    void leaf(const std::string& name, const char* value, size_t len, bool result, uint64_t cycles);
+    void finish(const std::string& exp, bool result);
+
+private:
+    TraceRing& _ring;
+    const void* _exp;
+    uint64_t _eval;
+    uint64_t _start;
+}; // TraceScope
+
+} // end namespace route
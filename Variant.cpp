@@ -44,33 +44,47 @@ Variant::Variant(char *str):_type(String),_numValue(0),_stringValue(new std::str
 Variant::Variant(const std::string &val):_type(String),_numValue(0),_stringValue(new std::string(val)) {
 }
 
+Variant::Variant(const Version &v):_type(PackedVersion),_numValue(static_cast<unsigned long long>(v.packed)),_stringValue(NULL) {
+}
+
+Variant::Variant(const IpAddr &addr):_type(IpAddress),_numValue(static_cast<unsigned long long>(addr.hi)),
+  _ipLow(addr.lo) {
+}
+
 Variant::~Variant() {
-  delete _stringValue;
+  if (_type == String) {
+    delete _stringValue;
+  }
   _stringValue = NULL;
 }
 
 Variant::Variant(const Variant &other) {
   _type = other._type;
   _numValue = other._numValue;
-  _stringValue = NULL;
-  if (other._stringValue) {
+  _ipLow = other._ipLow;
+  if (other._type == String && other._stringValue) {
     _stringValue = new std::string(*other._stringValue);
   }
 }
 
 Variant& Variant::operator=(const Variant &other) {
-  _type = other._type;
-  _numValue = other._numValue;
-  if (_stringValue) {
-    _stringValue->clear();
+  if (this == &other) {
+    return *this;
   }
-  if (other._stringValue) {
-    if (!_stringValue) {
-      _stringValue = new std::string(*other._stringValue);
+  if (other._type == String && other._stringValue) {
+    if (_type == String && _stringValue) {
+      _stringValue->assign(*other._stringValue);
     } else {
-      _stringValue->append(*other._stringValue);
+      _stringValue = new std::string(*other._stringValue);
+    }
+  } else {
+    if (_type == String) {
+      delete _stringValue;
     }
+    _ipLow = other._ipLow;
   }
+  _type = other._type;
+  _numValue = other._numValue;
   return *this;
 }
 
@@ -81,6 +95,9 @@ bool Variant::operator==(const Variant &other) const {
   if (other._type == String) {
     return _stringValue == other._stringValue;
   }
+  if (other._type == IpAddress) {
+    return asConstIp() == other.asConstIp();
+  }
   if (other._type == Float || other._type == Double) {
     return _numValue.doubleValue - other._numValue.doubleValue < 0.000001 && other._numValue.doubleValue - _numValue.doubleValue < 0.000001;
   }
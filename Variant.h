@@ -1,6 +1,9 @@
 #pragma once
 
+#include <string.h>
 #include <string>
+#include "Version.h"
+#include "IpAddr.h"
 
 namespace route {
 
@@ -18,6 +21,8 @@ namespace route {
     Double,
     MaxSimpleType = Double,
     String,
+    PackedVersion,
+    IpAddress,
   } DataType;
 
   class Variant {
@@ -37,6 +42,10 @@ namespace route {
       Variant(const char *str);
       Variant(char *str);
       Variant(const std::string &val);
+      // 版本号在构造时解析一次, 之后每条规则按整数比较
+      Variant(const Version &v);
+      // 地址的两个 64 位整数存放在 Variant 内, 不分配内存
+      Variant(const IpAddr &addr);
       ~Variant();
 
     public:
@@ -46,6 +55,10 @@ namespace route {
       bool operator!=(const Variant &other) const;
 
     public:
+      inline DataType type() const {
+        return static_cast<DataType>(_type);
+      }
+
       inline bool isEmpty() const {
         return _type == Invalid;
       }
@@ -94,6 +107,14 @@ namespace route {
         return _type == String;
       }
 
+      inline bool isVersion() const {
+        return _type == PackedVersion;
+      }
+
+      inline bool isIp() const {
+        return _type == IpAddress;
+      }
+
     public:
       inline bool asConstBool() const {
         return !(_numValue.intValue == 0);
@@ -139,6 +160,17 @@ namespace route {
         return *_stringValue;
       }
 
+      inline Version asConstVersion() const {
+        return Version(static_cast<uint64_t>(_numValue.intValue));
+      }
+
+      inline IpAddr asConstIp() const {
+        if (_type != IpAddress) {
+          return IpAddr();
+        }
+        return IpAddr(static_cast<uint64_t>(_numValue.intValue), _ipLow);
+      }
+
       inline char asConstChar() const {
         return _numValue.intValue;
       }
@@ -160,7 +192,11 @@ namespace route {
         Value(char c):intValue(c) {;}
       };
       Value   _numValue;
-      std::string *_stringValue;
+      // String 时为字符串; IpAddress 时为地址的低 64 位, 高 64 位在 _numValue 中
+      union {
+        std::string *_stringValue;
+        uint64_t _ipLow;
+      };
   };
 
 } // end namespace route
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace route {
+
+/**
+ * @brief 点分版本号, 最多 4 段, 每段 0-65535, 打包为一个 64 位整数
+ *
+ * "12.10.3" 打包为 12 << 48 | 10 << 32 | 3 << 16, 缺少的段为 0, 整数比较即版本比较.
+ * 不带点的整数 (旧的 1208 写法) 作为只有第一段的版本.
+ */
+struct Version {
+    uint64_t packed;
+
+    constexpr Version(): packed(0) {}
+    explicit constexpr Version(uint64_t p): packed(p) {}
+
+    static constexpr Version Make(uint16_t major, uint16_t minor = 0, uint16_t patch = 0, uint16_t build = 0)
+    {
+        return Version(static_cast<uint64_t>(major) << 48 | static_cast<uint64_t>(minor) << 32 |
+                       static_cast<uint64_t>(patch) << 16 | build);
+    }
+
+    /**
+    * @brief 解析点分版本号
+    *
+    * @return 0 成功, 1 有效版本号后有多余字符, -1 格式错误或某段超出范围 (同 gsl::check_cast)
+    */
+    static int Parse(std::string_view s, Version& v)
+    {
+        uint64_t packed = 0;
+        size_t i = 0;
+        int parts = 0;
+        while (parts < 4) {
+            size_t b = i;
+            uint32_t n = 0;
+            while (i < s.size() && s[i] >= '0' && s[i] <= '9') {
+                n = n * 10 + (s[i] - '0');
+                if (n > 0xffff) {
+                    return -1;
+                }
+                ++i;
+            }
+            if (i == b) {
+                return -1;
+            }
+            packed |= static_cast<uint64_t>(n) << (48 - 16 * parts);
+            ++parts;
+            if (i == s.size() || s[i] != '.') {
+                break;
+            }
+            ++i;
+        }
+        v.packed = packed;
+        return i == s.size() ? 0 : 1;
+    }
+
+    // 旧的整数版本号, 超出一段的范围时返回 false
+    static bool FromInt(int64_t n, Version& v)
+    {
+        if (n < 0 || n > 0xffff) {
+            return false;
+        }
+        v = Make(static_cast<uint16_t>(n));
+        return true;
+    }
+
+    uint16_t part(int i) const
+    {
+        return static_cast<uint16_t>(packed >> (48 - 16 * i));
+    }
+
+    // 省略末尾为 0 的段, 至少保留第一段
+    std::string ToString() const
+    {
+        int n = 4;
+        while (n > 1 && part(n - 1) == 0) {
+            --n;
+        }
+        std::string s = std::to_string(part(0));
+        for (int i = 1; i < n; ++i) {
+            s += '.';
+            s += std::to_string(part(i));
+        }
+        return s;
+    }
+
+    bool operator==(const Version& o) const { return packed == o.packed; }
+    bool operator!=(const Version& o) const { return packed != o.packed; }
+    bool operator<(const Version& o) const { return packed < o.packed; }
+    bool operator<=(const Version& o) const { return packed <= o.packed; }
+    bool operator>(const Version& o) const { return packed > o.packed; }
+    bool operator>=(const Version& o) const { return packed >= o.packed; }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Version& v)
+{
+    return os << v.ToString();
+}
+
+} // end namespace route
+
+namespace std {
+template<>
+struct hash<route::Version> {
+    size_t operator()(const route::Version& v) const
+    {
+        return std::hash<uint64_t>()(v.packed);
+    }
+};
+} // end namespace std
+
+namespace gsl {
+inline int check_cast(std::string_view value, route::Version& dest)
+{
+    return route::Version::Parse(value, dest);
+}
+} // end namespace gsl
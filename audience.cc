@@ -0,0 +1,126 @@
+/*
+ * audience: 在用户画像数据集上估算规则覆盖的人数
+ *
+ * usage: audience -d profiles.csv (-e expression | -r rules.conf) [-l]
+ *        audience -d profiles.csv -g rows     生成一份合成数据集
+ *
+ * -l 输出命中的用户 id, 每行一个
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "ProfileIndex.h"
+#include "RuleSet.h"
+
+using namespace route;
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool generate(const std::string& path, long rows)
+{
+    FILE* fp = fopen(path.c_str(), "w");
+    if (!fp) {
+        fprintf(stderr, "open %s failed\n", path.c_str());
+        return false;
+    }
+    srand(12345);
+    fprintf(fp, "id,V,P,A,L,E\n");
+    for (long i = 0; i < rows; ++i) {
+        // 约 5% 的用户没有实验分组
+        fprintf(fp, "%ld,%d,%d,%d,%d,%s\n", 100000 + i, 1200 + rand() % 12, rand() % 2,
+                rand() % 3, rand() % 8, rand() % 20 ? (rand() % 2 ? "abtest" : "control") : "");
+    }
+    fclose(fp);
+    return true;
+}
+
+static void report(const ProfileIndex& index, uint32_t id, const ASTExp& exp, bool list)
+{
+    auto start = std::chrono::steady_clock::now();
+    Bitmap b = index.select(exp);
+    double ms = since(start);
+    uint64_t n = b.cardinality();
+    fprintf(stderr, "rule %u: %llu / %u users (%.2f%%) in %.2f ms: %s\n", id,
+            (unsigned long long)n, index.rows(), index.rows() ? 100.0 * n / index.rows() : 0.0,
+            ms, exp.getExp().c_str());
+    if (list) {
+        std::vector<uint32_t> rows;
+        b.toVector(rows);
+        for (uint32_t r : rows) {
+            printf("%s\n", index.id(r).c_str());
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string data;
+    std::string exp;
+    std::string rules;
+    long gen = 0;
+    bool list = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:e:r:g:lh")) != -1) {
+        switch (opt) {
+            case 'd': data = optarg; break;
+            case 'e': exp = optarg; break;
+            case 'r': rules = optarg; break;
+            case 'g': gen = atol(optarg); break;
+            case 'l': list = true; break;
+            default:
+                fprintf(stderr, "usage: %s -d profiles.csv (-e expression | -r rules.conf) [-l]\n"
+                                "       %s -d profiles.csv -g rows\n", argv[0], argv[0]);
+                return 1;
+        }
+    }
+    if (data.empty()) {
+        fprintf(stderr, "missing -d\n");
+        return 1;
+    }
+    if (gen > 0) {
+        return generate(data, gen) ? 0 : 1;
+    }
+    if (exp.empty() == rules.empty()) {
+        fprintf(stderr, "need exactly one of -e and -r\n");
+        return 1;
+    }
+
+    ProfileIndex index;
+    auto start = std::chrono::steady_clock::now();
+    if (!index.load(data)) {
+        return 1;
+    }
+    fprintf(stderr, "loaded %u users in %.0f ms, index %.1f MB\n", index.rows(), since(start),
+            index.bytes() / 1048576.0);
+    for (const auto& kv : index.cardinalities()) {
+        fprintf(stderr, "  %s: %zu values\n", kv.first.c_str(), kv.second);
+    }
+
+    if (!exp.empty()) {
+        ASTExp* ast = XExpression::compile(exp);
+        if (!ast) {
+            fprintf(stderr, "compile failed: %s\n", exp.c_str());
+            return 1;
+        }
+        ast->optimize();
+        report(index, 0, *ast, list);
+        delete ast;
+        return 0;
+    }
+    RuleSet rs;
+    if (!rs.load(rules)) {
+        return 1;
+    }
+    for (size_t i = 0; i < rs.size(); ++i) {
+        report(index, rs.rule(i).id, *rs.rule(i).exp, list);
+    }
+    return 0;
+}
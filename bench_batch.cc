@@ -0,0 +1,111 @@
+/*
+ * bench_batch: 逐个请求求值与批量 (按规则依次处理一批请求 + 预取) 求值的对比
+ *
+ * 规则数从 -r 起每次翻倍到 -m, 规则集超出缓存后批量求值的优势变大.
+ *
+ * usage: bench_batch [-r min_rules] [-m max_rules] [-b batch] [-n requests]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "RuleSet.h"
+
+using namespace route;
+
+static std::string makeRule(int i)
+{
+    std::string exp = "V={";
+    for (int k = 0; k < 12; ++k) {
+        exp += (k ? "," : "") + std::to_string(1200 + rand() % 40);
+    }
+    int lo = rand() % 5;
+    exp += "} && A=[" + std::to_string(lo) + "," + std::to_string(lo + rand() % 4) + "]";
+    exp += " && L={" + std::to_string(rand() % 8) + "," + std::to_string(rand() % 8) + "}";
+    exp += " || E={exp" + std::to_string(i) + ",exp" + std::to_string(i + 1) + "}";
+    return exp;
+}
+
+int main(int argc, char* argv[])
+{
+    int min_rules = 1000;
+    int max_rules = 64000;
+    int batch = 16;
+    int requests = 512;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:m:b:n:h")) != -1) {
+        switch (opt) {
+            case 'r': min_rules = atoi(optarg); break;
+            case 'm': max_rules = atoi(optarg); break;
+            case 'b': batch = atoi(optarg); break;
+            case 'n': requests = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-r min_rules] [-m max_rules] [-b batch] [-n requests]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (min_rules <= 0 || batch <= 0 || requests < batch) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+    requests -= requests % batch;
+
+    srand(12345);
+    std::vector<std::string> texts;
+    for (int i = 0; i < requests; ++i) {
+        texts.push_back("V=" + std::to_string(1200 + rand() % 40) + "&A=" + std::to_string(rand() % 8) +
+                        "&L=" + std::to_string(rand() % 8) + "&E=exp" + std::to_string(rand() % max_rules));
+    }
+    std::vector<RequestBuffer> buffers;
+    for (const auto& t : texts) {
+        buffers.emplace_back(t.data(), t.size(), BufferFormat::QueryString());
+    }
+    std::vector<RequestBuffer*> ptrs;
+    for (auto& b : buffers) {
+        ptrs.push_back(&b);
+    }
+    std::vector<std::vector<uint32_t>> matched(batch);
+
+    printf("%8s %14s %14s %8s\n", "rules", "single ns/req", "batch ns/req", "speedup");
+    RuleSet rs;
+    for (int n = min_rules; n <= max_rules; n *= 2) {
+        while (rs.size() < static_cast<size_t>(n)) {
+            rs.add(static_cast<uint32_t>(rs.size() + 1), makeRule(static_cast<int>(rs.size())));
+        }
+        // 每个请求至少过一遍规则集, 每种方式约 2000 万次规则求值
+        int rounds = std::max(1, static_cast<int>(20000000LL / n / requests));
+
+        size_t hits_single = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            for (int i = 0; i < requests; ++i) {
+                matched[0].clear();
+                buffers[i].reset(texts[i].data(), texts[i].size());
+                hits_single += rs.evaluate(buffers[i], matched[0]);
+            }
+        }
+        double single = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        size_t hits_batch = 0;
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            for (int i = 0; i < requests; i += batch) {
+                for (int j = 0; j < batch; ++j) {
+                    matched[j].clear();
+                    buffers[i + j].reset(texts[i + j].data(), texts[i + j].size());
+                }
+                hits_batch += rs.evaluate(&ptrs[i], batch, matched.data());
+            }
+        }
+        double batched = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%8d %14.0f %14.0f %7.2fx%s\n", n, single / rounds / requests * 1e9,
+               batched / rounds / requests * 1e9, single / batched,
+               hits_single == hits_batch ? "" : "  (hit count differs)");
+        fflush(stdout);
+    }
+    return 0;
+}
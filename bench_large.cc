@@ -0,0 +1,120 @@
+/*
+ * bench_large: 机器生成的超长表达式的编译, 化简和求值代价
+ *
+ * 三种形状: 全部 AND, 全部 OR, AND/OR 交替 (没有优先级, 交替时每个操作符新开一层,
+ * 嵌套深度与项数相同). 按项数 1k 到 -n 逐级放大, 每项的耗时和内存应基本不变.
+ *
+ * usage: bench_large [-n max_terms] [-r eval_rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <malloc.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "xExpression.h"
+
+using namespace route;
+
+static const char* kNames[] = {"P", "A", "L"};
+
+// 防止求值被优化掉
+static volatile int g_sink = 0;
+
+enum Shape {ALL_AND, ALL_OR, ALTERNATE};
+
+// AND 后面的项都成立, OR 后面的项都不成立, 求值会访问每一个叶子
+static std::string generate(Shape shape, size_t terms)
+{
+    std::string exp;
+    exp.reserve(terms * 20);
+    for (size_t i = 0; i < terms; ++i) {
+        bool use_and = shape == ALL_AND || (shape == ALTERNATE && i % 2 == 1);
+        if (i) {
+            exp += use_and ? " && " : " || ";
+        }
+        exp += kNames[i % 3];
+        if (i && !use_and) {
+            exp += "=[" + std::to_string(100 + i) + "," + std::to_string(200 + i) + ")";
+        } else {
+            exp += "=[0," + std::to_string(10 + i) + ")";
+        }
+    }
+    return exp;
+}
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static size_t heapBytes()
+{
+    return mallinfo2().uordblks;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t max_terms = 1000000;
+    int rounds = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:h")) != -1) {
+        switch (opt) {
+            case 'n': max_terms = strtoul(optarg, NULL, 10); break;
+            case 'r': rounds = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n max_terms] [-r eval_rounds]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (rounds < 1) {
+        rounds = 1;
+    }
+
+    std::map<std::string, Variant> values;
+    for (const char* name : kNames) {
+        values[name] = Variant(5);
+    }
+
+    const char* shapes[] = {"and", "or", "alternate"};
+    printf("%-10s %9s %8s %12s %12s %12s %12s\n",
+           "shape", "terms", "nodes", "compile ns", "bytes", "eval ns", "optimize ns");
+    for (int s = ALL_AND; s <= ALTERNATE; ++s) {
+        for (size_t terms = 1000; terms <= max_terms; terms *= 10) {
+            std::string exp = generate(static_cast<Shape>(s), terms);
+
+            size_t before = heapBytes();
+            auto start = std::chrono::steady_clock::now();
+            ASTExp* e = XExpression::compile(exp);
+            double t_compile = seconds(start);
+            size_t bytes = heapBytes() - before;
+            if (!e) {
+                fprintf(stderr, "compile failed: %s %zu terms\n", shapes[s], terms);
+                return 1;
+            }
+
+            size_t nodes = e->size();
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < rounds; ++i) {
+                g_sink = g_sink + e->evaluate(values);
+            }
+            double t_eval = seconds(start) / rounds;
+
+            start = std::chrono::steady_clock::now();
+            e->optimize();
+            double t_opt = seconds(start);
+
+            // 每项的代价, 线性时各行应接近
+            printf("%-10s %9zu %8zu %12.1f %12.1f %12.2f %12.1f\n",
+                   shapes[s], terms, nodes, t_compile * 1e9 / terms,
+                   static_cast<double>(bytes) / terms, t_eval * 1e9 / terms,
+                   t_opt * 1e9 / terms);
+            delete e;
+        }
+    }
+    printf("(per-term cost; eval = one evaluate over the unoptimized tree)\n");
+    return 0;
+}
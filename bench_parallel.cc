@@ -0,0 +1,131 @@
+/*
+ * bench_parallel: 单个请求在大规则集上的串行求值与 fork-join 求值的延迟对比
+ *
+ * 规则数从 -r 起每次乘 4 到 -m, 线程数 (含调用线程) 从 2 起每次翻倍到 -t,
+ * 输出每个请求的平均延迟和相对串行的加速比. 低于 min_nodes 的规则集按串行求值.
+ *
+ * usage: bench_parallel [-r min_rules] [-m max_rules] [-t max_threads] [-n requests] [-s shard_nodes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ParallelRuleSet.h"
+
+using namespace route;
+
+static std::string makeRule(int i)
+{
+    std::string exp = "V={";
+    for (int k = 0; k < 12; ++k) {
+        exp += (k ? "," : "") + std::to_string(1200 + rand() % 40);
+    }
+    int lo = rand() % 5;
+    exp += "} && A=[" + std::to_string(lo) + "," + std::to_string(lo + rand() % 4) + "]";
+    exp += " && L={" + std::to_string(rand() % 8) + "," + std::to_string(rand() % 8) + "}";
+    exp += " || E={exp" + std::to_string(i) + ",exp" + std::to_string(i + 1) + "}";
+    return exp;
+}
+
+int main(int argc, char* argv[])
+{
+    int min_rules = 2000;
+    int max_rules = 512000;
+    int max_threads = std::max(2u, std::thread::hardware_concurrency());
+    int requests = 64;
+    size_t shard_nodes = ParallelOptions().shard_nodes;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:m:t:n:s:h")) != -1) {
+        switch (opt) {
+            case 'r': min_rules = atoi(optarg); break;
+            case 'm': max_rules = atoi(optarg); break;
+            case 't': max_threads = atoi(optarg); break;
+            case 'n': requests = atoi(optarg); break;
+            case 's': shard_nodes = strtoul(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "usage: %s [-r min_rules] [-m max_rules] [-t max_threads] [-n requests] "
+                        "[-s shard_nodes]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (min_rules <= 0 || max_threads < 2 || requests <= 0 || shard_nodes == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    srand(12345);
+    std::vector<std::map<std::string, Variant>> values(requests);
+    for (auto& v : values) {
+        v["V"] = Variant(1200 + rand() % 40);
+        v["A"] = Variant(rand() % 8);
+        v["L"] = Variant(rand() % 8);
+        v["E"] = Variant("exp" + std::to_string(rand() % max_rules));
+    }
+
+    std::vector<std::unique_ptr<ForkJoinPool>> pools;
+    for (int t = 2; t <= max_threads; t *= 2) {
+        pools.emplace_back(new ForkJoinPool(t - 1));
+    }
+
+    printf("%8s %8s %14s", "rules", "shards", "serial ns/req");
+    for (const auto& p : pools) {
+        printf("  %6zut ns/req %8s", p->workers() + 1, "speedup");
+    }
+    printf("\n");
+    RuleSet rs;
+    std::vector<uint32_t> expect, matched;
+    for (int n = min_rules; n <= max_rules; n *= 4) {
+        while (rs.size() < static_cast<size_t>(n)) {
+            rs.add(static_cast<uint32_t>(rs.size() + 1), makeRule(static_cast<int>(rs.size())));
+        }
+        // 每种方式约 2000 万次规则求值
+        int rounds = std::max(1, static_cast<int>(20000000LL / n / requests));
+
+        auto start = std::chrono::steady_clock::now();
+        size_t hits = 0;
+        for (int r = 0; r < rounds; ++r) {
+            for (const auto& v : values) {
+                expect.clear();
+                hits += rs.evaluate(v, expect);
+            }
+        }
+        double serial = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%8d %8zu %14.0f", n, ParallelRuleSet(&rs, pools[0].get(), ParallelOptions(shard_nodes, 0)).shards(),
+               serial / rounds / requests * 1e9);
+
+        for (const auto& p : pools) {
+            // min_nodes 为 0, 所有大小都并行, 可以看出自适应阈值应取在哪里
+            ParallelRuleSet prs(&rs, p.get(), ParallelOptions(shard_nodes, 0));
+            bool same = true;
+            for (const auto& v : values) {
+                expect.clear();
+                matched.clear();
+                rs.evaluate(v, expect);
+                prs.evaluate(v, matched);
+                same = same && expect == matched;
+            }
+            start = std::chrono::steady_clock::now();
+            size_t phits = 0;
+            for (int r = 0; r < rounds; ++r) {
+                for (const auto& v : values) {
+                    matched.clear();
+                    phits += prs.evaluate(v, matched);
+                }
+            }
+            double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printf("  %14.0f %7.2fx%s", t / rounds / requests * 1e9, serial / t,
+                   same && phits == hits ? "" : "!");
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    printf("(! marks a result that differs from serial evaluation)\n");
+    return 0;
+}
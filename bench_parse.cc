@@ -0,0 +1,91 @@
+/*
+ * bench_parse: 规则文本解析的吞吐
+ *
+ * 1. 切分 + 数值转换: 旧的 stringstream/getline + strtol 与 SplitView + from_chars 对比
+ * 2. XExpression::compile 整体吞吐
+ *
+ * usage: bench_parse [-n iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "xExpression.h"
+
+using namespace route;
+
+// 旧实现: 每个片段一个 std::string, 经 c_str() 交给 strtol
+static int legacySplit(const std::string& str, std::vector<long>& tokens, char sep)
+{
+    std::stringstream ss(str);
+    std::string tok;
+    while (getline(ss, tok, sep)) {
+        char* end = NULL;
+        tokens.push_back(strtol(tok.c_str(), &end, 10));
+    }
+    return tokens.size();
+}
+
+template<class F>
+static double timeIt(int n, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i) {
+        f(i);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    int n = 200000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+            case 'n': n = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    std::string list;
+    for (int i = 0; i < 32; ++i) {
+        list += (i ? "," : "") + std::to_string(1200 + i * 7);
+    }
+    std::vector<long> tokens;
+    long sum = 0;
+    double t_old = timeIt(n, [&](int) {
+        tokens.clear();
+        legacySplit(list, tokens, ',');
+        sum += tokens.back();
+    });
+    double t_new = timeIt(n, [&](int) {
+        tokens.clear();
+        gsl::StringSplitView(list, tokens, ',');
+        sum += tokens.back();
+    });
+    printf("split 32 numbers: stringstream+strtol %.0f /s, SplitView+from_chars %.0f /s, %.2fx\n",
+           n / t_old, n / t_new, t_old / t_new);
+
+    const char* exps[] = {
+        "V=(1206,1209] && P={1}  && A={1} && E={abtest}",
+        "V={1201,1202,1203,1204,1205,1206,1207,1208,1209,1210} || E={exp1,exp2,exp3,abtest}",
+        "V=[1200,1300) && L={1,2,3,4,5,6,7,8} && P={0}",
+    };
+    size_t bytes = 0;
+    double t_compile = timeIt(n / 10, [&](int i) {
+        const char* exp = exps[i % 3];
+        ASTExp* ast = XExpression::compile(exp);
+        bytes += strlen(exp);
+        sum += ast != nullptr;
+        delete ast;
+    });
+    printf("compile: %.0f expressions/s, %.1f MB/s\n", (n / 10) / t_compile, bytes / t_compile / 1e6);
+    return sum == 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * bench_scaling: 多线程求值吞吐随线程数的变化
+ *
+ * 对比所有线程共享一个 RuleSet 与每个节点/CPU 一个 ReplicatedRuleSet 副本,
+ * 线程 i 绑定在 CPU i 上.
+ *
+ * usage: bench_scaling [-r rules] [-t max_threads] [-d ms] [-m node|cpu]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ReplicatedRuleSet.h"
+
+using namespace route;
+
+static std::string makeRules(int n)
+{
+    char path[] = "/tmp/bench_scaling_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return std::string();
+    }
+    FILE* fp = fdopen(fd, "w");
+    srand(12345);
+    for (int i = 0; i < n; ++i) {
+        int lo = 1200 + rand() % 10;
+        fprintf(fp, "%d V=(%d,%d] && P={%d} && A={%d,%d} || E={exp%d,abtest}\n",
+                i + 1, lo, lo + rand() % 5, rand() % 2, rand() % 3, rand() % 3, rand() % 10);
+    }
+    fclose(fp);
+    return path;
+}
+
+static void makeRequests(std::vector<std::map<std::string, Variant>>& reqs)
+{
+    for (size_t i = 0; i < reqs.size(); ++i) {
+        reqs[i]["V"] = Variant(1200 + rand() % 12);
+        reqs[i]["P"] = Variant(rand() % 2);
+        reqs[i]["A"] = Variant(rand() % 3);
+        reqs[i]["E"] = Variant(rand() % 2 ? "abtest" : "control");
+    }
+}
+
+static double run(int threads, int ms, const RuleSet* shared, ReplicatedRuleSet* replicated)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> total(0);
+    std::vector<std::thread> ths;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int t = 0; t < threads; ++t) {
+        ths.emplace_back([&, t]() {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(t % (ncpu > 0 ? ncpu : 1), &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            std::vector<std::map<std::string, Variant>> reqs(256);
+            makeRequests(reqs);
+            std::vector<uint32_t> matched;
+            uint64_t n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                const RuleSet& rules = replicated ? replicated->local() : *shared;
+                for (const auto& r : reqs) {
+                    matched.clear();
+                    rules.evaluate(r, matched);
+                }
+                n += reqs.size();
+            }
+            total += n;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    stop = true;
+    for (auto& th : ths) {
+        th.join();
+    }
+    return total.load() * 1000.0 / ms;
+}
+
+int main(int argc, char* argv[])
+{
+    int nrules = 200;
+    int max_threads = static_cast<int>(std::thread::hardware_concurrency());
+    int ms = 500;
+    ReplicatedRuleSet::Mode mode = ReplicatedRuleSet::PER_NODE;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:t:d:m:h")) != -1) {
+        switch (opt) {
+            case 'r': nrules = atoi(optarg); break;
+            case 't': max_threads = atoi(optarg); break;
+            case 'd': ms = atoi(optarg); break;
+            case 'm': mode = strcmp(optarg, "cpu") == 0 ? ReplicatedRuleSet::PER_CPU : ReplicatedRuleSet::PER_NODE; break;
+            default:
+                fprintf(stderr, "usage: %s [-r rules] [-t max_threads] [-d ms] [-m node|cpu]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (max_threads <= 0) {
+        max_threads = 1;
+    }
+    std::string path = makeRules(nrules);
+    RuleSet shared;
+    ReplicatedRuleSet replicated(mode);
+    if (path.empty() || !shared.load(path) || !replicated.load(path)) {
+        fprintf(stderr, "load rules failed\n");
+        return 1;
+    }
+    unlink(path.c_str());
+    printf("%d rules, %zu replicas\n", nrules, replicated.replicas());
+    printf("%8s %16s %8s %16s %8s\n", "threads", "shared eval/s", "scale", "replica eval/s", "scale");
+    double base_shared = 0;
+    double base_replica = 0;
+    for (int t = 1; t <= max_threads; t = t < 4 ? t + 1 : t * 2) {
+        double s = run(t, ms, &shared, nullptr);
+        double r = run(t, ms, nullptr, &replicated);
+        if (t == 1) {
+            base_shared = s;
+            base_replica = r;
+        }
+        printf("%8d %16.0f %8.2f %16.0f %8.2f\n", t, s, s / base_shared, r, r / base_replica);
+    }
+    return 0;
+}
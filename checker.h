@@ -4,7 +4,20 @@
 #include <cstdint>
 #include <vector>
 #include <algorithm>
+#include <charconv>
+#include <string_view>
+#include <type_traits>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <typeinfo>
 #include "CheckCastNoThrow.h"
+#include "ConstantPool.h"
+#include "CoarseClock.h"
+#include "ExternalList.h"
+#include "Version.h"
+#include "PrefixTrie.h"
+#include "CounterStore.h"
 #include <iostream>
 
 namespace route {
@@ -15,7 +28,7 @@ public:
     virtual ~IChecker() = default;
     
 public:
-    virtual int Parser(const std::string& pattern) = 0;
+    virtual int Parser(std::string_view pattern) = 0;
 
     virtual bool IsValid(const int8_t& value)
     {
@@ -61,6 +74,92 @@ public:
     {
         return false;
     }
+
+    virtual bool IsValid(const Version& value)
+    {
+        return false;
+    }
+
+    virtual bool IsValid(const IpAddr& value)
+    {
+        return false;
+    }
+
+    // 未解码的文本值 (如 query string 中的值), 不构造 Variant 直接比较
+    virtual bool IsValidRaw(const char* data, size_t len)
+    {
+        return false;
+    }
+
+    // 以下供表达式优化使用
+
+    /**
+    * @brief 与同类型的 checker 求交 (intersect) 或求并
+    *
+    * @return 新的 checker, 结果无法用单个 checker 表示时返回 nullptr
+    */
+    virtual IChecker* Merge(const IChecker* other, bool intersect) const
+    {
+        return nullptr;
+    }
+
+    // 没有任何值能满足
+    virtual bool IsEmpty() const
+    {
+        return false;
+    }
+
+    // 规范化的文本形式, 集合排序去重, 如 "(1206,1209]" "{1,2}"
+    virtual std::string Describe() const
+    {
+        return std::string();
+    }
+
+    // 把常量移入规则集的常量池, 之后只保留池中的句柄
+    virtual void Intern(ConstantPools& pools)
+    {
+    }
+
+    // Intern 的逆操作: 常量复制回叶子自己, 归还池中的引用; 表达式析构或重新化简前调用
+    virtual void Release(ConstantPools& pools)
+    {
+    }
+
+    // 叶子自身占用的字节, 不含池中的常量
+    virtual size_t Footprint() const
+    {
+        return sizeof(IChecker);
+    }
+
+    // 常量数组的位置和字节数, 供批量求值时预取
+    virtual const void* ConstantData(size_t& bytes) const
+    {
+        bytes = 0;
+        return nullptr;
+    }
+
+    // 时间类 checker 不读取请求中的属性, 而是与 CoarseClock 比较
+    virtual bool IsClock() const
+    {
+        return false;
+    }
+
+    virtual bool IsValidNow()
+    {
+        return false;
+    }
+
+    // 绝对时间区间的生效范围 [from, until), 不是绝对时间区间时返回 false
+    virtual bool Window(int64_t& from, int64_t& until) const
+    {
+        return false;
+    }
+
+    // 结果除属性值外还取决于随时间变化的状态 (如事件计数, 可重新加载的名单), 不能按属性值缓存
+    virtual bool IsVolatile() const
+    {
+        return false;
+    }
 };
 
 
@@ -73,7 +172,13 @@ class TChecker : public IChecker {
     };
 public:
     TChecker() = default;
-    ~TChecker() = default;
+    // 已 Intern 的常量由表达式在析构前 Release, 这里只释放自己持有的
+    ~TChecker()
+    {
+        if (!handle_) {
+            delete[] values_;
+        }
+    }
 
     static IChecker* Create() 
     {
@@ -86,14 +191,19 @@ public:
     *
     * @return 0 success, 1 error for format 
     */
-    int Parser(const std::string& pattern) override
+    int Parser(std::string_view pattern) override
     {
+        std::vector<T> parsed;
         State s = E_START;
-        std::string value;
+        // 当前值在 pattern 中的范围, 值中间夹有空白时需要拼接
+        size_t begin = std::string_view::npos;
+        size_t end = 0;
+        bool spaced = false;
         int dot = 0;
         for (size_t i=0; i < pattern.size(); ++i) {
             const char& ch = pattern[i];
             if (std::isspace(ch)) {
+                spaced = spaced || begin != std::string_view::npos;
                 continue;
             }
             switch (s) {
@@ -112,8 +222,11 @@ public:
                         if (ch == '.') {
                             ++dot;
                         }
-                        if (judge_(ch)) {
-                            value.push_back(ch);
+                        if (Judge()(ch)) {
+                            if (begin == std::string_view::npos) {
+                                begin = i;
+                            }
+                            end = i + 1;
                         }
                         else if (ch == ',') {
                             finish =  true;
@@ -126,15 +239,30 @@ public:
                         else {
                             return 1; 
                         }
-                        if (dot > 1) {
+                        // 版本号的点由 check_cast 校验
+                        if (dot > 1 && !std::is_same<T, Version>::value) {
                             return 1;
                         }
                         if (finish) {
                             dot = 0;
+                            std::string_view value;
+                            if (begin != std::string_view::npos) {
+                                value = pattern.substr(begin, end - begin);
+                            }
+                            std::string joined;
+                            if (spaced) {
+                                joined.assign(value.data(), value.size());
+                                joined.erase(std::remove_if(joined.begin(), joined.end(),
+                                             [](unsigned char c) { return std::isspace(c); }), joined.end());
+                                value = joined;
+                            }
                             T num;
-                            gsl::check_cast<T, const char*>(value.c_str(), num);
-                            candidate_values_.push_back(num);
-                            value.clear();
+                            if (Convert(value, num) != 0) {
+                                return 1;
+                            }
+                            parsed.push_back(num);
+                            begin = std::string_view::npos;
+                            spaced = false;
                         }
                     }
                 break;
@@ -143,22 +271,240 @@ public:
             }
             
         }
-        return s == E_END && IsMatch() ? 0 : 1;
+        if (s != E_END || !IsMatch(parsed.size())) {
+            return 1;
+        }
+        Bind(parsed);
+        return 0;
     }
 
     bool IsValid(const T& value) override
+    {
+        return Check(value);
+    }
+
+    bool IsValidRaw(const char* data, size_t len) override
+    {
+        if constexpr (std::is_same<T, std::string>::value) {
+            return Check(std::string_view(data, len));
+        } else {
+            T value;
+            return gsl::check_cast(std::string_view(data, len), value) == 0 && Check(value);
+        }
+    }
+
+    // 只合并动态类型相同的叶子: 派生类 (如 COUNT) 的比较对象不同, 不能按常量合并
+    IChecker* Merge(const IChecker* other, bool intersect) const override
+    {
+        if (!other || typeid(*this) != typeid(*other)) {
+            return nullptr;
+        }
+        const TChecker* o = static_cast<const TChecker*>(other);
+        if (IsSet() && o->IsSet()) {
+            std::vector<T> x = SortedValues();
+            std::vector<T> y = o->SortedValues();
+            std::vector<T> out;
+            if (intersect) {
+                std::set_intersection(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(out));
+            } else {
+                std::set_union(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(out));
+            }
+            return MakeSet(out);
+        }
+        if (IsSet() || o->IsSet()) {
+            const TChecker* set = IsSet() ? this : o;
+            const TChecker* range = IsSet() ? o : this;
+            std::vector<T> out;
+            for (const auto& v : set->SortedValues()) {
+                if (range->Check(v)) {
+                    out.push_back(v);
+                } else if (!intersect) {
+                    return nullptr;
+                }
+            }
+            return intersect ? MakeSet(out) : MakeInterval(range->l_ch_, range->values_[0],
+                                                           range->values_[1], range->r_ch_);
+        }
+        const T& lo1 = values_[0];
+        const T& hi1 = values_[1];
+        const T& lo2 = o->values_[0];
+        const T& hi2 = o->values_[1];
+        bool lo1_open = l_ch_ == '(';
+        bool hi1_open = r_ch_ == ')';
+        bool lo2_open = o->l_ch_ == '(';
+        bool hi2_open = o->r_ch_ == ')';
+        if (intersect) {
+            bool lo_open = lo1 == lo2 ? (lo1_open || lo2_open) : (lo1 < lo2 ? lo2_open : lo1_open);
+            bool hi_open = hi1 == hi2 ? (hi1_open || hi2_open) : (hi1 < hi2 ? hi1_open : hi2_open);
+            return MakeInterval(lo_open ? '(' : '[', std::max(lo1, lo2), std::min(hi1, hi2), hi_open ? ')' : ']');
+        }
+        // 两个区间不相交也不相邻时无法合并
+        if (hi1 < lo2 || (hi1 == lo2 && hi1_open && lo2_open) ||
+            hi2 < lo1 || (hi2 == lo1 && hi2_open && lo1_open)) {
+            return nullptr;
+        }
+        bool lo_open = lo1 == lo2 ? (lo1_open && lo2_open) : (lo1 < lo2 ? lo1_open : lo2_open);
+        bool hi_open = hi1 == hi2 ? (hi1_open && hi2_open) : (hi1 < hi2 ? hi2_open : hi1_open);
+        return MakeInterval(lo_open ? '(' : '[', std::min(lo1, lo2), std::max(hi1, hi2), hi_open ? ')' : ']');
+    }
+
+    bool IsEmpty() const override
+    {
+        if (IsSet()) {
+            return count_ == 0;
+        }
+        const T& lo = values_[0];
+        const T& hi = values_[1];
+        bool lo_open = l_ch_ == '(';
+        bool hi_open = r_ch_ == ')';
+        if (hi < lo) {
+            return true;
+        }
+        if constexpr (std::is_integral<T>::value) {
+            // 整数区间按闭区间比较, 如 (1,2) 为空
+            if ((lo_open && lo == std::numeric_limits<T>::max()) ||
+                (hi_open && hi == std::numeric_limits<T>::min())) {
+                return true;
+            }
+            return (hi_open ? hi - 1 : hi) < (lo_open ? lo + 1 : lo);
+        } else {
+            return lo == hi && (lo_open || hi_open);
+        }
+    }
+
+    std::string Describe() const override
+    {
+        std::ostringstream os;
+        os << l_ch_;
+        for (uint32_t i = 0; i < count_; ++i) {
+            if (i) {
+                os << ',';
+            }
+            os << values_[i];
+        }
+        os << r_ch_;
+        return os.str();
+    }
+
+    void Intern(ConstantPools& pools) override
+    {
+        if (handle_) {
+            return;
+        }
+        uint32_t handle = pools.intern<T>(values_, count_);
+        const T* pooled = pools.get<T>(handle, count_);
+        delete[] values_;
+        values_ = pooled;
+        handle_ = handle;
+    }
+
+    void Release(ConstantPools& pools) override
+    {
+        if (!handle_) {
+            return;
+        }
+        uint32_t handle = handle_;
+        Own(values_, count_);
+        pools.release<T>(handle);
+    }
+
+    size_t Footprint() const override
+    {
+        return sizeof(*this) + (handle_ ? 0 : count_ * sizeof(T));
+    }
+
+    const void* ConstantData(size_t& bytes) const override
+    {
+        bytes = count_ * sizeof(T);
+        return values_;
+    }
+
+protected:
+    inline bool IsSet() const
+    {
+        return l_ch_ == '{';
+    }
+
+    // 把 pattern 中的一个常量转换为 T, 派生类可改变常量的写法
+    virtual int Convert(std::string_view value, T& num) const
+    {
+        return gsl::check_cast(value, num);
+    }
+
+    // Merge 结果的空 checker, 派生类返回自己的类型以保留其比较方式
+    virtual TChecker* NewChecker() const
+    {
+        return new TChecker();
+    }
+
+private:
+    // 集合已在 Bind 中排序去重
+    std::vector<T> SortedValues() const
+    {
+        return std::vector<T>(values_, values_ + count_);
+    }
+
+    // 解析或合并的结果, 集合排序去重后复制到自己持有的数组
+    void Bind(std::vector<T>& values)
+    {
+        if (IsSet()) {
+            std::sort(values.begin(), values.end());
+            values.erase(std::unique(values.begin(), values.end()), values.end());
+        }
+        Own(values.data(), values.size());
+    }
+
+    // 改为持有 values 的副本, values 可以是当前的常量
+    void Own(const T* values, size_t n)
+    {
+        T* copy = n ? new T[n] : nullptr;
+        std::copy(values, values + n, copy);
+        if (!handle_) {
+            delete[] values_;
+        }
+        values_ = copy;
+        count_ = static_cast<uint32_t>(n);
+        handle_ = 0;
+    }
+
+    TChecker* MakeSet(std::vector<T> values) const
+    {
+        TChecker* c = NewChecker();
+        c->l_ch_ = '{';
+        c->r_ch_ = '}';
+        c->Bind(values);
+        return c;
+    }
+
+    TChecker* MakeInterval(char l_ch, const T& lo, const T& hi, char r_ch) const
+    {
+        TChecker* c = NewChecker();
+        c->l_ch_ = l_ch;
+        c->r_ch_ = r_ch;
+        std::vector<T> values{lo, hi};
+        c->Bind(values);
+        return c;
+    }
+
+protected:
+    template<typename U>
+    bool Check(const U& value) const
     {
         if (l_ch_ == '(' && r_ch_ == ')') {
-           return candidate_values_[0] < value && value < candidate_values_[1];
+           return values_[0] < value && value < values_[1];
         } else if (l_ch_ == '(' && r_ch_ == ']') {
-           return candidate_values_[0] < value && value <= candidate_values_[1];
+           return values_[0] < value && value <= values_[1];
         } else if (l_ch_ == '[' && r_ch_ == ']') {
-           return candidate_values_[0] <= value && value <= candidate_values_[1];
+           return values_[0] <= value && value <= values_[1];
         } else if (l_ch_ == '[' && r_ch_ == ')') {
-           return candidate_values_[0] <= value && value < candidate_values_[1];
+           return values_[0] <= value && value < values_[1];
         } else if (l_ch_ == '{' && r_ch_ == '}') {
-            for (auto& it : candidate_values_) {
-                if (it == value) {
+            // 集合有序, 较大时二分查找
+            if (count_ > 8) {
+                return std::binary_search(values_, values_ + count_, value);
+            }
+            for (uint32_t i = 0; i < count_; ++i) {
+                if (values_[i] == value) {
                     return true;
                 }
             }
@@ -167,12 +513,12 @@ public:
     }
 
 private:
-    inline bool IsMatch() 
+    inline bool IsMatch(size_t n) const
     {
         bool match = false;
         if ((l_ch_ == '(' || l_ch_ == '[') && 
             (r_ch_ == ')' || r_ch_ == ']') && 
-            candidate_values_.size() == 2) {
+            n == 2) {
            match = true; 
         } else if (l_ch_ == '{' && r_ch_ == '}') {
            match = true; 
@@ -181,10 +527,12 @@ private:
     }
 
 protected:
+    // 常量: handle_ 为 0 时是自己持有的数组, 否则在常量池中
+    const T* values_ = nullptr;
+    uint32_t count_ = 0;
+    uint32_t handle_ = 0;
     char l_ch_;
     char r_ch_;
-    std::vector<T> candidate_values_;
-    Judge judge_;
 };
 
 struct NumberCheck {
@@ -205,6 +553,12 @@ struct StringCheck {
     }
 };
 
+struct VersionCheck {
+    bool operator()(const char& c) {
+        return (c >= '0' && c <= '9') || c == '.';
+    }
+};
+
 struct WildcardCheck {
     bool operator()(const char& c) {
         return c == '*';
@@ -219,4 +573,543 @@ typedef TChecker<float, FloatCheck> FloatChecker;
 typedef TChecker<double, FloatCheck> DoubleChecker;
 typedef TChecker<std::string, StringCheck> StringChecker;
 
+/**
+* @brief 64 位整数字段 (FIELD_LONG, FIELD_ULONG) 的比较, 任意宽度的整数请求值都按数值比较
+*
+* 超出 T 的范围的值不满足区间和集合.
+*/
+template<typename T>
+class WideIntChecker : public TChecker<T, NumberCheck> {
+public:
+    static IChecker* Create()
+    {
+        return new WideIntChecker<T>();
+    }
+
+    bool IsValid(const int32_t& value) override { return CheckInt(value); }
+    bool IsValid(const uint32_t& value) override { return CheckInt(value); }
+    bool IsValid(const int64_t& value) override { return CheckInt(value); }
+    bool IsValid(const uint64_t& value) override { return CheckInt(value); }
+
+protected:
+    TChecker<T, NumberCheck>* NewChecker() const override
+    {
+        return new WideIntChecker<T>();
+    }
+
+private:
+    template<typename I>
+    bool CheckInt(I value) const
+    {
+        if constexpr (std::is_signed<I>::value && !std::is_signed<T>::value) {
+            if (value < 0) {
+                return false;
+            }
+        } else if constexpr (!std::is_signed<I>::value && std::is_signed<T>::value) {
+            if (static_cast<uint64_t>(value) > static_cast<uint64_t>(std::numeric_limits<T>::max())) {
+                return false;
+            }
+        }
+        return this->Check(static_cast<T>(value));
+    }
+};
+
+typedef WideIntChecker<int64_t> WideLongChecker;
+typedef WideIntChecker<uint64_t> WideULongChecker;
+
+/**
+* @brief 版本号: V=(12.9,12.10.3], 常量解析为打包的 64 位整数, 比较只需一次整数比较
+*
+* 常量都不带点时是旧的整数写法 (V=[1200,1300), V={120800}), 按整数比较, 不受每段 65535 的限制;
+* 此时点分的请求值按第一段比较, 后面几段不全为 0 时介于相邻两个整数之间, 如 1208 < 1208.5 < 1209.
+* 常量带点时, 请求中的整数值按只有第一段的版本号比较, 字符串值按点分版本号解析.
+*/
+class VersionChecker : public TChecker<Version, VersionCheck> {
+public:
+    static IChecker* Create()
+    {
+        return new VersionChecker();
+    }
+
+    int Parser(std::string_view pattern) override
+    {
+        legacy_ = pattern.find('.') == std::string_view::npos;
+        return TChecker::Parser(pattern);
+    }
+
+    bool IsValid(const int32_t& value) override { return CheckInt(value); }
+    bool IsValid(const uint32_t& value) override { return CheckInt(value); }
+    bool IsValid(const int64_t& value) override { return CheckInt(value); }
+    bool IsValid(const uint64_t& value) override { return CheckInt(value); }
+
+    bool IsValid(const Version& value) override
+    {
+        return Check(legacy_ ? Legacy(value) : value);
+    }
+
+    bool IsValid(const std::string& value) override
+    {
+        return CheckText(value);
+    }
+
+    bool IsValidRaw(const char* data, size_t len) override
+    {
+        return CheckText(std::string_view(data, len));
+    }
+
+    // 两种写法的常量编码不同, 不能合并
+    IChecker* Merge(const IChecker* other, bool intersect) const override
+    {
+        const VersionChecker* o = dynamic_cast<const VersionChecker*>(other);
+        if (!o || o->legacy_ != legacy_) {
+            return nullptr;
+        }
+        return TChecker::Merge(other, intersect);
+    }
+
+    std::string Describe() const override
+    {
+        if (!legacy_) {
+            return TChecker::Describe();
+        }
+        std::string s(1, l_ch_);
+        for (uint32_t i = 0; i < count_; ++i) {
+            if (i) {
+                s += ',';
+            }
+            s += std::to_string(values_[i].packed / 2);
+        }
+        s += r_ch_;
+        return s;
+    }
+
+protected:
+    int Convert(std::string_view value, Version& v) const override
+    {
+        if (!legacy_) {
+            return TChecker::Convert(value, v);
+        }
+        uint64_t n = 0;
+        if (gsl::check_cast(value, n) != 0 || n > kMaxInt) {
+            return 1;
+        }
+        v = Version(n * 2);
+        return 0;
+    }
+
+    TChecker* NewChecker() const override
+    {
+        VersionChecker* c = new VersionChecker();
+        c->legacy_ = legacy_;
+        return c;
+    }
+
+private:
+    // 整数写法的常量 n 存为 2n; 点分的值 m.x 存为 2m, 后面几段不全为 0 时为 2m + 1
+    static constexpr uint64_t kMaxInt = UINT64_MAX / 2;
+
+    static Version Legacy(const Version& v)
+    {
+        uint64_t major = v.packed >> 48;
+        return Version(major * 2 + ((v.packed & 0xffffffffffffULL) != 0));
+    }
+
+    template<typename I>
+    bool CheckInt(I value) const
+    {
+        if constexpr (std::is_signed<I>::value) {
+            if (value < 0) {
+                return false;
+            }
+        }
+        if (legacy_) {
+            return static_cast<uint64_t>(value) <= kMaxInt && Check(Version(static_cast<uint64_t>(value) * 2));
+        }
+        Version v;
+        return static_cast<uint64_t>(value) <= 0xffff && Version::FromInt(static_cast<int64_t>(value), v) && Check(v);
+    }
+
+    bool CheckText(std::string_view s) const
+    {
+        uint64_t n = 0;
+        if (legacy_ && gsl::check_cast(s, n) == 0) {
+            return n <= kMaxInt && Check(Version(n * 2));
+        }
+        Version v;
+        return Version::Parse(s, v) == 0 && Check(legacy_ ? Legacy(v) : v);
+    }
+
+private:
+    bool legacy_ = false;
+};
+
+/**
+* @brief 地址前缀集合: CIDR={10.0.0.0/8,192.168.1.0/24,2001:db8::/32}, 地址在任一网段内时满足
+*
+* 前缀编译为 PrefixTrie, 查询代价与前缀个数无关. 加入规则集后改用规则集内同一属性上
+* 所有叶子共用的 PrefixIndex (见 RuleSet::indexPrefixes), 自己的树随之释放.
+*/
+class CidrChecker : public IChecker {
+public:
+    static IChecker* Create()
+    {
+        return new CidrChecker();
+    }
+
+    int Parser(std::string_view pattern) override
+    {
+        if (pattern.size() < 2 || pattern.front() != '{' || pattern.back() != '}') {
+            return 1;
+        }
+        std::string_view body = pattern.substr(1, pattern.size() - 2);
+        while (!body.empty()) {
+            size_t comma = body.find(',');
+            std::string_view item = body.substr(0, comma);
+            IpPrefix prefix;
+            if (IpPrefix::Parse(item, prefix) != 0) {
+                return 1;
+            }
+            prefixes_.push_back(prefix);
+            body = comma == std::string_view::npos ? std::string_view() : body.substr(comma + 1);
+        }
+        Build();
+        return 0;
+    }
+
+    bool IsValid(const IpAddr& value) override
+    {
+        return Check(value);
+    }
+
+    bool IsValid(const std::string& value) override
+    {
+        IpAddr addr;
+        return IpAddr::Parse(value, addr) == 0 && Check(addr);
+    }
+
+    bool IsValidRaw(const char* data, size_t len) override
+    {
+        IpAddr addr;
+        return IpAddr::Parse(std::string_view(data, len), addr) == 0 && Check(addr);
+    }
+
+    // 只合并并集, 交集一般无法用一组前缀表示
+    IChecker* Merge(const IChecker* other, bool intersect) const override
+    {
+        const CidrChecker* o = dynamic_cast<const CidrChecker*>(other);
+        if (!o || intersect) {
+            return nullptr;
+        }
+        CidrChecker* c = new CidrChecker();
+        c->prefixes_ = prefixes_;
+        c->prefixes_.insert(c->prefixes_.end(), o->prefixes_.begin(), o->prefixes_.end());
+        c->Build();
+        return c;
+    }
+
+    bool IsEmpty() const override
+    {
+        return prefixes_.empty();
+    }
+
+    std::string Describe() const override
+    {
+        std::string s = "{";
+        for (size_t i = 0; i < prefixes_.size(); ++i) {
+            if (i) {
+                s += ',';
+            }
+            s += prefixes_[i].ToString();
+        }
+        return s + "}";
+    }
+
+    const std::vector<IpPrefix>& Prefixes() const
+    {
+        return prefixes_;
+    }
+
+    // 不含前缀树; 规则集建立共享索引后自己的树已清空
+    size_t Footprint() const override
+    {
+        return sizeof(*this) + prefixes_.capacity() * sizeof(IpPrefix);
+    }
+
+    // 改用共享索引, label 为本叶子在索引中的编号
+    void Attach(const PrefixIndex* index, uint32_t label)
+    {
+        index_ = index;
+        label_ = label;
+        trie_.clear();
+    }
+
+private:
+    // 前缀排序去重后建树
+    void Build()
+    {
+        std::sort(prefixes_.begin(), prefixes_.end());
+        prefixes_.erase(std::unique(prefixes_.begin(), prefixes_.end()), prefixes_.end());
+        std::vector<PrefixTrie::Entry> entries;
+        for (const auto& p : prefixes_) {
+            entries.push_back(PrefixTrie::Entry{p, 0});
+        }
+        trie_.build(entries);
+    }
+
+    inline bool Check(const IpAddr& addr) const
+    {
+        return index_ ? index_->contains(addr, label_) : trie_.lookup(addr) != 0;
+    }
+
+private:
+    std::vector<IpPrefix> prefixes_;
+    PrefixTrie trie_;
+    const PrefixIndex* index_ = nullptr;
+    uint32_t label_ = 0;
+};
+
+enum ClockField {
+    CLOCK_TIME,
+    CLOCK_HOUR,
+    CLOCK_WDAY,
+};
+
+/**
+* @brief 时间窗口: TIME 为 epoch 秒, HOUR 为本地小时 0-23, WDAY 为星期 0-6 (0 为星期日)
+*
+* 例如 TIME=[1700000000,1700600000) HOUR=[9,18) WDAY={1,2,3,4,5}
+*/
+template<ClockField F>
+class TimeChecker : public TChecker<int64_t, NumberCheck> {
+public:
+    static IChecker* Create()
+    {
+        CoarseClock::start();
+        return new TimeChecker<F>();
+    }
+
+    bool IsClock() const override
+    {
+        return true;
+    }
+
+    bool IsValidNow() override
+    {
+        return Check(Now());
+    }
+
+    // 合并会丢失时间语义
+    IChecker* Merge(const IChecker* other, bool intersect) const override
+    {
+        return nullptr;
+    }
+
+    bool Window(int64_t& from, int64_t& until) const override
+    {
+        if (F != CLOCK_TIME || IsSet()) {
+            return false;
+        }
+        // 端点为 INT64_MAX 时不再加一
+        const int64_t max = std::numeric_limits<int64_t>::max();
+        from = l_ch_ == '(' && values_[0] < max ? values_[0] + 1 : values_[0];
+        until = r_ch_ == ']' && values_[1] < max ? values_[1] + 1 : values_[1];
+        return true;
+    }
+
+private:
+    static inline int64_t Now()
+    {
+        if constexpr (F == CLOCK_TIME) {
+            return CoarseClock::now();
+        } else if constexpr (F == CLOCK_HOUR) {
+            return CoarseClock::hour();
+        } else {
+            return CoarseClock::wday();
+        }
+    }
+};
+
+/**
+* @brief 外部名单: U=@file:vip_users, 值 (数值按十进制文本) 在名单中时满足
+*
+* 名单由 ListRegistry 加载并在所有规则间共享, 重新加载名单不需要重新编译规则.
+*/
+class ListChecker : public IChecker {
+public:
+    static constexpr std::string_view kPrefix = "@file:";
+
+    static bool IsListPattern(std::string_view pattern)
+    {
+        return pattern.substr(0, kPrefix.size()) == kPrefix;
+    }
+
+    int Parser(std::string_view pattern) override
+    {
+        if (!IsListPattern(pattern)) {
+            return 1;
+        }
+        name_ = std::string(pattern.substr(kPrefix.size()));
+        slot_ = ListRegistry::instance().acquire(name_);
+        return slot_ ? 0 : 1;
+    }
+
+    bool IsValid(const int32_t& value) override { return CheckNumber(value); }
+    bool IsValid(const uint32_t& value) override { return CheckNumber(value); }
+    bool IsValid(const int64_t& value) override { return CheckNumber(value); }
+    bool IsValid(const uint64_t& value) override { return CheckNumber(value); }
+
+    bool IsValid(const std::string& value) override
+    {
+        return slot_->contains(value.data(), value.size());
+    }
+
+    bool IsValidRaw(const char* data, size_t len) override
+    {
+        return slot_->contains(data, len);
+    }
+
+    std::string Describe() const override
+    {
+        return std::string(kPrefix) + name_;
+    }
+
+    size_t Footprint() const override
+    {
+        return sizeof(*this);
+    }
+
+    // 名单可以重新加载, 结果不能按属性值缓存
+    bool IsVolatile() const override
+    {
+        return true;
+    }
+
+private:
+    template<typename T>
+    bool CheckNumber(T value)
+    {
+        char buf[24];
+        auto res = std::to_chars(buf, buf + sizeof(buf), value);
+        return slot_->contains(buf, res.ptr - buf);
+    }
+
+private:
+    std::string name_;
+    const ListSlot* slot_ = nullptr;
+};
+
+/**
+* @brief 事件频率: COUNT(login,U,600)=[0,5), 属性 U 的取值最近 600 秒内 login 事件少于 5 次时满足
+*
+* 事件由调用方通过 CounterStore::instance().add(event, value) 记录, 数值属性按十进制文本作为 key.
+* 窗口可带 s/m/h 后缀, 不能超过 CounterStore::maxWindow(); 右边使用普通的区间或集合写法.
+*/
+class CountChecker : public TChecker<int64_t, NumberCheck> {
+public:
+    static constexpr std::string_view kPrefix = "COUNT(";
+
+    static bool IsCountHead(std::string_view head)
+    {
+        return head.substr(0, kPrefix.size()) == kPrefix;
+    }
+
+    CountChecker():
+    store_(&CounterStore::instance())
+    {
+    }
+
+    /**
+    * @brief 解析等号左边的 COUNT(event,ATTR,window)
+    *
+    * @param attr 计数所按的属性名
+    *
+    * @return 0 success, 1 error for format
+    */
+    int ParseHead(std::string_view head, std::string& attr)
+    {
+        if (!IsCountHead(head) || head.back() != ')') {
+            return 1;
+        }
+        head = head.substr(kPrefix.size(), head.size() - kPrefix.size() - 1);
+        size_t c1 = head.find(',');
+        size_t c2 = c1 == std::string_view::npos ? c1 : head.find(',', c1 + 1);
+        if (c2 == std::string_view::npos || c1 == 0 || c2 == c1 + 1) {
+            return 1;
+        }
+        std::string_view window = head.substr(c2 + 1);
+        uint32_t unit = 1;
+        if (!window.empty() && (window.back() == 's' || window.back() == 'm' || window.back() == 'h')) {
+            unit = window.back() == 'h' ? 3600 : window.back() == 'm' ? 60 : 1;
+            window.remove_suffix(1);
+        }
+        uint32_t n = 0;
+        auto res = std::from_chars(window.data(), window.data() + window.size(), n);
+        if (window.empty() || res.ec != std::errc() || res.ptr != window.data() + window.size() ||
+            n == 0 || n > store_->maxWindow() / unit) {
+            return 1;
+        }
+        event_.assign(head.data(), c1);
+        attr.assign(head.data() + c1 + 1, c2 - c1 - 1);
+        window_ = n * unit;
+        return 0;
+    }
+
+    bool IsValid(const int32_t& value) override { return CheckNumber(value); }
+    bool IsValid(const uint32_t& value) override { return CheckNumber(value); }
+    bool IsValid(const int64_t& value) override { return CheckNumber(value); }
+    bool IsValid(const uint64_t& value) override { return CheckNumber(value); }
+
+    bool IsValid(const std::string& value) override
+    {
+        return CheckKey(value);
+    }
+
+    bool IsValidRaw(const char* data, size_t len) override
+    {
+        return CheckKey(std::string_view(data, len));
+    }
+
+    // 不同事件或窗口的计数不能合并
+    IChecker* Merge(const IChecker* other, bool intersect) const override
+    {
+        return nullptr;
+    }
+
+    // 带上事件和窗口, 避免化简时被当作同一叶子去重
+    std::string Describe() const override
+    {
+        return std::string(kPrefix) + event_ + "," + std::to_string(window_) + ")" +
+               TChecker<int64_t, NumberCheck>::Describe();
+    }
+
+    bool IsVolatile() const override
+    {
+        return true;
+    }
+
+    size_t Footprint() const override
+    {
+        return TChecker<int64_t, NumberCheck>::Footprint() + sizeof(*this) - sizeof(TChecker<int64_t, NumberCheck>);
+    }
+
+private:
+    template<typename T>
+    bool CheckNumber(T value)
+    {
+        char buf[24];
+        auto res = std::to_chars(buf, buf + sizeof(buf), value);
+        return CheckKey(std::string_view(buf, res.ptr - buf));
+    }
+
+    bool CheckKey(std::string_view key) const
+    {
+        return Check(static_cast<int64_t>(store_->count(event_, key, window_)));
+    }
+
+private:
+    CounterStore* store_;
+    std::string event_;
+    uint32_t window_ = 0;
+};
+
 } //end namespace route
@@ -0,0 +1,102 @@
+/*
+ * dlog_decode: 读取 DecisionLog 写出的段文件
+ *
+ * 按文件顺序输出每条记录: "<time>\t<key>\t<version>\t<rule id>,<rule id>,..."
+ * time 为本地时间, key 为 16 位十六进制. 文件损坏或不完整时输出已读到的记录并报告原因.
+ *
+ * usage: dlog_decode [-s] [-k key] [-v version] file...
+ *
+ * -s 只输出汇总: 每条规则的命中数 "<rule id>\t<count>", 以及总记录数和未命中的记录数
+ * -k/-v 只看指定 key (十六进制) 或规则集版本的记录
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+
+#include "DecisionLog.h"
+
+using namespace route;
+
+int main(int argc, char* argv[])
+{
+    bool summary = false;
+    bool by_key = false;
+    bool by_version = false;
+    uint64_t key = 0;
+    uint32_t version = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "sk:v:h")) != -1) {
+        switch (opt) {
+            case 's': summary = true; break;
+            case 'k': by_key = true; key = strtoull(optarg, NULL, 16); break;
+            case 'v': by_version = true; version = strtoul(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "usage: %s [-s] [-k key] [-v version] file...\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-s] [-k key] [-v version] file...\n", argv[0]);
+        return 1;
+    }
+
+    std::map<uint32_t, uint64_t> counts;
+    uint64_t records = 0;
+    uint64_t misses = 0;
+    int ret = 0;
+    Decision d;
+    std::string line;
+    for (int i = optind; i < argc; ++i) {
+        DecisionLogReader reader;
+        if (!reader.open(argv[i])) {
+            fprintf(stderr, "%s: %s\n", argv[i], reader.error().c_str());
+            ret = 1;
+            continue;
+        }
+        while (reader.next(d)) {
+            if ((by_key && d.key != key) || (by_version && d.version != version)) {
+                continue;
+            }
+            ++records;
+            if (summary) {
+                misses += d.ids.empty();
+                for (auto id : d.ids) {
+                    ++counts[id];
+                }
+                continue;
+            }
+            char head[96];
+            time_t t = d.time;
+            struct tm tm;
+            localtime_r(&t, &tm);
+            size_t n = strftime(head, sizeof(head), "%Y-%m-%d %H:%M:%S", &tm);
+            snprintf(head + n, sizeof(head) - n, "\t%016llx\t%u\t", static_cast<unsigned long long>(d.key),
+                     d.version);
+            line = head;
+            for (size_t k = 0; k < d.ids.size(); ++k) {
+                if (k) {
+                    line += ',';
+                }
+                line += std::to_string(d.ids[k]);
+            }
+            line += '\n';
+            fwrite(line.data(), 1, line.size(), stdout);
+        }
+        if (!reader.error().empty()) {
+            fprintf(stderr, "%s: %s\n", argv[i], reader.error().c_str());
+            ret = 1;
+        }
+    }
+    if (summary) {
+        for (const auto& kv : counts) {
+            printf("%u\t%llu\n", kv.first, static_cast<unsigned long long>(kv.second));
+        }
+        printf("records\t%llu\nmisses\t%llu\n", static_cast<unsigned long long>(records),
+               static_cast<unsigned long long>(misses));
+    }
+    return ret;
+}
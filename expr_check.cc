@@ -0,0 +1,85 @@
+/*
+ * expr_check: 表达式化简的自检
+ *
+ * 对照化简前后的求值结果, 检查只有比较方式相同的叶子才会被合并. 全部通过时输出 "ok" 并返回 0,
+ * 否则输出第一处不符并返回 1.
+ *
+ * usage: expr_check
+ */
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "xExpression.h"
+
+using namespace route;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "expr_check:%d: %s: ", __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+// 化简前后对 values 的求值结果应相同, 返回化简说明的条数
+static int compare(const std::string& exp, const std::map<std::string, Variant>& values, bool expect,
+                   size_t& merges)
+{
+    ASTExp* plain = XExpression::compile(exp);
+    ASTExp* optimized = XExpression::compile(exp);
+    CHECK(plain && optimized, "compile failed: %s", exp.c_str());
+    std::vector<std::string> report;
+    optimized->optimize(&report);
+    merges = 0;
+    for (const auto& line : report) {
+        merges += line.compare(0, 6, "merge ") == 0;
+    }
+    bool before = plain->evaluate(values);
+    bool after = optimized->evaluate(values);
+    SAFE_RELEASE(plain);
+    SAFE_RELEASE(optimized);
+    CHECK(before == expect, "%s: %d before optimize", exp.c_str(), before);
+    CHECK(after == expect, "%s: %d after optimize (%zu merges)", exp.c_str(), after, merges);
+    return 0;
+}
+
+int main()
+{
+    CHECK(Schema::instance().define("big", FIELD_LONG).valid(), "define big");
+    std::map<std::string, Variant> values;
+    values["big"] = Variant(static_cast<int64_t>(5));
+    values["P"] = Variant(7);
+
+    // COUNT 叶子与同一属性上的普通叶子比较的对象不同, 两种顺序都不能合并
+    size_t merges = 0;
+    const char* count_exps[] = {
+        "big=[1,10] && COUNT(expr_check,big,60)=[0,2]",
+        "COUNT(expr_check,big,60)=[0,2] && big=[1,10]",
+        "big=[1,10] || COUNT(expr_check,big,60)=[3,5]",
+        "COUNT(expr_check,big,60)=[3,5] || big=[1,10]",
+    };
+    for (const char* exp : count_exps) {
+        if (compare(exp, values, true, merges)) {
+            return 1;
+        }
+        CHECK(merges == 0, "%s: %zu merges", exp, merges);
+    }
+
+    // 比较方式相同的叶子照常合并
+    if (compare("P=[1,10] && P=[5,20]", values, true, merges)) {
+        return 1;
+    }
+    CHECK(merges == 1, "P ranges: %zu merges", merges);
+    if (compare("big=[1,6] || big=[5,9]", values, true, merges)) {
+        return 1;
+    }
+    CHECK(merges == 1, "big ranges: %zu merges", merges);
+
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * live_check: LiveRuleSet 增删改和整理的自检
+ *
+ * 反复替换和删除规则, 每一步对照期望的命中结果, 并检查常量池在规则更替后复用空间而不是一直增长,
+ * 整理分段前后结果不变, load 只重新编译有变化的规则. 全部通过时输出 "ok" 并返回 0,
+ * 否则输出第一处不符并返回 1.
+ *
+ * usage: live_check [-r rules] [-k rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "LiveRuleSet.h"
+
+using namespace route;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "live_check:%d: %s: ", __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+// 第 round 轮的规则 id: A 取两个本轮独有的值, E 为本轮共用的值
+static std::string makeRule(uint32_t id, int round)
+{
+    int base = round * 100000 + static_cast<int>(id) * 2;
+    return "A={" + std::to_string(base) + "," + std::to_string(base + 1) + "} && E={r" +
+           std::to_string(round) + "}";
+}
+
+static std::vector<uint32_t> evaluate(const LiveRuleSet& rules, int a, int round)
+{
+    std::map<std::string, Variant> values;
+    values["A"] = Variant(a);
+    values["E"] = Variant("r" + std::to_string(round));
+    std::vector<uint32_t> matched;
+    rules.evaluate(values, matched);
+    return matched;
+}
+
+// 规则 id 在第 round 轮的内容下应当且只有它命中
+static int checkRule(const LiveRuleSet& rules, uint32_t id, int round, bool present)
+{
+    std::vector<uint32_t> matched = evaluate(rules, round * 100000 + static_cast<int>(id) * 2 + 1, round);
+    if (present) {
+        CHECK(matched.size() == 1 && matched[0] == id, "rule %u round %d: %zu matches", id, round, matched.size());
+    } else {
+        CHECK(matched.empty(), "removed rule %u still matches", id);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t n = 500;
+    int rounds = 50;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:k:h")) != -1) {
+        switch (opt) {
+            case 'r': n = static_cast<uint32_t>(atoi(optarg)); break;
+            case 'k': rounds = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-r rules] [-k rounds]\n", argv[0]);
+                return 1;
+        }
+    }
+    CHECK(n >= 4 && rounds >= 2, "need at least 4 rules and 2 rounds");
+
+    LiveRuleSet rules;
+    for (uint32_t id = 1; id <= n; ++id) {
+        CHECK(rules.upsert(id, makeRule(id, 0), static_cast<int32_t>(id % 7)), "upsert %u", id);
+    }
+    CHECK(!rules.upsert(n + 1, "A={1"), "bad expression accepted");
+    CHECK(rules.snapshot()->size() == n, "%zu rules", rules.snapshot()->size());
+    for (uint32_t id = 1; id <= n; ++id) {
+        if (checkRule(rules, id, 0, true)) {
+            return 1;
+        }
+    }
+
+    // 每轮替换全部规则的常量, 常量池应复用上一轮释放的列表
+    PoolStats first;
+    for (int round = 1; round <= rounds; ++round) {
+        for (uint32_t id = 1; id <= n; ++id) {
+            CHECK(rules.upsert(id, makeRule(id, round), static_cast<int32_t>(id % 7)), "upsert %u", id);
+        }
+        for (uint32_t id = 1; id <= n; id += n / 4) {
+            if (checkRule(rules, id, round, true)) {
+                return 1;
+            }
+        }
+        CHECK(evaluate(rules, (round - 1) * 100000 + 3, round - 1).empty(), "old constants still match");
+        PoolStats s = rules.memoryStats();
+        CHECK(s.lists == n + 1, "round %d: %zu lists in use, expected %u", round, s.lists, n + 1);
+        if (round == 1) {
+            first = s;
+        }
+        CHECK(s.stored_bytes + s.free_bytes <= first.stored_bytes + first.free_bytes,
+              "round %d: pool grew from %zu to %zu bytes", round, first.stored_bytes + first.free_bytes,
+              s.stored_bytes + s.free_bytes);
+    }
+
+    // 删除四分之三, 段变碎后整理, 结果不变
+    std::set<uint32_t> removed;
+    for (uint32_t id = 1; id <= n; ++id) {
+        if (id % 4) {
+            CHECK(rules.remove(id), "remove %u", id);
+            removed.insert(id);
+        }
+    }
+    CHECK(!rules.remove(1), "removed twice");
+    size_t before = rules.stats().segments;
+    rules.compact();
+    LiveStats st = rules.stats();
+    CHECK(st.rules == n - removed.size(), "%zu rules after remove", st.rules);
+    CHECK(st.segments <= before && st.segments <= (st.rules + LiveRuleSet::kSegmentRules - 1) /
+          LiveRuleSet::kSegmentRules + 1, "%zu segments for %zu rules", st.segments, st.rules);
+    for (uint32_t id = 1; id <= n; ++id) {
+        if (checkRule(rules, id, rounds, !removed.count(id))) {
+            return 1;
+        }
+    }
+    PoolStats s = rules.memoryStats();
+    CHECK(s.lists == st.rules + 1 && s.references == st.rules * 2, "%zu lists, %zu references for %zu rules",
+          s.lists, s.references, st.rules);
+
+    // load 只编译文本有变化的规则, 删除文件中没有的规则
+    char path[] = "/tmp/live_check.XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0, "mkstemp failed");
+    FILE* f = fdopen(fd, "w");
+    uint32_t changed = 0;
+    for (uint32_t id = 4; id <= n; id += 4) {
+        bool edit = id % 8 == 0;
+        changed += edit;
+        fprintf(f, "%u:%u %s\n", id, id % 7, makeRule(id, edit ? rounds + 1 : rounds).c_str());
+    }
+    fprintf(f, "%u %s\n", n + 1, makeRule(n + 1, rounds + 1).c_str());
+    fclose(f);
+    uint64_t compiled = rules.stats().compiled;
+    bool loaded = rules.load(path);
+    unlink(path);
+    CHECK(loaded, "load failed");
+    CHECK(rules.stats().compiled - compiled == changed + 1, "%llu rules compiled, expected %u",
+          static_cast<unsigned long long>(rules.stats().compiled - compiled), changed + 1);
+    for (uint32_t id = 4; id <= n; id += 4) {
+        if (checkRule(rules, id, id % 8 == 0 ? rounds + 1 : rounds, true)) {
+            return 1;
+        }
+    }
+    if (checkRule(rules, n + 1, rounds + 1, true)) {
+        return 1;
+    }
+    printf("ok: %u rules, %d rounds, %zu lists, %zu free\n", n, rounds, rules.memoryStats().lists,
+           rules.memoryStats().free_lists);
+    return 0;
+}
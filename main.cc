@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include "xExpression.h"
+#include "ResultCache.h"
+#include "Tracer.h"
 #include <thread>
 #include <time.h>
 
@@ -25,7 +27,7 @@ int getVersion()
   return vers[i];
 }
 
-void test(ASTExp* ast)
+void test(ASTExp* ast, ExpressionCache* cache)
 {
     for (int i=0; i < 100000; ++i) {
       std::map<std::string, Variant> m ;
@@ -33,7 +35,7 @@ void test(ASTExp* ast)
       m["P"] = Variant((int)i%2);
       m["A"] = Variant((int)i%2);
       m["E"] = Variant("abtest");
-      if (ast->evaluate(m)) {
+      if (cache->evaluate(m)) {
         printf("\033[1;92m succ. %s %s\033[0m\n", Debug(m).c_str(), ast->getExp().c_str());
       } else {
         printf("\033[1;91m failed. %s %s\033[0m\n", Debug(m).c_str(), ast->getExp().c_str());
@@ -44,6 +46,11 @@ void test(ASTExp* ast)
 int main()
 {
     srand(time(NULL));
+    // TRACE_RATE=N: 每 N 次求值记录一次求值路径, 结束时输出到 stderr
+    const char* rate = getenv("TRACE_RATE");
+    if (rate) {
+        Tracer::setSampleRate(atoi(rate));
+    }
    std::string exp = "V=(1206,1209] && P={1}  && A={1} && E={abtest}";
     ASTExp* ast = XExpression::compile(exp);
     if (!ast) {
@@ -52,13 +59,19 @@ int main()
     } else {
         printf("\033[1;92m compile succ.\n\033[0m");
     }
+    ExpressionCache cache(ast, 1024);
     std::thread ths[10];
     for (int i=0; i < 10; ++i) {
-     ths[i] = std::thread(test, ast);
+     ths[i] = std::thread(test, ast, &cache);
     }
     for (int i=0; i < 10; ++i) {
       ths[i].join();
     }
+    printf("cache hits %llu misses %llu\n",
+           (unsigned long long)cache.cache().hits(), (unsigned long long)cache.cache().misses());
+    if (rate) {
+        Tracer::dump(stderr);
+    }
     delete ast;
     return 0;
 }
@@ -0,0 +1,361 @@
+/*
+ * replay: 在请求日志上回放规则文件
+ *
+ * 每行一条记录, 格式同 QUERY_STRING ("V=1208&P=1&E=abtest"), 分隔符可用 -F/-K 修改.
+ * 文件用 mmap 读取, 标准输入按块读取; 输入切成以行结尾的块, 由线程池并行求值,
+ * 结果按块的顺序输出, 与线程数无关.
+ *
+ * usage: replay -r rules.conf [-t threads] [-b block_kb] [-o] [-F pair_sep] [-K kv_sep] [file|-]
+ *
+ * 默认输出每条规则的命中数: "<rule id>\t<count>\t<expression>"
+ * -o 输出每次命中: "<record offset>\t<rule id>", offset 为记录首字节在输入中的偏移
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "RuleSet.h"
+#include "CoarseClock.h"
+
+using namespace route;
+
+struct Chunk {
+    // 记录在输入中的起始偏移
+    uint64_t base;
+    const char* data;
+    size_t len;
+    // 从标准输入读到的块自己持有内存
+    std::vector<char> owned;
+    uint64_t records;
+    std::vector<uint64_t> counts;
+    std::vector<std::pair<uint64_t, uint32_t>> hits;
+    bool done;
+};
+
+/**
+ * @brief 固定线程数的块求值流水线
+ *
+ * 主线程 submit 块并按提交顺序取回结果, 在途的块数有上限, 内存占用与输入大小无关.
+ */
+class Replayer {
+public:
+    Replayer(const RuleSet& rules, const BufferFormat& format, int threads, bool offsets):
+    _rules(rules),
+    _format(format),
+    _offsets(offsets),
+    _limit(threads * 2),
+    _stop(false),
+    _counts(rules.size(), 0),
+    _records(0)
+    {
+        for (int i = 0; i < threads; ++i) {
+            _workers.emplace_back(&Replayer::work, this);
+        }
+    }
+
+    ~Replayer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _ready.notify_all();
+        for (auto& t : _workers) {
+            t.join();
+        }
+    }
+
+    void submit(Chunk* c)
+    {
+        c->done = false;
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_inflight.size() >= _limit) {
+            drainFront(lock);
+        }
+        _inflight.push_back(c);
+        _pending.push_back(c);
+        _ready.notify_one();
+    }
+
+    void finish()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_inflight.empty()) {
+            drainFront(lock);
+        }
+    }
+
+    uint64_t records() const { return _records; }
+    const std::vector<uint64_t>& counts() const { return _counts; }
+
+private:
+    // 等最早提交的块完成后输出并释放
+    void drainFront(std::unique_lock<std::mutex>& lock)
+    {
+        Chunk* c = _inflight.front();
+        _done.wait(lock, [c]() { return c->done; });
+        _inflight.pop_front();
+        lock.unlock();
+        _records += c->records;
+        for (size_t i = 0; i < _counts.size(); ++i) {
+            _counts[i] += c->counts[i];
+        }
+        for (const auto& h : c->hits) {
+            printf("%llu\t%u\n", (unsigned long long)h.first, h.second);
+        }
+        delete c;
+        lock.lock();
+    }
+
+    void work()
+    {
+        RequestBuffer buffer(nullptr, 0, _format);
+        for (;;) {
+            Chunk* c = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _ready.wait(lock, [this]() { return _stop || !_pending.empty(); });
+                if (_pending.empty()) {
+                    return;
+                }
+                c = _pending.front();
+                _pending.pop_front();
+            }
+            process(c, buffer);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                c->done = true;
+            }
+            _done.notify_all();
+        }
+    }
+
+    void process(Chunk* c, RequestBuffer& buffer)
+    {
+        c->records = 0;
+        c->counts.assign(_rules.size(), 0);
+        int64_t now = CoarseClock::now();
+        const char* p = c->data;
+        const char* end = c->data + c->len;
+        while (p < end) {
+            const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+            const char* eol = nl ? nl : end;
+            size_t len = eol - p;
+            if (len && p[len - 1] == '\r') {
+                --len;
+            }
+            if (len) {
+                ++c->records;
+                buffer.reset(p, len);
+                for (size_t i = 0; i < _rules.size(); ++i) {
+                    const Rule& r = _rules.rule(i);
+                    if (r.active(now) && r.exp->evaluate(buffer)) {
+                        ++c->counts[i];
+                        if (_offsets) {
+                            c->hits.emplace_back(c->base + (p - c->data), r.id);
+                        }
+                    }
+                }
+            }
+            p = eol + 1;
+        }
+    }
+
+private:
+    const RuleSet& _rules;
+    BufferFormat _format;
+    bool _offsets;
+    size_t _limit;
+    bool _stop;
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    std::condition_variable _done;
+    std::deque<Chunk*> _pending;
+    std::deque<Chunk*> _inflight;
+    std::vector<std::thread> _workers;
+    // 只由主线程访问
+    std::vector<uint64_t> _counts;
+    uint64_t _records;
+};
+
+// 文件整体映射, 按约 block 字节切分, 块在换行处结束
+static bool replayFile(const char* path, size_t block, Replayer& replayer, uint64_t& bytes)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "stat %s failed: %s\n", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    bytes = st.st_size;
+    if (bytes == 0) {
+        close(fd);
+        return true;
+    }
+    void* addr = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "mmap %s failed: %s\n", path, strerror(errno));
+        return false;
+    }
+    madvise(addr, bytes, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(addr);
+    size_t pos = 0;
+    while (pos < bytes) {
+        size_t end = std::min<size_t>(bytes, pos + block);
+        if (end < bytes) {
+            const char* nl = static_cast<const char*>(memchr(data + end, '\n', bytes - end));
+            end = nl ? nl - data + 1 : bytes;
+        }
+        Chunk* c = new Chunk();
+        c->base = pos;
+        c->data = data + pos;
+        c->len = end - pos;
+        replayer.submit(c);
+        pos = end;
+    }
+    replayer.finish();
+    munmap(addr, bytes);
+    return true;
+}
+
+// 标准输入按块读取, 不完整的最后一行移到下一块
+static bool replayStdin(size_t block, Replayer& replayer, uint64_t& bytes)
+{
+    std::vector<char> carry;
+    bytes = 0;
+    for (;;) {
+        Chunk* c = new Chunk();
+        c->owned.swap(carry);
+        size_t used = c->owned.size();
+        c->owned.resize(std::max(block, used * 2));
+        bool eof = false;
+        while (used < c->owned.size()) {
+            ssize_t n = read(STDIN_FILENO, c->owned.data() + used, c->owned.size() - used);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                fprintf(stderr, "read stdin failed: %s\n", strerror(errno));
+                delete c;
+                return false;
+            }
+            if (n == 0) {
+                eof = true;
+                break;
+            }
+            used += n;
+        }
+        size_t keep = used;
+        if (!eof) {
+            while (keep > 0 && c->owned[keep - 1] != '\n') {
+                --keep;
+            }
+            if (keep == 0) {
+                // 一行超过块大小, 下一轮用更大的块
+                carry.assign(c->owned.begin(), c->owned.begin() + used);
+                delete c;
+                continue;
+            }
+            carry.assign(c->owned.begin() + keep, c->owned.begin() + used);
+        }
+        c->owned.resize(keep);
+        c->base = bytes;
+        c->data = c->owned.data();
+        c->len = keep;
+        bytes += keep;
+        if (keep) {
+            replayer.submit(c);
+        } else {
+            delete c;
+        }
+        if (eof) {
+            break;
+        }
+    }
+    replayer.finish();
+    return true;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s -r rules [-t threads] [-b block_kb] [-o] [-F pair_sep] [-K kv_sep] [file|-]\n",
+            prog);
+}
+
+int main(int argc, char* argv[])
+{
+    std::string rules_path;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t block = 4 << 20;
+    bool offsets = false;
+    char pair_sep = '&';
+    char kv_sep = '=';
+    int opt;
+    while ((opt = getopt(argc, argv, "r:t:b:oF:K:h")) != -1) {
+        switch (opt) {
+            case 'r': rules_path = optarg; break;
+            case 't': threads = atoi(optarg); break;
+            case 'b': block = static_cast<size_t>(atol(optarg)) << 10; break;
+            case 'o': offsets = true; break;
+            case 'F': pair_sep = optarg[0] == '\\' && optarg[1] == 't' ? '\t' : optarg[0]; break;
+            case 'K': kv_sep = optarg[0]; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (rules_path.empty() || threads <= 0 || block == 0 || optind + 1 < argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char* input = optind < argc ? argv[optind] : "-";
+
+    RuleSet rules;
+    if (!rules.load(rules_path)) {
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint64_t bytes = 0;
+    bool ok;
+    Replayer replayer(rules, BufferFormat::QueryString(pair_sep, kv_sep), threads, offsets);
+    if (strcmp(input, "-") == 0) {
+        ok = replayStdin(block, replayer, bytes);
+    } else {
+        ok = replayFile(input, block, replayer, bytes);
+    }
+    if (!ok) {
+        return 1;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!offsets) {
+        for (size_t i = 0; i < rules.size(); ++i) {
+            printf("%u\t%llu\t%s\n", rules.rule(i).id, (unsigned long long)replayer.counts()[i],
+                   rules.rule(i).exp->getExp().c_str());
+        }
+    }
+    fflush(stdout);
+    fprintf(stderr, "%llu records, %.1f MB, %zu rules, %d threads in %.3f s: %.0f records/s, %.1f MB/s\n",
+            (unsigned long long)replayer.records(), bytes / 1048576.0, rules.size(), threads, secs,
+            replayer.records() / secs, bytes / 1048576.0 / secs);
+    return 0;
+}
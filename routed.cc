@@ -0,0 +1,392 @@
+/*
+ * routed: 本地规则求值服务
+ *
+ * 加载规则文件, 在 Unix domain socket 上以 epoll 处理 Protocol.h 中定义的二进制请求,
+ * 返回命中的规则 id. 一次读到的多个请求作为一批求值, 响应合并为一次写出.
+ * 收到 SIGHUP 时重新加载规则文件, 加载失败则继续使用旧规则.
+ * 收到 SIGUSR1 时只重新加载规则引用的外部名单 (@file:name), 不重新编译规则.
+ * 指定 -d 时每个请求的命中结果写入决策日志 <prefix>.*.dlog, key 为请求属性部分的哈希,
+ * 版本为规则文件的加载次数.
+ *
+ * usage: routed -r rules.conf [-s /tmp/routed.sock] [-a V,P,A,L,E] [-l list_dir] [-d log_prefix]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "RuleSet.h"
+#include "Protocol.h"
+#include "DecisionLog.h"
+
+using namespace route;
+
+struct Connection {
+    int fd;
+    std::string in;
+    std::string out;
+    size_t out_off;
+    // 对端已关闭写端, 发完剩余响应后关闭
+    bool eof;
+    Connection(): fd(-1), out_off(0), eof(false) {}
+};
+
+// 一次读取期间输入缓冲的上限, 超过时先处理已收到的请求; 处理后仍超过说明帧不完整且过大, 关闭连接
+static const size_t kMaxInputBuffer = 4 * (proto::kMaxFrameSize + sizeof(uint32_t));
+// 未发出的响应超过此值时暂停读取该连接, 发完后再恢复, 对端只发不收时内存不会一直增长
+static const size_t kMaxPendingOutput = 4 * (proto::kMaxFrameSize + sizeof(uint32_t));
+
+struct Request {
+    uint32_t seq;
+    // 属性部分的哈希, 只在写决策日志时计算
+    uint64_t key;
+    std::map<std::string, Variant> values;
+};
+
+static std::vector<std::string> g_attrs;
+static std::unique_ptr<RuleSet> g_rules;
+static uint32_t g_version = 0;
+static std::unique_ptr<DecisionLog> g_log;
+
+static int setNonBlock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int listenUnix(const std::string& path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        close(fd);
+        return -1;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(fd, 128) < 0 || setNonBlock(fd) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool reloadRules(const std::string& path)
+{
+    std::unique_ptr<RuleSet> rules(new RuleSet());
+    std::vector<std::string> report;
+    if (!rules->load(path, &report)) {
+        return false;
+    }
+    for (const auto& line : report) {
+        fprintf(stderr, "%s\n", line.c_str());
+    }
+    g_rules.swap(rules);
+    ++g_version;
+    PoolStats ps = g_rules->memoryStats();
+    fprintf(stderr, "loaded %zu rules from %s, %zu nodes in %zu bytes, %zu constant lists for %zu leaves, "
+            "%zu bytes saved\n", g_rules->size(), path.c_str(), ps.nodes, ps.node_bytes, ps.lists, ps.references,
+            ps.saved());
+    return true;
+}
+
+// 解析一个请求, 失败返回 false, 连接将被关闭
+static bool decodeRequest(const char* body, size_t len, Request& req)
+{
+    proto::Reader r(body, len);
+    uint16_t count = 0;
+    if (!r.get(req.seq) || !r.get(count)) {
+        return false;
+    }
+    req.values.clear();
+    if (g_log) {
+        req.key = DecisionLog::hashKey(std::string_view(body + sizeof(req.seq), len - sizeof(req.seq)));
+    }
+    for (uint16_t i = 0; i < count; ++i) {
+        uint8_t slot = 0;
+        if (!r.get(slot) || slot >= g_attrs.size()) {
+            return false;
+        }
+        if (!r.getValue(req.values[g_attrs[slot]])) {
+            return false;
+        }
+    }
+    return r.eof();
+}
+
+// 取出缓冲区中所有完整的请求帧, 作为一批求值
+static bool processInput(Connection& c, std::vector<Request>& batch, std::vector<uint32_t>& matched)
+{
+    size_t off = 0;
+    size_t n = 0;
+    while (c.in.size() - off >= sizeof(uint32_t)) {
+        uint32_t len = 0;
+        memcpy(&len, c.in.data() + off, sizeof(len));
+        if (len > proto::kMaxFrameSize) {
+            return false;
+        }
+        if (c.in.size() - off - sizeof(len) < len) {
+            break;
+        }
+        if (n == batch.size()) {
+            batch.emplace_back();
+        }
+        if (!decodeRequest(c.in.data() + off + sizeof(len), len, batch[n])) {
+            return false;
+        }
+        ++n;
+        off += sizeof(len) + len;
+    }
+    c.in.erase(0, off);
+
+    proto::Writer w(c.out);
+    for (size_t i = 0; i < n; ++i) {
+        matched.clear();
+        g_rules->evaluate(batch[i].values, matched);
+        if (g_log) {
+            g_log->append(batch[i].key, g_version, matched);
+        }
+        size_t pos = w.beginFrame();
+        w.put<uint32_t>(batch[i].seq);
+        w.put<uint32_t>(static_cast<uint32_t>(matched.size()));
+        for (auto id : matched) {
+            w.put<uint32_t>(id);
+        }
+        w.endFrame(pos);
+    }
+    return true;
+}
+
+static size_t pendingOutput(const Connection& c)
+{
+    return c.out.size() - c.out_off;
+}
+
+// 0 写完, 1 还有剩余, -1 出错
+static int flushOutput(Connection& c)
+{
+    while (c.out_off < c.out.size()) {
+        ssize_t n = write(c.fd, c.out.data() + c.out_off, c.out.size() - c.out_off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : -1;
+        }
+        c.out_off += n;
+    }
+    c.out.clear();
+    c.out_off = 0;
+    return 0;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s -r rules [-s socket] [-a attrs] [-l list_dir] [-d log_prefix]\n", prog);
+}
+
+int main(int argc, char* argv[])
+{
+    std::string rules_path;
+    std::string sock_path = "/tmp/routed.sock";
+    std::string attrs = proto::kDefaultAttributes;
+    std::string log_prefix;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:s:a:l:d:h")) != -1) {
+        switch (opt) {
+            case 'r': rules_path = optarg; break;
+            case 'l': ListRegistry::instance().setDirectory(optarg); break;
+            case 's': sock_path = optarg; break;
+            case 'a': attrs = optarg; break;
+            case 'd': log_prefix = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (rules_path.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    proto::SplitAttributes(attrs, g_attrs);
+    if (g_attrs.empty() || g_attrs.size() > 256) {
+        fprintf(stderr, "invalid attribute list: %s\n", attrs.c_str());
+        return 1;
+    }
+    if (!reloadRules(rules_path)) {
+        return 1;
+    }
+    if (!log_prefix.empty()) {
+        g_log.reset(new DecisionLog(DecisionLogOptions(log_prefix)));
+        if (!g_log->open()) {
+            return 1;
+        }
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK);
+    int lfd = listenUnix(sock_path);
+    int efd = epoll_create1(0);
+    if (sfd < 0 || lfd < 0 || efd < 0) {
+        fprintf(stderr, "init failed: %s\n", strerror(errno));
+        return 1;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = lfd;
+    epoll_ctl(efd, EPOLL_CTL_ADD, lfd, &ev);
+    ev.data.fd = sfd;
+    epoll_ctl(efd, EPOLL_CTL_ADD, sfd, &ev);
+    fprintf(stderr, "listening on %s\n", sock_path.c_str());
+
+    std::unordered_map<int, Connection> conns;
+    std::vector<Request> batch;
+    std::vector<uint32_t> matched;
+    struct epoll_event events[64];
+    char buf[64 * 1024];
+    bool running = true;
+    while (running) {
+        int n = epoll_wait(efd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "epoll_wait failed: %s\n", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == sfd) {
+                struct signalfd_siginfo si;
+                while (read(sfd, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGHUP) {
+                        if (!reloadRules(rules_path)) {
+                            fprintf(stderr, "reload failed, keep %zu rules\n", g_rules->size());
+                        }
+                    } else if (si.ssi_signo == SIGUSR1) {
+                        size_t ok = ListRegistry::instance().reloadAll();
+                        for (const auto& kv : ListRegistry::instance().stats()) {
+                            fprintf(stderr, "list %s: %zu entries\n", kv.first.c_str(), kv.second);
+                        }
+                        fprintf(stderr, "reloaded %zu lists\n", ok);
+                    } else {
+                        running = false;
+                    }
+                }
+                continue;
+            }
+            if (fd == lfd) {
+                int cfd;
+                while ((cfd = accept(lfd, NULL, NULL)) >= 0) {
+                    setNonBlock(cfd);
+                    ev.events = EPOLLIN;
+                    ev.data.fd = cfd;
+                    epoll_ctl(efd, EPOLL_CTL_ADD, cfd, &ev);
+                    conns[cfd].fd = cfd;
+                }
+                continue;
+            }
+            auto it = conns.find(fd);
+            if (it == conns.end()) {
+                continue;
+            }
+            Connection& c = it->second;
+            bool closed = (events[i].events & EPOLLERR) != 0;
+            if (!closed && !c.eof && pendingOutput(c) < kMaxPendingOutput &&
+                (events[i].events & (EPOLLIN | EPOLLHUP))) {
+                for (;;) {
+                    ssize_t r = read(fd, buf, sizeof(buf));
+                    if (r > 0) {
+                        c.in.append(buf, r);
+                        if (c.in.size() < kMaxInputBuffer) {
+                            continue;
+                        }
+                        if (!processInput(c, batch, matched)) {
+                            break;
+                        }
+                        if (c.in.size() >= kMaxInputBuffer) {
+                            fprintf(stderr, "input too large, close fd %d\n", fd);
+                            closed = true;
+                            break;
+                        }
+                        if (pendingOutput(c) >= kMaxPendingOutput && flushOutput(c) != 0) {
+                            // 对端没有及时读取响应, 剩余请求留在 socket 中, 发完后再读
+                            break;
+                        }
+                        continue;
+                    }
+                    if (r == 0) {
+                        // 对端半关闭: 已收到的请求照常求值, 响应发完后再关闭
+                        c.eof = true;
+                    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                        closed = true;
+                    }
+                    if (r < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                if (!closed && !processInput(c, batch, matched)) {
+                    fprintf(stderr, "bad request, close fd %d\n", fd);
+                    closed = true;
+                }
+            }
+            if (!closed) {
+                int w = flushOutput(c);
+                if (w < 0 || (w == 0 && c.eof)) {
+                    closed = true;
+                } else {
+                    bool reading = !c.eof && pendingOutput(c) < kMaxPendingOutput;
+                    ev.events = w ? static_cast<uint32_t>(EPOLLOUT) : 0u;
+                    ev.events |= reading ? static_cast<uint32_t>(EPOLLIN) : 0u;
+                    ev.data.fd = fd;
+                    epoll_ctl(efd, EPOLL_CTL_MOD, fd, &ev);
+                }
+            }
+            if (closed) {
+                epoll_ctl(efd, EPOLL_CTL_DEL, fd, NULL);
+                close(fd);
+                conns.erase(it);
+            }
+        }
+    }
+    for (auto& kv : conns) {
+        close(kv.first);
+    }
+    close(lfd);
+    unlink(sock_path.c_str());
+    if (g_log) {
+        g_log->flush();
+        DecisionStats ds = g_log->stats();
+        fprintf(stderr, "decision log: %llu written, %llu dropped, %llu failed, %llu bytes in %llu segments\n",
+                static_cast<unsigned long long>(ds.written), static_cast<unsigned long long>(ds.dropped),
+                static_cast<unsigned long long>(ds.failed), static_cast<unsigned long long>(ds.bytes),
+                static_cast<unsigned long long>(ds.segments));
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * routed_bench: routed 的压测客户端
+ *
+ * 每个连接一次发送 depth 个请求 (pipeline), 收齐响应后再发下一批,
+ * 结束时输出吞吐和每批平均延迟.
+ *
+ * usage: routed_bench [-s /tmp/routed.sock] [-n 1000000] [-d 64] [-c 1]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+#include "Protocol.h"
+
+using namespace route;
+
+static std::atomic<uint64_t> g_matched(0);
+
+static int connectUnix(const std::string& path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool writeAll(int fd, const std::string& buf)
+{
+    size_t off = 0;
+    while (off < buf.size()) {
+        ssize_t n = write(fd, buf.data() + off, buf.size() - off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        off += n;
+    }
+    return true;
+}
+
+// 与 main.cc 的测试数据一致: V P A E
+static void encodeRequest(proto::Writer& w, uint32_t seq, const std::vector<int>& slots, unsigned int& seed)
+{
+    static const int vers[] = {1208, 1206, 1209, 1205, 1207};
+    size_t pos = w.beginFrame();
+    w.put<uint32_t>(seq);
+    w.put<uint16_t>(4);
+    w.put<uint8_t>(slots[0]);
+    w.put<uint8_t>(proto::T_INT32);
+    w.put<int32_t>(vers[rand_r(&seed) % 5]);
+    w.put<uint8_t>(slots[1]);
+    w.put<uint8_t>(proto::T_INT32);
+    w.put<int32_t>(seq % 2);
+    w.put<uint8_t>(slots[2]);
+    w.put<uint8_t>(proto::T_INT32);
+    w.put<int32_t>(seq % 2);
+    w.put<uint8_t>(slots[3]);
+    w.put<uint8_t>(proto::T_STRING);
+    w.putString("abtest");
+    w.endFrame(pos);
+}
+
+static void run(const std::string& path, const std::vector<int>& slots, uint64_t total, int depth)
+{
+    int fd = connectUnix(path);
+    if (fd < 0) {
+        fprintf(stderr, "connect %s failed: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+    unsigned int seed = static_cast<unsigned int>(time(NULL)) ^ fd;
+    std::string out;
+    std::string in;
+    std::vector<char> buf(64 * 1024);
+    uint64_t sent = 0;
+    uint64_t matched = 0;
+    while (sent < total) {
+        out.clear();
+        proto::Writer w(out);
+        int batch = static_cast<int>(std::min<uint64_t>(depth, total - sent));
+        for (int i = 0; i < batch; ++i) {
+            encodeRequest(w, static_cast<uint32_t>(sent + i), slots, seed);
+        }
+        if (!writeAll(fd, out)) {
+            fprintf(stderr, "write failed: %s\n", strerror(errno));
+            break;
+        }
+        int received = 0;
+        while (received < batch) {
+            ssize_t n = read(fd, buf.data(), buf.size());
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                fprintf(stderr, "connection closed by server\n");
+                close(fd);
+                return;
+            }
+            in.append(buf.data(), n);
+            size_t off = 0;
+            while (in.size() - off >= sizeof(uint32_t)) {
+                uint32_t len = 0;
+                memcpy(&len, in.data() + off, sizeof(len));
+                if (in.size() - off - sizeof(len) < len) {
+                    break;
+                }
+                proto::Reader r(in.data() + off + sizeof(len), len);
+                uint32_t seq = 0;
+                uint32_t count = 0;
+                r.get(seq);
+                r.get(count);
+                matched += count;
+                ++received;
+                off += sizeof(len) + len;
+            }
+            in.erase(0, off);
+        }
+        sent += batch;
+    }
+    g_matched += matched;
+    close(fd);
+}
+
+int main(int argc, char* argv[])
+{
+    std::string path = "/tmp/routed.sock";
+    std::string attrs = proto::kDefaultAttributes;
+    uint64_t total = 1000000;
+    int depth = 64;
+    int conns = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:d:c:a:h")) != -1) {
+        switch (opt) {
+            case 's': path = optarg; break;
+            case 'n': total = strtoull(optarg, NULL, 10); break;
+            case 'd': depth = atoi(optarg); break;
+            case 'c': conns = atoi(optarg); break;
+            case 'a': attrs = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-s socket] [-n requests] [-d depth] [-c conns] [-a attrs]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (depth <= 0 || conns <= 0) {
+        fprintf(stderr, "depth and conns must be positive\n");
+        return 1;
+    }
+    std::vector<std::string> names;
+    proto::SplitAttributes(attrs, names);
+    const char* need[] = {"V", "P", "A", "E"};
+    std::vector<int> slots;
+    for (const char* name : need) {
+        size_t i = 0;
+        while (i < names.size() && names[i] != name) {
+            ++i;
+        }
+        if (i == names.size()) {
+            fprintf(stderr, "attribute %s not in %s\n", name, attrs.c_str());
+            return 1;
+        }
+        slots.push_back(static_cast<int>(i));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> ths;
+    for (int i = 0; i < conns; ++i) {
+        ths.emplace_back(run, path, slots, total / conns, depth);
+    }
+    for (auto& th : ths) {
+        th.join();
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t done = total / conns * conns;
+    printf("requests %llu, matched rules %llu, %.3f s, %.0f req/s, %.2f us per batch of %d\n",
+           (unsigned long long)done, (unsigned long long)g_matched.load(), sec, done / sec,
+           sec * 1e6 / ((done + depth - 1) / depth) * conns, depth);
+    return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * static_check: StaticExpression 与 XExpression 的对照自检
+ *
+ * 同一组表达式在编译期用 static_assert 检查若干取值, 运行时再在一组取值上与 XExpression::compile
+ * 的结果逐一比较. 编译通过且全部一致时输出 "ok" 并返回 0, 否则输出第一处不符并返回 1.
+ *
+ * usage: static_check
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+#include "StaticExpression.h"
+#include "xExpression.h"
+
+using namespace route;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "static_check:%d: %s: ", __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+struct Request {
+    int32_t p;
+    uint64_t uid;
+    double score;
+    std::string_view e;
+    static constexpr std::string_view names[] = {"P", "uid", "score", "E"};
+    template<size_t I> constexpr auto get() const { return std::get<I>(std::tie(p, uid, score, e)); }
+};
+
+ROUTE_STATIC_EXPRESSION(IntRange, "P=[1,10] && E={abc,xyz}");
+ROUTE_STATIC_EXPRESSION(UnsignedSet, "uid={0,5,18446744073709551615}");
+ROUTE_STATIC_EXPRESSION(UnsignedRange, "uid=(9223372036854775807,18446744073709551615]");
+ROUTE_STATIC_EXPRESSION(DoubleRange, "score=(0.5,1.25] || P={7}");
+ROUTE_STATIC_EXPRESSION(DoubleSet, "score={0.1,2,3.75}");
+
+constexpr Request Make(int32_t p, uint64_t uid, double score, std::string_view e)
+{
+    return Request{p, uid, score, e};
+}
+
+static_assert(IntRange::evaluate(Make(1, 0, 0, "abc")), "");
+static_assert(!IntRange::evaluate(Make(11, 0, 0, "abc")), "");
+static_assert(!IntRange::evaluate(Make(5, 0, 0, "ab")), "");
+static_assert(UnsignedSet::evaluate(Make(0, 18446744073709551615ULL, 0, "")), "");
+static_assert(!UnsignedSet::evaluate(Make(0, 4, 0, "")), "");
+static_assert(UnsignedRange::evaluate(Make(0, 9223372036854775808ULL, 0, "")), "");
+static_assert(!UnsignedRange::evaluate(Make(0, 9223372036854775807ULL, 0, "")), "");
+static_assert(DoubleRange::evaluate(Make(0, 0, 1.25, "")), "");
+static_assert(!DoubleRange::evaluate(Make(0, 0, 0.5, "")), "");
+static_assert(DoubleRange::evaluate(Make(7, 0, 0, "")), "");
+static_assert(DoubleSet::evaluate(Make(0, 0, 0.1, "")), "");
+static_assert(!DoubleSet::evaluate(Make(0, 0, 0.2, "")), "");
+
+// 在每组取值上对照编译期与运行时的结果
+template<class Exp>
+static int compare(const Request* reqs, size_t n)
+{
+    ASTExp* exp = XExpression::compile(std::string(Exp::text()));
+    CHECK(exp, "compile failed: %.*s", static_cast<int>(Exp::text().size()), Exp::text().data());
+    for (size_t i = 0; i < n; ++i) {
+        const Request& r = reqs[i];
+        std::map<std::string, Variant> values;
+        values["P"] = Variant(static_cast<int>(r.p));
+        values["uid"] = Variant(static_cast<unsigned long long>(r.uid));
+        values["score"] = Variant(r.score);
+        values["E"] = Variant(std::string(r.e));
+        bool expect = exp->evaluate(values);
+        CHECK(Exp::evaluate(r) == expect, "%.*s: P=%d uid=%llu score=%g E=%.*s, runtime %d",
+              static_cast<int>(Exp::text().size()), Exp::text().data(), r.p,
+              static_cast<unsigned long long>(r.uid), r.score, static_cast<int>(r.e.size()), r.e.data(), expect);
+    }
+    SAFE_RELEASE(exp);
+    return 0;
+}
+
+int main()
+{
+    CHECK(Schema::instance().define("uid", FIELD_ULONG).valid(), "define uid");
+    CHECK(Schema::instance().define("score", FIELD_DOUBLE).valid(), "define score");
+
+    const Request reqs[] = {
+        Make(0, 0, 0, ""),
+        Make(1, 5, 0.1, "abc"),
+        Make(10, 4, 0.5, "xyz"),
+        Make(7, 9223372036854775807ULL, 0.50001, "ab"),
+        Make(11, 9223372036854775808ULL, 1.25, "abc"),
+        Make(5, 18446744073709551615ULL, 1.2500001, "xyz"),
+        Make(-3, 18446744073709551614ULL, 3.75, "abcd"),
+        Make(2, 1ULL << 32, 2, "x"),
+    };
+    size_t n = sizeof(reqs) / sizeof(reqs[0]);
+    if (compare<IntRange>(reqs, n) || compare<UnsignedSet>(reqs, n) || compare<UnsignedRange>(reqs, n) ||
+        compare<DoubleRange>(reqs, n) || compare<DoubleSet>(reqs, n)) {
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -1,90 +1,368 @@
 #include "xExpression.h"
+#include "Optimizer.h"
+#include "Tracer.h"
 
 namespace route {
 
 ASTExp::ASTExp(const std::string& exp):
 _tree(nullptr),
+_pools(nullptr),
 _exp(exp)
 {
 }
 
-ASTExp::ASTExp() 
+ASTExp::ASTExp():
+_tree(nullptr),
+_pools(nullptr)
 {
 }
 
 ASTExp::~ASTExp()
 {
-    release(_tree);
+    release();
+    TreeNode::destroy(_tree);
 }
 
-void ASTExp::release(TreeNode* t)
+void TreeNode::destroy(TreeNode* t)
 {
+    std::vector<TreeNode*> stack;
     if (t) {
-        release(t->l);
-        release(t->r);
-        SAFE_RELEASE(t);
+        stack.push_back(t);
+    }
+    while (!stack.empty()) {
+        TreeNode* n = stack.back();
+        stack.pop_back();
+        stack.insert(stack.end(), n->children.begin(), n->children.end());
+        delete n;
     }
 }
 
+/**
+* @brief 从左到右建树, 不递归
+*
+* 语法为 leaf (op leaf)*, 没有优先级, 按从左到右结合. 与当前根相同的操作符直接追加操作数,
+* 不同时以当前根为第一个操作数新建一层, 如 a && b && c || d 为 OR(AND(a, b, c), d).
+*/
 bool ASTExp::parse(std::stack<std::string>& tokens)
 {
-    bool ret = true;
-    _tree = buildTree(tokens, ret);
+    // 栈顶为最后一个 token
+    std::vector<std::string> seq(tokens.size());
+    for (size_t i = seq.size(); i > 0; --i) {
+        seq[i - 1].swap(tokens.top());
+        tokens.pop();
+    }
+    bool ret = seq.empty() || seq.size() % 2 == 1;
+    TreeNode* root = nullptr;
+    TreeNode* op = nullptr;
+    for (size_t i = 0; ret && i < seq.size(); ++i) {
+        std::string& token = seq[i];
+        token.erase(std::remove_if(token.begin(), token.end(), [](unsigned char ch){ return std::isspace(ch);}), token.end());
+        TreeNode* node = new TreeNode();
+        if (!node->build(token)) {
+            fprintf(stderr, "error token format: %s\n", token.c_str());
+            SAFE_RELEASE(node);
+            ret = false;
+            break;
+        }
+        // 偶数位置是叶子, 奇数位置是操作符
+        bool is_op = node->type == AND || node->type == OR;
+        if (is_op != (i % 2 == 1)) {
+            SAFE_RELEASE(node);
+            ret = false;
+            break;
+        }
+        if (is_op) {
+            op = node;
+            continue;
+        }
+        if (!root) {
+            root = node;
+        } else if (root->type == op->type) {
+            root->children.push_back(node);
+            SAFE_RELEASE(op);
+        } else {
+            op->children.push_back(root);
+            op->children.push_back(node);
+            root = op;
+            op = nullptr;
+        }
+    }
+    SAFE_RELEASE(op);
+    _tree = root;
     if (ret) {
-      ret = isValid(_tree);
-    } 
+      updateAttributes();
+      updateHot();
+    }
     return ret;
 }
 
-bool ASTExp::isValid(TreeNode* t)
+void ASTExp::optimize(std::vector<std::string>* report)
 {
-    if (!t) {
-      return true;
+    // 化简会合并和丢弃叶子, 先取回常量, 化简后再入池
+    ConstantPools* pools = _pools;
+    release();
+    ExpOptimizer optimizer(report);
+    _tree = optimizer.optimize(_tree);
+    updateAttributes();
+    if (pools) {
+        intern(*pools);
+    } else {
+        updateHot();
     }
-    if (t->type == AND || t->type == OR) {
-      if (t->l == nullptr || t->r == nullptr) {
-        return false;
+}
+
+void ASTExp::intern(ConstantPools& pools)
+{
+    if (_pools && _pools != &pools) {
+        release();
+    }
+    TreeNode::visit(_tree, [&pools](TreeNode* t) {
+      if (t->p) {
+        t->p->Intern(pools);
       }
+      return true;
+    });
+    _pools = &pools;
+    updateHot();
+}
+
+void ASTExp::release()
+{
+    if (!_pools) {
+        return;
     }
-    else {
-      if (t->l != nullptr || t->r != nullptr) {
+    ConstantPools& pools = *_pools;
+    TreeNode::visit(_tree, [&pools](TreeNode* t) {
+      if (t->p) {
+        t->p->Release(pools);
+      }
+      return true;
+    });
+    _pools = nullptr;
+}
+
+void ASTExp::footprint(PoolStats& stats) const
+{
+    TreeNode::visit(_tree, [&stats](TreeNode* t) {
+      ++stats.nodes;
+      stats.node_bytes += sizeof(TreeNode) + t->children.capacity() * sizeof(TreeNode*) +
+                          ValueBytes(t->name) - sizeof(std::string);
+      if (t->p) {
+        stats.node_bytes += t->p->Footprint();
+      }
+      return true;
+    });
+}
+
+void ASTExp::updateAttributes()
+{
+    _attrs.clear();
+    _size = 0;
+    _volatile = false;
+    TreeNode::visit(_tree, [this](TreeNode* t) {
+      ++_size;
+      if (t->type == NUM) {
+        _attrs.push_back(t->name);
+        _volatile = _volatile || (t->p && t->p->IsVolatile());
+      } else if (t->type == CLOCK) {
+        _attrs.push_back("@" + t->name);
+      }
+      return true;
+    });
+    std::sort(_attrs.begin(), _attrs.end());
+    _attrs.erase(std::unique(_attrs.begin(), _attrs.end()), _attrs.end());
+}
+
+// 每个叶子最多预取 4 行常量, 总数有上限, 大表达式只预取靠前的部分
+static const size_t kHotLines = 4;
+static const size_t kMaxHot = 48;
+
+void ASTExp::updateHot()
+{
+    _hot.clear();
+    TreeNode::visit(_tree, [this](TreeNode* t) {
+      if (_hot.size() >= kMaxHot) {
         return false;
       }
-    }
-    return isValid(t->l) && isValid(t->r);
+      _hot.push_back(t);
+      if (!t->children.empty()) {
+        _hot.push_back(t->children.data());
+      }
+      if (t->p) {
+        _hot.push_back(t->p);
+        size_t bytes = 0;
+        const char* data = static_cast<const char*>(t->p->ConstantData(bytes));
+        for (size_t off = 0; data && off < bytes && off < kHotLines * 64; off += 64) {
+          _hot.push_back(data + off);
+        }
+      }
+      return true;
+    });
+    std::vector<const void*>(_hot).swap(_hot);
 }
 
-TreeNode* ASTExp::buildTree(std::stack<std::string>& tokens, bool& ret)
+void ASTExp::activeWindow(int64_t& from, int64_t& until) const
 {
-    if (tokens.size() <= 0) {
-        return nullptr;
-    }
-    std::string token = tokens.top();
-    token.erase(std::remove_if(token.begin(), token.end(), [](unsigned char ch){ return std::isspace(ch);}), token.end());
-    tokens.pop();
-    TreeNode* root = new TreeNode();
-    if (!root->build(token)) {
-        fprintf(stderr, "error token format: %s\n", token.c_str());
-        ret = false;
-        SAFE_RELEASE(root);
-        return root;
+    from = std::numeric_limits<int64_t>::min();
+    until = std::numeric_limits<int64_t>::max();
+    // 只看根节点 AND 链上的叶子
+    TreeNode::visit(_tree, [&from, &until](TreeNode* t) {
+      int64_t lo, hi;
+      if (t->type == CLOCK && t->p->Window(lo, hi)) {
+        from = std::max(from, lo);
+        until = std::min(until, hi);
+      }
+      return t->type == AND;
+    });
+}
+
+// 把属性值格式化为轨迹中的文本
+static size_t formatValue(const Variant& v, char* buf, size_t cap)
+{
+    int n = 0;
+    if (v.isString()) {
+        const std::string& s = v.asConstString();
+        n = snprintf(buf, cap, "%s", s.c_str());
+    } else if (v.isFloat() || v.isDouble()) {
+        n = snprintf(buf, cap, "%g", v.asConstDouble());
+    } else if (v.isVersion()) {
+        n = snprintf(buf, cap, "%s", v.asConstVersion().ToString().c_str());
+    } else if (v.isIp()) {
+        n = snprintf(buf, cap, "%s", v.asConstIp().ToString().c_str());
+    } else if (v.isUInt() || v.isULong() || v.isULongLong()) {
+        n = snprintf(buf, cap, "%llu", v.asConstULongLong());
+    } else if (!v.isEmpty()) {
+        n = snprintf(buf, cap, "%lld", v.asConstLongLong());
     }
-    if (root->type == AND || root->type == OR) {
-        root->l = buildTree(tokens, ret);
+    return n < 0 ? 0 : std::min(static_cast<size_t>(n), cap - 1);
+}
+
+static size_t formatValue(const RawValue& v, char* buf, size_t cap)
+{
+    int n = 0;
+    switch (v.type) {
+        case RawValue::TEXT:
+        case RawValue::STRING:
+            n = snprintf(buf, cap, "%.*s", static_cast<int>(v.len), v.data);
+            break;
+        case RawValue::INT32: {
+            int32_t i;
+            memcpy(&i, v.data, sizeof(i));
+            n = snprintf(buf, cap, "%d", i);
+            break;
+        }
+        case RawValue::UINT32: {
+            uint32_t u;
+            memcpy(&u, v.data, sizeof(u));
+            n = snprintf(buf, cap, "%u", u);
+            break;
+        }
+        case RawValue::DOUBLE: {
+            double d;
+            memcpy(&d, v.data, sizeof(d));
+            n = snprintf(buf, cap, "%g", d);
+            break;
+        }
+        case RawValue::VERSION: {
+            uint64_t packed;
+            memcpy(&packed, v.data, sizeof(packed));
+            n = snprintf(buf, cap, "%s", Version(packed).ToString().c_str());
+            break;
+        }
+        case RawValue::IP: {
+            IpAddr addr;
+            memcpy(&addr, v.data, sizeof(addr));
+            n = snprintf(buf, cap, "%s", addr.ToString().c_str());
+            break;
+        }
     }
-    else {
-       TreeNode* ptr = buildTree(tokens, ret);
-       if (ptr) {
-        ptr->r = root;
-        root = ptr;
-       }
+    return n < 0 ? 0 : std::min(static_cast<size_t>(n), cap - 1);
+}
+
+// 结构体成员及其绑定, 供 evaluateWith 统一比较和格式化
+struct BoundMember {
+    const BoundField* field;
+    const char* data;
+};
+
+static bool matchLeaf(TreeNode* t, const Variant* v) { return ASTExp::matchValue(t, *v); }
+static bool matchLeaf(TreeNode* t, const RawValue& v) { return ASTExp::matchValue(t, v); }
+static bool matchLeaf(TreeNode* t, const BoundMember& m) { return t->p && m.field->match(t->p, m.data); }
+
+static size_t formatLeaf(const Variant* v, char* buf, size_t cap) { return formatValue(*v, buf, cap); }
+static size_t formatLeaf(const RawValue& v, char* buf, size_t cap) { return formatValue(v, buf, cap); }
+static size_t formatLeaf(const BoundMember& m, char* buf, size_t cap) { return m.field->format(m.data, buf, cap); }
+
+// 轨迹中缺失属性的取值
+static const char kMissingValue[] = "<missing>";
+
+template<class Value, class FetchFn>
+bool ASTExp::evaluateWith(FetchFn fetch)
+{
+    if (Tracer::sample()) {
+        TraceScope scope(this);
+        auto leaf = [&fetch, &scope](TreeNode* t) {
+            uint64_t start = Tracer::cycles();
+            Value v;
+            bool found = fetch(t, v);
+            bool ret = found && matchLeaf(t, v);
+            uint64_t cost = Tracer::cycles() - start;
+            char buf[64];
+            if (found) {
+                scope.leaf(t->name, buf, formatLeaf(v, buf, sizeof(buf)), ret, cost);
+            } else {
+                scope.leaf(t->name, kMissingValue, sizeof(kMissingValue) - 1, ret, cost);
+            }
+            return ret;
+        };
+        bool ret = match(_tree, leaf);
+        scope.finish(_exp, ret);
+        return ret;
     }
-    return root;
+    auto leaf = [&fetch](TreeNode* t) {
+        Value v;
+        return fetch(t, v) && matchLeaf(t, v);
+    };
+    return match(_tree, leaf);
 }
 
 bool ASTExp::evaluate(const std::map<std::string, Variant>& values)
 {
-    return match(_tree, values);
+    return evaluateWith<const Variant*>([&values](TreeNode* t, const Variant*& v) {
+        auto it = values.find(t->name);
+        v = it == values.end() ? nullptr : &it->second;
+        return v != nullptr;
+    });
+}
+
+bool ASTExp::evaluate(RequestBuffer& buffer)
+{
+    return evaluateWith<RawValue>([&buffer](TreeNode* t, RawValue& v) { return buffer.find(t->name, v); });
+}
+
+bool ASTExp::evaluate(LazyAttributes& attrs)
+{
+    return evaluateWith<const Variant*>([&attrs](TreeNode* t, const Variant*& v) {
+        v = attrs.find(t->name);
+        return v != nullptr;
+    });
+}
+
+bool ASTExp::evaluate(const Record& record)
+{
+    return evaluateWith<const Variant*>([&record](TreeNode* t, const Variant*& v) {
+        v = t->field ? record.find(*t->field) : nullptr;
+        return v != nullptr;
+    });
+}
+
+bool ASTExp::evaluateBound(const char* obj, const FieldBinding& binding)
+{
+    return evaluateWith<BoundMember>([obj, &binding](TreeNode* t, BoundMember& m) {
+        m.field = t->field ? binding.find(*t->field) : nullptr;
+        m.data = m.field ? obj + m.field->offset : nullptr;
+        return m.field != nullptr;
+    });
 }
 
 std::string ASTExp::getExp() const
@@ -92,37 +370,66 @@ std::string ASTExp::getExp() const
     return _exp;
 }
 
-bool ASTExp::match(TreeNode* t, const std::map<std::string, Variant>& values)
+bool ASTExp::matchValue(TreeNode* t, const Variant& data)
 {
-    if (!t) {
-        return true;
+    if (data.isInt()) {
+        return t->valid<int32_t>(data.asConstInt());
+    } else if (data.isUInt()) {
+        return t->valid<uint32_t>(data.asConstUInt());
+    } else if (data.isLong() || data.isLongLong()) {
+        return t->valid<int64_t>(data.asConstLongLong());
+    } else if (data.isULong() || data.isULongLong()) {
+        return t->valid<uint64_t>(data.asConstULongLong());
+    } else if (data.isString()) {
+        return t->valid<std::string>(data.asConstString());
+    } else if (data.isDouble()) {
+        return t->valid<double>(data.asConstDouble());
+    } else if (data.isFloat()) {
+        return t->valid<float>(data.asConstFloat());
+    } else if (data.isVersion()) {
+        return t->valid<Version>(data.asConstVersion());
+    } else if (data.isIp()) {
+        return t->valid<IpAddr>(data.asConstIp());
+    } else {
+        fprintf(stderr, "Not support type\n");
+        return false;
     }
-    if (t->type == NUM) {
-        auto it = values.find(t->name);
-        if (it == values.end()) {
-            return false;
+}
+
+bool ASTExp::matchValue(TreeNode* t, const RawValue& data)
+{
+    if (!t->p) {
+        return false;
+    }
+    switch (data.type) {
+        case RawValue::TEXT:
+        case RawValue::STRING:
+            return t->p->IsValidRaw(data.data, data.len);
+        case RawValue::INT32: {
+            int32_t i;
+            memcpy(&i, data.data, sizeof(i));
+            return t->p->IsValid(i);
         }
-        const Variant& data = it->second;
-        if (data.isInt()) {
-            return t->valid<int32_t>(data.asConstInt());
-        } else if (data.isUInt()) {
-            return t->valid<uint32_t>(data.asConstUInt());
-        } else if (data.isString()) {
-            return t->valid<std::string>(data.asConstString());
-        } else if (data.isDouble()) {
-            return t->valid<double>(data.asConstDouble());
-        } else if (data.isFloat()) {
-            return t->valid<float>(data.asConstFloat());
-        } else {
-            fprintf(stderr, "Not support type\n");
-            return false;
+        case RawValue::UINT32: {
+            uint32_t u;
+            memcpy(&u, data.data, sizeof(u));
+            return t->p->IsValid(u);
+        }
+        case RawValue::DOUBLE: {
+            double d;
+            memcpy(&d, data.data, sizeof(d));
+            return t->p->IsValid(d);
+        }
+        case RawValue::VERSION: {
+            uint64_t packed;
+            memcpy(&packed, data.data, sizeof(packed));
+            return t->p->IsValid(Version(packed));
+        }
+        case RawValue::IP: {
+            IpAddr addr;
+            memcpy(&addr, data.data, sizeof(addr));
+            return t->p->IsValid(addr);
         }
-    }
-    else if (t->type == AND) {
-        return match(t->l, values) && match(t->r, values);
-    }
-    else if (t->type == OR) {
-        return match(t->r, values) || match(t->l, values);
     }
     return false;
 }
@@ -142,7 +449,7 @@ ASTExp* XExpression::compile(const std::string& exp)
 
 bool XExpression::lexer(const std::string& exp, std::stack<std::string>& tokens)
 {
-    char prec;
+    char prec = ' ';
     char curc;
     std::string token;
     bool can_push = false;
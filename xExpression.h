@@ -3,10 +3,15 @@
 #include "checker.h"
 #include "StringUtil.h"
 #include "Variant.h"
+#include "RequestBuffer.h"
+#include "LazyAttributes.h"
+#include "Schema.h"
+#include "FieldBinding.h"
 
 #include <string.h>
 #include <map>
 #include <stack>
+#include <vector>
 #include <functional>
 
 namespace route {
@@ -17,28 +22,72 @@ if (p) { \
     p = nullptr; \
 }
 
-enum Type {INVALID, NUM, AND, OR};
+// ALWAYS/NEVER 为优化后折叠出的常量节点, CLOCK 为与当前时间比较的叶子
+enum Type {INVALID, NUM, AND, OR, ALWAYS, NEVER, CLOCK};
 
 using Creator = std::function<IChecker*(void)>;
 using CheckerCreatorMap = std::map<std::string, Creator>;
 const CheckerCreatorMap checker_map = {
-   {"V",  std::bind(IntChecker::Create)},
+   {"V",  std::bind(VersionChecker::Create)},
    {"P",  std::bind(IntChecker::Create)},
    {"A",  std::bind(IntChecker::Create)},
    {"L",  std::bind(IntChecker::Create)},
-   {"E", std::bind(StringChecker::Create)}
+   {"E", std::bind(StringChecker::Create)},
+   {"U", std::bind(StringChecker::Create)},
+   {"CIDR", std::bind(CidrChecker::Create)},
+   {"TIME", std::bind(TimeChecker<CLOCK_TIME>::Create)},
+   {"HOUR", std::bind(TimeChecker<CLOCK_HOUR>::Create)},
+   {"WDAY", std::bind(TimeChecker<CLOCK_WDAY>::Create)}
+};
+
+// 不在 checker_map 中的属性按 Schema::instance() 中的字段类型选择 checker
+const std::map<FieldType, Creator> field_checker_map = {
+   {FIELD_INT, std::bind(IntChecker::Create)},
+   {FIELD_LONG, std::bind(WideLongChecker::Create)},
+   {FIELD_ULONG, std::bind(WideULongChecker::Create)},
+   {FIELD_DOUBLE, std::bind(DoubleChecker::Create)},
+   {FIELD_STRING, std::bind(StringChecker::Create)},
+   {FIELD_VERSION, std::bind(VersionChecker::Create)},
+   {FIELD_IP, std::bind(CidrChecker::Create)}
 };
 
 struct TreeNode {
    std::string name;
    Type type;
    IChecker* p;
-   TreeNode* r;
-   TreeNode* l;
-   TreeNode():type(INVALID), p(nullptr), r(nullptr), l(nullptr) {}
+   // AND/OR 的操作数, 连续的同类操作符展开在同一层; 叶子为空
+   std::vector<TreeNode*> children;
+   // 属性在 Schema 中的位置, 从 Record 或 Binding 取值时使用; 未定义时为 nullptr
+   const FieldRef* field;
+   TreeNode():type(INVALID), p(nullptr), field(nullptr) {}
+   // 只释放自己, 整棵树用 destroy
    ~TreeNode() {
         SAFE_RELEASE(p);
    }
+
+   // 释放整棵树, 不递归, 任意深度的树都不会栈溢出
+   static void destroy(TreeNode* t);
+
+   /**
+   * @brief 不递归的先序遍历, 操作数按从左到右的顺序访问
+   *
+   * @param fn bool(TreeNode*) 或 bool(const TreeNode*), 返回 false 时不访问该节点的操作数
+   */
+   template<class Node, class Fn>
+   static void visit(Node* t, Fn&& fn)
+   {
+    std::vector<Node*> stack;
+    if (t) {
+        stack.push_back(t);
+    }
+    while (!stack.empty()) {
+        Node* n = stack.back();
+        stack.pop_back();
+        if (fn(n)) {
+            stack.insert(stack.end(), n->children.rbegin(), n->children.rend());
+        }
+    }
+   }
    bool build(const std::string& str)
    {
     if (str == "||") {
@@ -51,20 +100,48 @@ struct TreeNode {
         type = AND;
         return true;
     } else {
-        std::vector<std::string> values;
-        if (gsl::StringSplit(str, values, '=') < 2) {
+        size_t eq = str.find('=');
+        if (eq == std::string::npos) {
             return false;
         }
         type = NUM;
-        name = values[0];
+        std::string_view head = std::string_view(str).substr(0, eq);
+        std::string_view pattern = std::string_view(str).substr(eq + 1);
+        // COUNT(event,ATTR,window) 比较 ATTR 取值上的事件计数, 叶子名为 ATTR
+        if (CountChecker::IsCountHead(head)) {
+            CountChecker* c = new CountChecker();
+            p = c;
+            if (c->ParseHead(head, name) || c->Parser(pattern)) {
+                SAFE_RELEASE(p);
+                return false;
+            }
+            field = Schema::instance().resolve(name);
+            return true;
+        }
+        name.assign(head);
+        FieldType ft = FIELD_RECORD;
+        field = Schema::instance().resolve(name, &ft);
+        const Creator* create = nullptr;
         auto it = checker_map.find(name);
-        if (it == checker_map.end()) {
+        if (it != checker_map.end()) {
+            create = &it->second;
+        } else if (field) {
+            // 如 user.age, 按字段类型比较
+            create = &field_checker_map.at(ft);
+        } else {
             return false;
         }
-        p = it->second();
-        int ret = p->Parser(values[1]);
+        // @file:name 引用外部名单, 任何属性都可以使用
+        if (ListChecker::IsListPattern(pattern)) {
+            p = new ListChecker();
+        } else {
+            p = (*create)();
+        }
+        int ret = p->Parser(pattern);
         if (ret) {
             SAFE_RELEASE(p);
+        } else if (p->IsClock()) {
+            type = CLOCK;
         }
         return ret == 0;
     }
@@ -85,18 +162,176 @@ public:
     
     bool parse(std::stack<std::string>& tokens);
 
+    // 开启 Tracer 采样时, 被采样的求值会记录访问过的叶子和结果
     bool evaluate(const std::map<std::string, Variant>& values);
 
+    // 直接在序列化的请求上求值, 只解码表达式用到的属性
+    bool evaluate(RequestBuffer& buffer);
+
+    // 属性按需由 provider 计算, 被短路跳过的叶子不会触发计算
+    bool evaluate(LazyAttributes& attrs);
+
+    // 按叶子编译时解析的 FieldRef 从嵌套记录取值, 不查找属性名
+    bool evaluate(const Record& record);
+
+    // 直接从结构体成员取值, 成员按 binding 中的偏移和类型读取, 不构造 map 和 Variant
+    template<class T>
+    bool evaluate(const T& obj, const Binding<T>& binding)
+    {
+        return evaluateBound(reinterpret_cast<const char*>(&obj), binding);
+    }
+
     std::string getExp() const;
+
+    /**
+    * @brief 化简表达式树: 合并同一属性上的区间和集合, 去掉重复的子表达式,
+    * 把不可满足的子树折叠为常量
+    *
+    * @param report 非空时追加每一步化简的说明
+    */
+    void optimize(std::vector<std::string>* report = nullptr);
+
+    // 把各叶子的常量移入 pools, pools 需比表达式存活更久, 表达式析构时归还引用
+    void intern(ConstantPools& pools);
+
+    // 表达式树占用的内存 (节点, checker 及未入池的常量), 计入 stats
+    void footprint(PoolStats& stats) const;
+
+    // 表达式引用到的属性名, 排序去重, parse 时计算; 时间叶子记为 "@TIME" 等
+    const std::vector<std::string>& attributes() const { return _attrs; }
+
+    // 含 COUNT, 外部名单等结果不只取决于属性值的叶子, 不能按属性值缓存
+    bool isVolatile() const { return _volatile; }
+
+    // 预取求值会访问的节点, checker 和常量, 批量求值时提前几条规则调用
+    void prefetch() const
+    {
+        for (const void* p : _hot) {
+            __builtin_prefetch(p);
+        }
+    }
+
+    // 表达式树的节点数, 用作求值代价
+    size_t size() const { return _size; }
+
+    // 供离线分析遍历, 求值请使用 evaluate
+    const TreeNode* tree() const { return _tree; }
+
+    /**
+    * @brief 根节点 AND 链上 TIME 区间的交集 [from, until)
+    *
+    * 在此之外表达式恒为 false; 没有 TIME 区间时为 [INT64_MIN, INT64_MAX)
+    */
+    void activeWindow(int64_t& from, int64_t& until) const;
+
+    // 叶子节点与单个属性值的比较
+    static bool matchValue(TreeNode* t, const Variant& data);
+    static bool matchValue(TreeNode* t, const RawValue& data);
 private:
-    bool match(TreeNode* t, const std::map<std::string, Variant>& values);
-    TreeNode* buildTree(std::stack<std::string>& tokens, bool& ret);
-    void release(TreeNode* t); 
-    // 1 需要是满二叉树，所有叶子节点都是值，其他节点是逻辑操作符
-    bool isValid(TreeNode* t);
+    // 求值栈中的 AND/OR 节点和还未求值的操作数个数
+    struct Frame {
+        TreeNode* node;
+        size_t left;
+    };
+
+    // 前 kInlineFrames 层放在栈上, 更深的表达式才分配内存
+    class FrameStack {
+    public:
+        static constexpr size_t kInlineFrames = 16;
+
+        bool empty() const { return _size == 0; }
+        Frame& top() { return _size <= kInlineFrames ? _inline[_size - 1] : _spill.back(); }
+        void push(const Frame& f)
+        {
+            if (_size < kInlineFrames) {
+                _inline[_size] = f;
+            } else {
+                _spill.push_back(f);
+            }
+            ++_size;
+        }
+        void pop()
+        {
+            if (_size > kInlineFrames) {
+                _spill.pop_back();
+            }
+            --_size;
+        }
+    private:
+        Frame _inline[kInlineFrames];
+        std::vector<Frame> _spill;
+        size_t _size = 0;
+    };
+
+    /**
+    * @brief 按 AND/OR 结构求值, 叶子节点交给 leaf(TreeNode*) 判断
+    *
+    * 不递归, 用显式栈保存未完成的 AND/OR 节点. AND 从左到右, OR 从右到左求值,
+    * 与原来左深二叉树的短路顺序一致.
+    */
+    template<class LeafFn>
+    bool match(TreeNode* t, LeafFn& leaf)
+    {
+        if (!t) {
+            return true;
+        }
+        FrameStack stack;
+        bool ret = false;
+        for (;;) {
+            // 下降到第一个要求值的叶子
+            while ((t->type == AND || t->type == OR) && !t->children.empty()) {
+                size_t n = t->children.size();
+                stack.push(Frame{t, n - 1});
+                t = t->type == AND ? t->children[0] : t->children[n - 1];
+            }
+            if (t->type == NUM) {
+                ret = leaf(t);
+            }
+            else if (t->type == CLOCK) {
+                ret = t->p->IsValidNow();
+            }
+            else {
+                ret = t->type == ALWAYS || t->type == AND;
+            }
+            // 向上回到还有操作数要求值的节点
+            for (;;) {
+                if (stack.empty()) {
+                    return ret;
+                }
+                Frame& f = stack.top();
+                if (f.left == 0 || ret == (f.node->type == OR)) {
+                    stack.pop();
+                    continue;
+                }
+                --f.left;
+                const std::vector<TreeNode*>& c = f.node->children;
+                t = f.node->type == AND ? c[c.size() - 1 - f.left] : c[f.left];
+                break;
+            }
+        }
+    }
+    friend class RuleSet;
+
+    // obj 为 binding 所绑定类型的对象
+    bool evaluateBound(const char* obj, const FieldBinding& binding);
+    // 叶子由 fetch(TreeNode*, Value&) 取值, 取到后比较; Tracer 采样时同时记录取值和耗时
+    template<class Value, class FetchFn>
+    bool evaluateWith(FetchFn fetch);
+    void updateAttributes();
+    // 归还各叶子在常量池中的引用, 常量复制回叶子
+    void release();
+    void updateHot();
 private:
     TreeNode* _tree;
+    // intern 后非空, 叶子的常量在其中
+    ConstantPools* _pools;
     std::string _exp;
+    std::vector<std::string> _attrs;
+    size_t _size = 0;
+    // 含 IsVolatile() 的叶子, 与 _attrs 一起计算
+    bool _volatile = false;
+    // prefetch 的地址, 树或常量位置变化后重新收集
+    std::vector<const void*> _hot;
 }; // ASTExp
 
 class XExpression {